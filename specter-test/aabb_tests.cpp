@@ -37,23 +37,45 @@ TEST(intersections, aabb) {
 	float near, far;
 	ASSERT_TRUE(aabb00.rayIntersect(ray00, near, far) == true);
 	ASSERT_TRUE(near == 1.f);
-	ASSERT_TRUE(far == 2.f);
+	ASSERT_FLOAT_EQ(far, 2.f * specter::robustFarScale);
 
 	specter::Ray ray01(specter::vec3f(0.f, -1.f, 0.f), specter::vec3f(0.f, 1.f, 0.f));
 	ASSERT_TRUE(aabb00.rayIntersect(ray01, near, far) == true);
 	ASSERT_TRUE(near == 1.f);
-	ASSERT_TRUE(far == 2.f);
+	ASSERT_FLOAT_EQ(far, 2.f * specter::robustFarScale);
 
 	specter::Ray ray02(specter::vec3f(-1.f, 0.f, 0.f), specter::vec3f(1.f, 0.f, 0.f));
 	ASSERT_TRUE(aabb00.rayIntersect(ray02, near, far) == true);
 	ASSERT_TRUE(near == 1.f);
-	ASSERT_TRUE(far == 2.f);
+	ASSERT_FLOAT_EQ(far, 2.f * specter::robustFarScale);
 
 	// Rays going in the opposite direction of the AABB should not collide with the AABB
 	specter::Ray ray03(specter::vec3f(0.f, 0.f, 3.f), specter::vec3f(0.f, 0.f, 1.f));
 	EXPECT_TRUE(aabb00.rayIntersect(ray03, near, far) == false);
 }
 
+TEST(intervals, aabb) {
+	specter::AxisAlignedBoundingBox aabb00(specter::vec3f(0.f), specter::vec3f(1.f));
+	float near, far;
+
+	// The box lies completely behind tmax
+	specter::Ray ray00(specter::vec3f(0.5f, 0.5f, -1.f), specter::vec3f(0.f, 0.f, 1.f), 0.f, 0.5f);
+	EXPECT_TRUE(aabb00.rayIntersect(ray00, near, far) == false);
+	EXPECT_TRUE(aabb00.rayIntersectv2(ray00, near, far) == false);
+
+	// The interval is clipped by the box
+	specter::Ray ray01(specter::vec3f(0.5f, 0.5f, -1.f), specter::vec3f(0.f, 0.f, 1.f), 1.5f, 10.f);
+	ASSERT_TRUE(aabb00.rayIntersect(ray01, near, far) == true);
+	ASSERT_TRUE(near == 1.5f);
+	ASSERT_FLOAT_EQ(far, 2.f * specter::robustFarScale);
+
+	// The box is clipped by the interval
+	specter::Ray ray02(specter::vec3f(0.5f, 0.5f, -1.f), specter::vec3f(0.f, 0.f, 1.f), 0.f, 1.25f);
+	ASSERT_TRUE(aabb00.rayIntersectv2(ray02, near, far) == true);
+	ASSERT_TRUE(near == 1.f);
+	ASSERT_TRUE(far == 1.25f);
+}
+
 TEST(miscellaneous, aabb) {
 	specter::vec3f v0(0.f);
 	specter::vec3f v1(0.5f);
@@ -0,0 +1,228 @@
+#include "pch.h"
+#include "../src/accel.hpp"
+#include "../src/simd_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Random triangles in the cube [-10, 10]^3. The triangles of the mesh are the faces[3 * i, 3 * i + 3).
+class SoupModel : public specter::Model {
+
+public:
+
+	SoupModel(const uint32_t nTriangles, const unsigned int seed) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> position(-10.f, 10.f);
+		std::uniform_real_distribution<float> offset(-1.5f, 1.5f);
+		for (uint32_t i = 0; i < nTriangles; ++i) {
+			const specter::vec3f center(position(rng), position(rng), position(rng));
+			for (uint32_t k = 0; k < 3; ++k) {
+				vertices.push_back(center + specter::vec3f(offset(rng), offset(rng), offset(rng)));
+				faces.push_back({ 3 * i + k, 0, 0 });
+			}
+		}
+		normals.emplace_back(0.f, 0.f, 1.f);
+		uvs.emplace_back(0.f);
+		materials.push_back(nullptr);
+		nMeshes = 1;
+		mesh_indices.resize(1);
+		mesh_attribute_sizes.resize(1);
+		mesh_attribute_sizes[0].fsize = faces.size();
+	}
+
+	// Moves every vertex by up to "amplitude" along every axis, which deforms the triangles
+	void deform(const float amplitude, const unsigned int seed) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> offset(-amplitude, amplitude);
+		for (specter::vec3f& vertex : vertices) {
+			vertex = vertex + specter::vec3f(offset(rng), offset(rng), offset(rng));
+		}
+	}
+};
+
+// Instance of a model placed in the scene, see Accel::addInstance()
+struct SceneInstance {
+	std::shared_ptr<specter::Model> model;
+	specter::mat4f transform;
+};
+
+// Configuration of a structure, which is compared against the brute force intersection
+struct AccelConfiguration {
+	const char* name;
+	specter::AccelStructure structure;
+	specter::OctreeParameters octreeParameters;
+	specter::BVHParameters bvhParameters;
+};
+
+static std::vector<AccelConfiguration> accelConfigurations() {
+	std::vector<AccelConfiguration> configurations;
+	configurations.push_back({ "octree", specter::AccelStructure::Octree });
+	configurations.push_back({ "loose octree", specter::AccelStructure::Octree });
+	configurations.back().octreeParameters.loose = true;
+	configurations.push_back({ "octree with triangle blocks", specter::AccelStructure::Octree });
+	configurations.back().octreeParameters.triangleBlockBudget = 1 << 20;
+	configurations.push_back({ "k-d tree", specter::AccelStructure::KdTree });
+
+	for (const specter::AccelStructure structure : { specter::AccelStructure::LBVH, specter::AccelStructure::BVH }) {
+		const char* names[3] = { "LBVH", "wide LBVH", "compressed LBVH" };
+		if (structure == specter::AccelStructure::BVH) {
+			names[0] = "BVH";
+			names[1] = "wide BVH";
+			names[2] = "compressed BVH";
+		}
+		for (int i = 0; i < 3; ++i) {
+			configurations.push_back({ names[i], structure });
+			configurations.back().bvhParameters.wide = i == 1;
+			configurations.back().bvhParameters.compressed = i == 2;
+		}
+	}
+	configurations.push_back({ "LBVH with treelets", specter::AccelStructure::LBVH });
+	configurations.back().bvhParameters.treeletRounds = 2;
+	configurations.push_back({ "BVH with spatial splits", specter::AccelStructure::BVH });
+	configurations.back().bvhParameters.spatialSplits = true;
+
+	// The hierarchies are refitted instead of rebuilt, however far the triangles move
+	for (AccelConfiguration& configuration : configurations) {
+		configuration.bvhParameters.refitThreshold = 1e9f;
+	}
+	return configurations;
+}
+
+// Returns the levels, which the CPU supports
+static std::vector<specter::SimdLevel> supportedSimdLevels() {
+	std::vector<specter::SimdLevel> levels;
+	for (const specter::SimdLevel level : { specter::SimdLevel::SSE42, specter::SimdLevel::AVX2, specter::SimdLevel::AVX512 }) {
+		if (level <= specter::detectSimdLevel()) {
+			levels.push_back(level);
+		}
+	}
+	return levels;
+}
+
+// Rays from random origins in the cube [-14, 14]^3, such that some of them start inside the triangles
+static std::vector<specter::Ray> accelRays(const int nRays, const unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> position(-14.f, 14.f);
+	std::uniform_real_distribution<float> direction(-1.f, 1.f);
+	std::vector<specter::Ray> rays;
+	for (int i = 0; i < nRays; ++i) {
+		const specter::vec3f origin(position(rng), position(rng), position(rng));
+		rays.emplace_back(origin, specter::normalize(specter::vec3f(direction(rng), direction(rng), direction(rng))));
+	}
+	return rays;
+}
+
+// Returns the distance of the closest intersection of the ray with the triangles of all instances,
+// or the maximum float if there is none. The rays are transformed into the space of the instances.
+static float bruteForceClosestHit(const std::vector<SceneInstance>& instances, const specter::Ray& ray) {
+	float closest = std::numeric_limits<float>::max();
+	for (const SceneInstance& instance : instances) {
+		const specter::mat4f worldToObject = specter::inverse(instance.transform);
+		specter::Ray r(specter::transformPoint(worldToObject, ray.o), specter::transformVector(worldToObject, ray.d));
+		for (std::size_t i = 0; i < instance.model->GetTriangleCount(); ++i) {
+			r.tmax = std::min(ray.tmax, closest);
+			float u, v, t;
+			if (instance.model->rayIntersection(r, i, u, v, t)) {
+				closest = t;
+			}
+		}
+	}
+	return closest;
+}
+
+// Compares the closest and any hit of the rays against the brute force intersection
+static void expectBruteForceHits(const specter::Accel& accel, const std::vector<SceneInstance>& instances, const std::vector<specter::Ray>& rays, const std::string& context) {
+	for (const specter::Ray& ray : rays) {
+		const float expected = bruteForceClosestHit(instances, ray);
+		const bool expectedHit = expected != std::numeric_limits<float>::max();
+
+		specter::Intersection intersection;
+		ASSERT_EQ(accel.traceRay(ray, intersection), expectedHit) << context;
+		if (expectedHit) {
+			EXPECT_NEAR(intersection.t, expected, 1e-4f * std::max(1.f, expected)) << context;
+		}
+		ASSERT_EQ(accel.traceShadowRay(ray), expectedHit) << context;
+	}
+}
+
+static std::string describe(const AccelConfiguration& configuration, const specter::SimdLevel level, const specter::TriangleTest test) {
+	return std::string(configuration.name) + ", " + specter::simdLevelName(level) +
+		(test == specter::TriangleTest::Watertight ? ", watertight" : ", moeller-trumbore");
+}
+
+//
+// Closest and any hit of every structure and SIMD level, before and after refitting
+TEST(bruteForce, accel) {
+	const std::vector<specter::Ray> rays = accelRays(400, 5);
+	for (const specter::SimdLevel level : supportedSimdLevels()) {
+		specter::setSimdLevel(level);
+		for (const specter::TriangleTest test : { specter::TriangleTest::MoellerTrumbore, specter::TriangleTest::Watertight }) {
+			for (const AccelConfiguration& configuration : accelConfigurations()) {
+				const std::string context = describe(configuration, level, test);
+				auto soup = std::make_shared<SoupModel>(1500, 3);
+				soup->setTriangleTest(test);
+				std::shared_ptr<specter::Model> model = soup;
+				const std::vector<SceneInstance> instances = { { model, specter::mat4f(1.f) } };
+
+				specter::Accel accel;
+				accel.addModel(model);
+				accel.setStructure(configuration.structure);
+				accel.setBVHParameters(configuration.bvhParameters);
+				accel.build(configuration.octreeParameters);
+				expectBruteForceHits(accel, instances, rays, context);
+
+				soup->deform(0.5f, 9);
+				accel.refit(configuration.octreeParameters);
+				expectBruteForceHits(accel, instances, rays, context + ", refitted");
+			}
+		}
+	}
+	specter::setSimdLevel(specter::detectSimdLevel());
+}
+
+//
+// Instances of two models in the two-level structure, before and after moving the vertices and an instance
+TEST(instances, accel) {
+	const std::vector<specter::Ray> rays = accelRays(300, 19);
+	for (const specter::SimdLevel level : supportedSimdLevels()) {
+		specter::setSimdLevel(level);
+		for (const AccelConfiguration& configuration : accelConfigurations()) {
+			const std::string context = describe(configuration, level, specter::TriangleTest::MoellerTrumbore);
+			auto first = std::make_shared<SoupModel>(500, 23);
+			auto second = std::make_shared<SoupModel>(300, 29);
+			std::vector<SceneInstance> instances;
+			for (int i = 0; i < 4; ++i) {
+				// Rotation around the y axis followed by a translation, see transformPoint()
+				specter::mat4f transform(1.f);
+				const float c = std::cos(0.7f * i);
+				const float s = std::sin(0.7f * i);
+				transform.data[0] = c;
+				transform.data[2] = s;
+				transform.data[8] = -s;
+				transform.data[10] = c;
+				transform.data[3] = 4.f * i - 6.f;
+				transform.data[7] = 1.5f * i;
+				transform.data[11] = -2.f * i;
+				instances.push_back({ i % 2 == 0 ? std::shared_ptr<specter::Model>(first) : std::shared_ptr<specter::Model>(second), transform });
+			}
+
+			specter::Accel accel;
+			for (SceneInstance& instance : instances) {
+				accel.addInstance(instance.model, instance.transform);
+			}
+			accel.setStructure(configuration.structure);
+			accel.setBVHParameters(configuration.bvhParameters);
+			accel.build(configuration.octreeParameters);
+			expectBruteForceHits(accel, instances, rays, context);
+
+			first->deform(0.5f, 31);
+			instances[1].transform.data[7] += 3.f;
+			accel.setInstanceTransform(1, instances[1].transform);
+			accel.refit(configuration.octreeParameters);
+			expectBruteForceHits(accel, instances, rays, context + ", refitted");
+		}
+	}
+	specter::setSimdLevel(specter::detectSimdLevel());
+}
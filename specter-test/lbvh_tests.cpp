@@ -0,0 +1,59 @@
+#include "pch.h"
+#include "../src/dev/cpu_lbvh_helpers.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Sorts the codes with the radix sort and compares the result against std::stable_sort.
+// The object ids are the original positions, hence equal codes have to keep the order of their ids.
+static void expectSortedLikeStableSort(const std::vector<uint64_t>& codes) {
+	std::vector<specter::PrimitiveIdentifier> ids(codes.size());
+	for (std::size_t i = 0; i < codes.size(); ++i) {
+		ids[i].objectId = static_cast<int>(i);
+		ids[i].mortonCode = codes[i];
+	}
+	std::vector<specter::PrimitiveIdentifier> expected(ids);
+	std::stable_sort(expected.begin(), expected.end(), [](const specter::PrimitiveIdentifier& a, const specter::PrimitiveIdentifier& b) {
+		return a.mortonCode < b.mortonCode;
+	});
+
+	specter::radixsort(ids.data(), ids.size());
+	for (std::size_t i = 0; i < ids.size(); ++i) {
+		ASSERT_EQ(ids[i].mortonCode, expected[i].mortonCode);
+		ASSERT_EQ(ids[i].objectId, expected[i].objectId);
+	}
+}
+
+//
+// Radix sort of the morton codes
+TEST(radixsort, lbvh) {
+	std::mt19937_64 rng(42);
+	const uint64_t codeMask = (1ull << 63) - 1;
+
+	// Sizes around and not a multiple of the chunk size of 1 << 16 elements
+	for (const std::size_t n : { 0, 1, 2, 17, 65535, 65536, 65537, 3 * 65536 + 123 }) {
+		std::vector<uint64_t> codes(n);
+		for (uint64_t& code : codes) {
+			code = rng() & codeMask;
+		}
+		expectSortedLikeStableSort(codes);
+	}
+
+	// Many equal codes check the stability of the sort
+	std::vector<uint64_t> duplicates(100000);
+	for (uint64_t& code : duplicates) {
+		code = rng() % 16;
+	}
+	expectSortedLikeStableSort(duplicates);
+
+	// All codes are equal, every pass has a uniform digit and is skipped
+	expectSortedLikeStableSort(std::vector<uint64_t>(70000, 0x5555555555555555ull & codeMask));
+
+	// The codes only differ in the highest bits of the 63-bit codes, i.e. in the last pass
+	std::vector<uint64_t> highBits(70001);
+	for (uint64_t& code : highBits) {
+		code = ((rng() % 8) << 60) | 0x123456789ull;
+	}
+	expectSortedLikeStableSort(highBits);
+}
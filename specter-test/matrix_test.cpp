@@ -836,4 +836,41 @@ TEST(miscellaneous, mat4) {
 	EXPECT_TRUE(m00[3][1] == m01[1][3]);
 	EXPECT_TRUE(m00[3][2] == m01[2][3]);
 	EXPECT_TRUE(m00[3][3] == m01[3][3]);
+}
+
+TEST(affine, mat4) {
+	// Rotation of 30 degrees around z, scaling by (2, 3, 4) and translation by (1, 2, 3)
+	const float c = std::cos(0.5235988f);
+	const float s = std::sin(0.5235988f);
+	specter::mat4f m(1.f);
+	m[0][0] = 2.f * c; m[0][1] = -3.f * s; m[0][3] = 1.f;
+	m[1][0] = 2.f * s; m[1][1] = 3.f * c; m[1][3] = 2.f;
+	m[2][2] = 4.f; m[2][3] = 3.f;
+
+	specter::mat4f id = specter::inverse(m) * m;
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			EXPECT_NEAR(id[i][j], i == j ? 1.f : 0.f, 1e-5f);
+		}
+	}
+
+	const specter::vec3f origin = specter::transformPoint(m, specter::vec3f(0.f, 0.f, 0.f));
+	EXPECT_FLOAT_EQ(origin.x, 1.f);
+	EXPECT_FLOAT_EQ(origin.y, 2.f);
+	EXPECT_FLOAT_EQ(origin.z, 3.f);
+
+	const specter::vec3f p = specter::transformPoint(m, specter::vec3f(1.f, 0.f, 1.f));
+	EXPECT_FLOAT_EQ(p.x, 2.f * c + 1.f);
+	EXPECT_FLOAT_EQ(p.y, 2.f * s + 2.f);
+	EXPECT_FLOAT_EQ(p.z, 7.f);
+
+	const specter::vec3f v = specter::transformVector(m, specter::vec3f(1.f, 0.f, 1.f));
+	EXPECT_FLOAT_EQ(v.x, 2.f * c);
+	EXPECT_FLOAT_EQ(v.y, 2.f * s);
+	EXPECT_FLOAT_EQ(v.z, 4.f);
+
+	const specter::vec3f zero = specter::transformVector(m, specter::vec3f(0.f, 0.f, 0.f));
+	EXPECT_FLOAT_EQ(zero.x, 0.f);
+	EXPECT_FLOAT_EQ(zero.y, 0.f);
+	EXPECT_FLOAT_EQ(zero.z, 0.f);
 }
\ No newline at end of file
@@ -0,0 +1,135 @@
+#include "pch.h"
+#include "../src/model.hpp"
+#include "../src/simd_kernels.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+// Random triangles around the origin, which is hit by most rays. The triangles of the mesh are the faces[3 * i, 3 * i + 3).
+struct KernelMesh {
+	KernelMesh(const uint32_t nTriangles, const unsigned int seed) {
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> position(-1.f, 1.f);
+		for (uint32_t i = 0; i < 3 * nTriangles; ++i) {
+			vertices.emplace_back(position(rng), position(rng), position(rng));
+			faces.push_back({ i, 0, 0 });
+		}
+	}
+
+	specter::vec3f vertex(const uint32_t triangle, const int k) const {
+		return vertices[faces[3 * triangle + k].p];
+	}
+
+	std::vector<specter::vec3f> vertices;
+	std::vector<specter::FaceElement> faces;
+};
+
+// Returns the kernels of the levels, which the CPU supports
+static std::vector<const specter::SimdKernels*> supportedKernels() {
+	const specter::SimdLevel level = specter::detectSimdLevel();
+	std::vector<const specter::SimdKernels*> kernels = { &specter::sse42Kernels };
+	if (level >= specter::SimdLevel::AVX2) {
+		kernels.push_back(&specter::avx2Kernels);
+	}
+	if (level >= specter::SimdLevel::AVX512) {
+		kernels.push_back(&specter::avx512Kernels);
+	}
+	return kernels;
+}
+
+// Rays from random origins. Every other ray aims at the first vertex of the mesh, which is loaded by padding lanes.
+static std::vector<specter::Ray> kernelRays(const KernelMesh& mesh, const int nRays, const unsigned int seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> position(-3.f, 3.f);
+	std::uniform_real_distribution<float> target(-0.5f, 0.5f);
+	std::vector<specter::Ray> rays;
+	for (int i = 0; i < nRays; ++i) {
+		const specter::vec3f origin(position(rng), position(rng), position(rng));
+		const specter::vec3f aim = i % 2 == 0 ? mesh.vertices[0] : specter::vec3f(target(rng), target(rng), target(rng));
+		rays.emplace_back(origin, specter::normalize(aim - origin));
+	}
+	return rays;
+}
+
+//
+// Packets of fewer triangles than lanes
+TEST(partialPackets, simdKernels) {
+	const KernelMesh mesh(17, 7);
+	const std::vector<specter::Ray> rays = kernelRays(mesh, 2000, 11);
+	std::vector<uint32_t> indices(17);
+	for (uint32_t i = 0; i < 17; ++i) {
+		indices[i] = 16 - i;
+	}
+
+	for (const specter::TriangleTest test : { specter::TriangleTest::MoellerTrumbore, specter::TriangleTest::Watertight }) {
+		for (const specter::SimdKernels* kernels : supportedKernels()) {
+			for (uint32_t count = 1; count <= 17; ++count) {
+				for (const specter::Ray& ray : rays) {
+					// Scalar reference
+					int expected = -1;
+					float tExpected = ray.tmax;
+					for (uint32_t i = 0; i < count; ++i) {
+						specter::Ray r(ray);
+						r.tmax = tExpected;
+						float u, v, t;
+						if (specter::rayIntersectTriangle(test, r, mesh.vertex(indices[i], 0), mesh.vertex(indices[i], 1), mesh.vertex(indices[i], 2), u, v, t)) {
+							expected = static_cast<int>(i);
+							tExpected = t;
+						}
+					}
+
+					float u, v, t;
+					const int closest = kernels->intersectTriangles(test, ray, mesh.faces.data(), mesh.vertices.data(), indices.data(), count, u, v, t);
+					ASSERT_EQ(closest, expected) << specter::simdLevelName(kernels->level) << ", " << count << " triangles";
+					if (closest >= 0) {
+						EXPECT_NEAR(t, tExpected, 1e-5f * std::max(1.f, tExpected));
+					}
+					ASSERT_EQ(kernels->intersectTrianglesAny(test, ray, mesh.faces.data(), mesh.vertices.data(), indices.data(), count), expected >= 0)
+						<< specter::simdLevelName(kernels->level) << ", " << count << " triangles";
+				}
+			}
+		}
+	}
+}
+
+TEST(partialBlocks, simdKernels) {
+	const KernelMesh mesh(16, 13);
+	const std::vector<specter::Ray> rays = kernelRays(mesh, 2000, 17);
+
+	for (const specter::TriangleTest test : { specter::TriangleTest::MoellerTrumbore, specter::TriangleTest::Watertight }) {
+		for (const specter::SimdKernels* kernels : supportedKernels()) {
+			// The lanes after "count" triangles keep the degenerate triangles of the constructor
+			for (uint32_t count = 1; count <= 16; ++count) {
+				std::vector<specter::sTriangle> blocks((count + 7) / 8);
+				for (uint32_t i = 0; i < count; ++i) {
+					blocks[i / 8].store(i % 8, i, mesh.vertex(i, 0), mesh.vertex(i, 1), mesh.vertex(i, 2));
+				}
+
+				for (const specter::Ray& ray : rays) {
+					int expected = -1;
+					float tExpected = ray.tmax;
+					for (uint32_t i = 0; i < count; ++i) {
+						specter::Ray r(ray);
+						r.tmax = tExpected;
+						float u, v, t;
+						if (specter::rayIntersectTriangle(test, r, mesh.vertex(i, 0), mesh.vertex(i, 1), mesh.vertex(i, 2), u, v, t)) {
+							expected = static_cast<int>(i);
+							tExpected = t;
+						}
+					}
+
+					float u, v, t;
+					const uint32_t nBlocks = static_cast<uint32_t>(blocks.size());
+					const int closest = kernels->intersectBlocks(test, ray, blocks.data(), nBlocks, u, v, t);
+					ASSERT_EQ(closest, expected) << specter::simdLevelName(kernels->level) << ", " << count << " triangles";
+					if (closest >= 0) {
+						EXPECT_NEAR(t, tExpected, 1e-5f * std::max(1.f, tExpected));
+					}
+					ASSERT_EQ(kernels->intersectBlocksAny(test, ray, blocks.data(), nBlocks), expected >= 0)
+						<< specter::simdLevelName(kernels->level) << ", " << count << " triangles";
+				}
+			}
+		}
+	}
+}
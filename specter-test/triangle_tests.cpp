@@ -0,0 +1,34 @@
+#include "pch.h"
+#include "../src/triangle.hpp"
+
+//
+// Triangle
+TEST(watertight, triangle) {
+	// Two triangles of a fan share the edge from v0 to v2 and all of them share the vertex v0
+	const specter::vec3f v0(0.1f, 0.3f, 0.7f);
+	const specter::vec3f v1(1.3f, 0.2f, 0.9f);
+	const specter::vec3f v2(0.9f, 1.7f, 0.3f);
+	const specter::vec3f v3(-0.6f, 1.1f, 0.5f);
+	const specter::vec3f v4(-0.2f, -0.9f, 0.8f);
+	const specter::vec3f fan[4][3] = { { v0, v1, v2 }, { v0, v2, v3 }, { v0, v3, v4 }, { v0, v4, v1 } };
+	const specter::vec3f direction(0.31f, -0.17f, 1.f);
+	float u, v, t;
+
+	// Rays through the shared edge must not leak between the first two triangles
+	for (int i = 1; i < 64; ++i) {
+		const float s = i / 64.f;
+		const specter::vec3f p = v0 + (v2 - v0) * s;
+		const specter::Ray ray(p - direction * 2.f, direction);
+		const bool hit0 = specter::rayIntersectTriangle(specter::TriangleTest::Watertight, ray, fan[0][0], fan[0][1], fan[0][2], u, v, t);
+		const bool hit1 = specter::rayIntersectTriangle(specter::TriangleTest::Watertight, ray, fan[1][0], fan[1][1], fan[1][2], u, v, t);
+		EXPECT_TRUE(hit0 || hit1);
+	}
+
+	// A ray through the shared vertex must hit at least one triangle of the fan
+	const specter::Ray ray(v0 - direction * 2.f, direction);
+	bool hit = false;
+	for (int i = 0; i < 4; ++i) {
+		hit |= specter::rayIntersectTriangle(specter::TriangleTest::Watertight, ray, fan[i][0], fan[i][1], fan[i][2], u, v, t);
+	}
+	EXPECT_TRUE(hit);
+}
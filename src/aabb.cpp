@@ -48,6 +48,10 @@ bool AxisAlignedBoundingBox::containsEdgeInclusive(const vec3f& point) const {
 	return point <= max && point >= min;
 }
 
+bool AxisAlignedBoundingBox::containsEdgeInclusive(const AxisAlignedBoundingBox& other) const {
+	return containsEdgeInclusive(other.min) && containsEdgeInclusive(other.max);
+}
+
 bool AxisAlignedBoundingBox::overlaps(const AxisAlignedBoundingBox& other) const {
 	return min < other.max&& max > other.min;
 }
@@ -79,6 +83,35 @@ AxisAlignedBoundingBox combine(const AxisAlignedBoundingBox& box0, const AxisAli
 		maxComponent(box0.max, box1.max));
 }
 
+void splitTriangleBounds(	const vec3f* vertices, const AxisAlignedBoundingBox& bounds, const int axis, const float position,
+							AxisAlignedBoundingBox& left, AxisAlignedBoundingBox& right) {
+	left = right = AxisAlignedBoundingBox(vec3f(std::numeric_limits<float>::max()), vec3f(std::numeric_limits<float>::lowest()));
+	for (int e = 0; e < 3; ++e) {
+		const vec3f& v0 = vertices[e];
+		const vec3f& v1 = vertices[(e + 1) % 3];
+		const float p0 = v0[axis];
+		const float p1 = v1[axis];
+		if (p0 <= position) {
+			left = combine(left, AxisAlignedBoundingBox(v0, v0));
+		}
+		if (p0 >= position) {
+			right = combine(right, AxisAlignedBoundingBox(v0, v0));
+		}
+		if ((p0 < position && position < p1) || (p1 < position && position < p0)) {
+			vec3f intersection = v0 + (v1 - v0) * ((position - p0) / (p1 - p0));
+			intersection[axis] = position;
+			left = combine(left, AxisAlignedBoundingBox(intersection, intersection));
+			right = combine(right, AxisAlignedBoundingBox(intersection, intersection));
+		}
+	}
+
+	// The triangle may have been clipped by other planes before
+	left = AxisAlignedBoundingBox(maxComponent(left.min, bounds.min), minComponent(left.max, bounds.max));
+	right = AxisAlignedBoundingBox(maxComponent(right.min, bounds.min), minComponent(right.max, bounds.max));
+	left.max[axis] = std::min(left.max[axis], position);
+	right.min[axis] = std::max(right.min[axis], position);
+}
+
 #include <immintrin.h>
 
 void manyAABBRayIntersect(const AxisAlignedBoundingBox* bboxes, Ray& ray, float* nearT, const int count) {
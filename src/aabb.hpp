@@ -1,9 +1,16 @@
 #pragma once
 #include "ray.hpp"
+#include "simd_kernels.hpp"
 #include "vec3.hpp"
 
 namespace specter {
 
+// The far distances of the slab tests are scaled by 1 + 2 * gamma(3), where gamma(n) = n * eps / (1 - n * eps)
+// bounds the relative rounding error of n operations. Rounding then never culls a box, which the ray only grazes.
+// Otherwise, rays could slip between the boxes of two triangles sharing an edge, although the watertight
+// triangle test would hit both. Reference: Thiago Ize, Robust BVH Ray Traversal
+constexpr float robustFarScale = 1.0000004f;
+
 static int xx = 0;
 
 struct AxisAlignedBoundingBox {
@@ -32,15 +39,18 @@ struct AxisAlignedBoundingBox {
 	bool contains(const vec3f& point) const;
 	// Returns true if point is confined within [min, max]
 	bool containsEdgeInclusive(const vec3f& point) const;
+	// Returns true if other is confined within [min, max]
+	bool containsEdgeInclusive(const AxisAlignedBoundingBox& other) const;
 	// Returns true if two aabbs overlap in space.
 	bool overlaps(const AxisAlignedBoundingBox& other) const;
 	// Additionally, returns true if two edges/faces overlap
 	bool overlapsEdgeInclusive(const AxisAlignedBoundingBox& other) const;
 	
 	// Returns true if the ray collides with the bounding box along it's travelling direction
+	// within the ray interval. nearT and farT are clipped to the ray interval.
 	bool rayIntersect(const Ray& ray, float& nearT, float& farT) const {
-		nearT = std::numeric_limits<float>::min();
-		farT = std::numeric_limits<float>::max();
+		nearT = ray.tmin;
+		farT = ray.tmax;
 
 		for (int i = 0; i < 3; i++) {
 			float origin = ray.o[i];
@@ -60,7 +70,7 @@ struct AxisAlignedBoundingBox {
 					std::swap(t1, t2);
 
 				nearT = std::max(t1, nearT);
-				farT = std::min(t2, farT);
+				farT = std::min(t2 * robustFarScale, farT);
 
 				if (!(nearT <= farT))
 					return false;
@@ -74,8 +84,8 @@ struct AxisAlignedBoundingBox {
 		vec3f t1 = (max - ray.o) * ray.invd;
 		vec3f tmin = minv(t0, t1), tmax = maxv(t0, t1);
 
-		nearT = maxComponent(tmin);
-		farT = minComponent(tmax);
+		nearT = std::max(maxComponent(tmin), ray.tmin);
+		farT = std::min(minComponent(tmax) * robustFarScale, ray.tmax);
 
 		return nearT <= farT;
 	}
@@ -94,6 +104,12 @@ std::ostream& operator<<(std::ostream& os, const AxisAlignedBoundingBox& aabb);
 
 AxisAlignedBoundingBox combine(const AxisAlignedBoundingBox& box0, const AxisAlignedBoundingBox& box1);
 
+// Splits the part of the triangle within "bounds" at the plane, whose normal is the axis, and returns the bounds
+// of the parts on either side. The vertices on either side and the intersections of the edges with the plane
+// bound the parts. A part is invalid, if the triangle doesn't reach its side of the plane.
+void splitTriangleBounds(	const vec3f* vertices, const AxisAlignedBoundingBox& bounds, const int axis, const float position,
+							AxisAlignedBoundingBox& left, AxisAlignedBoundingBox& right);
+
 void manyAABBRayIntersect(const AxisAlignedBoundingBox* bboxes, const Ray& ray, float* near, const int count);
 
 
@@ -117,76 +133,17 @@ struct sAABB {
 		vec3f t1 = (bmax - r.o) * r.invd;
 		vec3f tmin = minv(t0, t1), tmax = maxv(t0, t1);
 
-		nearT = maxComponent(tmin);
-		farT = minComponent(tmax);
+		nearT = std::max(maxComponent(tmin), r.tmin);
+		farT = std::min(minComponent(tmax) * robustFarScale, r.tmax);
 
 		return nearT <= farT;
 	}
 
-	// Performs ray-aabb intersection against 8 AABBs. AVX2 is necessary.
-	// Currently specter is compiled with AVX2 enabled. If the target 
-	// architecture does not feature AVX2, the program will crash.
-	// In the future, I will add a switch in the accel structure, to default
-	// to SSE3.
+	// Performs ray-aabb intersection against 8 AABBs with the kernel of the SIMD level selected at startup.
+	// nearT and farT have to be initialized by the caller, usually with the ray interval.
+	// A box is hit if nearT[i] <= farT[i] after the call.
 	void rayIntersect(const Ray& r, float* nearT, float* farT) const {
-		// X component
-		
-		__m256 ROX = _mm256_broadcast_ss(&r.o.x);
-		__m256 ROY = _mm256_broadcast_ss(&r.o.y);
-		__m256 ROZ = _mm256_broadcast_ss(&r.o.z);
-		__m256 RIDX = _mm256_broadcast_ss(&r.invd.x);
-		__m256 RIDY = _mm256_broadcast_ss(&r.invd.y);
-		__m256 RIDZ = _mm256_broadcast_ss(&r.invd.z);
-		__m256 NEART = _mm256_load_ps(nearT);
-		__m256 FART = _mm256_load_ps(farT);
-
-		__m256 YMM8 = _mm256_load_ps(minx);
-		__m256 YMM9 = _mm256_load_ps(maxx);
-
-		__m256 T0 = _mm256_sub_ps(YMM8, ROX);
-		__m256 T1 = _mm256_sub_ps(YMM9, ROX);
-		T0 = _mm256_mul_ps(T0, RIDX);
-		T1 = _mm256_mul_ps(T1, RIDX);
-
-		YMM8 = _mm256_min_ps(T0, T1);
-		YMM9 = _mm256_max_ps(T0, T1);
-
-		NEART = _mm256_max_ps(YMM8, NEART);
-		FART = _mm256_min_ps(YMM9, FART);
-
-		// Y Component
-		YMM8 = _mm256_load_ps(miny);
-		YMM9 = _mm256_load_ps(maxy);
-
-		T0 = _mm256_sub_ps(YMM8, ROY);
-		T1 = _mm256_sub_ps(YMM9, ROY);
-		T0 = _mm256_mul_ps(T0, RIDY);
-		T1 = _mm256_mul_ps(T1, RIDY);
-
-		YMM8 = _mm256_min_ps(T0, T1);
-		YMM9 = _mm256_max_ps(T0, T1);
-
-		NEART = _mm256_max_ps(YMM8, NEART);
-		FART = _mm256_min_ps(YMM9, FART);
-
-		// Z Component 
-		YMM8 = _mm256_load_ps(minz);
-		YMM9 = _mm256_load_ps(maxz);
-
-		T0 = _mm256_sub_ps(YMM8, ROZ);
-		T1 = _mm256_sub_ps(YMM9, ROZ);
-		T0 = _mm256_mul_ps(T0, RIDZ);
-		T1 = _mm256_mul_ps(T1, RIDZ);
-
-		YMM8 = _mm256_min_ps(T0, T1);
-		YMM9 = _mm256_max_ps(T0, T1);
-
-		NEART = _mm256_max_ps(YMM8, NEART);
-		FART = _mm256_min_ps(YMM9, FART);
-
-		// Output to nearT and farT
-		_mm256_store_ps(nearT, NEART);
-		_mm256_store_ps(farT, FART);
+		GetSimdKernels().intersectBoxes(*this, r, nearT, farT);
 	}
 
 	struct alignas(32) {
@@ -2,30 +2,258 @@
 #include "accel.hpp"
 #include "timer.hpp"
 
+#include <fstream>
+
 namespace specter {
 
 void Accel::addModel(std::shared_ptr<Model>& model) {
 	this->model = model;
 }
 
-void Accel::build() {
-	std::cout << "Building octree...";
-	specter::Timer octreeTimer;
-	octree.build(model);	
-	std::cout << " Finished in : " << octreeTimer.elapsedTime() << " seconds.\n\n";
+uint32_t Accel::addInstance(std::shared_ptr<Model>& model, const mat4f& transform) {
+	// Models are identified by their address
+	uint32_t object = 0;
+	while (object < topLevel.GetObjectCount() && topLevel.GetObject(object) != model) {
+		++object;
+	}
+	if (object == topLevel.GetObjectCount()) {
+		object = topLevel.addObject(model);
+	}
+	return topLevel.addInstance(object, transform);
 }
 
-bool Accel::traceRay(const Ray& ray, Intersection& intersection) const {
-	return octree.traverse(model.get(), ray, intersection);
+void Accel::setInstanceTransform(const uint32_t instance, const mat4f& transform) {
+	topLevel.setTransform(instance, transform);
 }
 
-bool Accel::traceShadowRay(const Ray& ray) const {
-	return octree.traverseAny(model.get(), ray);
+void Accel::updateInstances() {
+	specter::Timer topLevelTimer;
+	topLevel.buildTopLevel();
+	std::cout << "Built top level over " << topLevel.GetInstanceCount() << " instances of " << topLevel.GetObjectCount()
+		<< " models in " << topLevelTimer.elapsedTime() << " seconds.\n";
+}
+
+bool Accel::isInstanced() const {
+	return !topLevel.isEmpty();
+}
+
+void Accel::setStructure(const AccelStructure structure) {
+	this->structure = structure;
+}
+
+void Accel::setBVHParameters(const BVHParameters& parameters) {
+	bvhParameters = parameters;
+}
+
+void Accel::setKdTreeParameters(const KdTreeParameters& parameters) {
+	kdTreeParameters = parameters;
+}
+
+void Accel::build(const OctreeParameters& parameters) {
+	if (isInstanced()) {
+		for (uint32_t object = 0; object < topLevel.GetObjectCount(); ++object) {
+			auto objectStructure = createAccelStructure(structure, parameters, bvhParameters, kdTreeParameters);
+			buildStructure(*objectStructure, topLevel.GetObject(object));
+			topLevel.setObjectStructure(object, std::move(objectStructure));
+		}
+		updateInstances();
+		std::cout << '\n';
+		return;
+	}
+
+	accelStructure = createAccelStructure(structure, parameters, bvhParameters, kdTreeParameters);
+	buildStructure(*accelStructure, model);
+}
+
+void Accel::buildStructure(IAccelStructure& accelStructure, std::shared_ptr<Model>& model) {
+	std::cout << "Building " << accelStructure.GetName() << "...\n";
+	specter::Timer buildTimer;
+	accelStructure.build(model);
+	std::cout << "Finished in : " << buildTimer.elapsedTime() << " seconds.\n";
+	accelStructure.printStats(std::cout);
+	std::cout << '\n';
+}
+
+void Accel::refit(const OctreeParameters& parameters) {
+	if (isInstanced()) {
+		for (uint32_t object = 0; object < topLevel.GetObjectCount(); ++object) {
+			if (!refitStructure(topLevel.GetObjectStructure(object), topLevel.GetObject(object))) {
+				auto objectStructure = createAccelStructure(structure, parameters, bvhParameters, kdTreeParameters);
+				buildStructure(*objectStructure, topLevel.GetObject(object));
+				topLevel.setObjectStructure(object, std::move(objectStructure));
+			}
+			topLevel.updateObjectBounds(object);
+		}
+		updateInstances();
+		return;
+	}
+
+	if (accelStructure == nullptr || !refitStructure(*accelStructure, model)) {
+		build(parameters);
+	}
+}
+
+bool Accel::refitStructure(IAccelStructure& accelStructure, std::shared_ptr<Model>& model) {
+	specter::Timer refitTimer;
+	if (!accelStructure.refit(model)) {
+		std::cout << "Rebuilding " << accelStructure.GetName() << " instead of refitting it.\n";
+		return false;
+	}
+	std::cout << "Refitted " << accelStructure.GetName() << " in " << refitTimer.elapsedTime() << " seconds.\n";
+	return true;
+}
+
+OctreeParameters Accel::autoTune(const std::vector<Ray>& sampleRays, const OctreeParameters& parameters) {
+	if (structure != AccelStructure::Octree || isInstanced()) {
+		build(parameters);
+		return parameters;
+	}
+
+	std::cout << "Auto-tuning octree with " << sampleRays.size() << " sample rays...\n";
+	const int defaultDepth = log8(model->GetTriangleCount());
+
+	std::vector<OctreeParameters> candidates;
+	for (const uint32_t leafThreshold : { 4u, 10u, 24u }) {
+		for (const int maxDepth : { std::max(defaultDepth - 1, 0), defaultDepth, defaultDepth + 1 }) {
+			OctreeParameters candidate = parameters;
+			candidate.leafThreshold = leafThreshold;
+			candidate.maxDepth = maxDepth;
+			candidates.push_back(candidate);
+		}
+	}
+
+	// Only one candidate is kept in memory at a time
+	std::size_t best = 0;
+	double bestTime = std::numeric_limits<double>::max();
+	std::vector<Intersection> intersections(sampleRays.size());
+	for (std::size_t i = 0; i < candidates.size(); ++i) {
+		accelStructure.reset();
+		accelStructure = std::make_unique<OctreeStructure>(candidates[i]);
+		specter::Timer buildTimer;
+		accelStructure->build(model);
+		const double buildTime = buildTimer.elapsedTime();
+
+		std::fill(intersections.begin(), intersections.end(), Intersection());
+		specter::Timer traceTimer;
+		accelStructure->traverseBatch(model.get(), sampleRays.data(), intersections.data(), sampleRays.size());
+		const double traceTime = traceTimer.elapsedTime();
+
+		std::cout << "  leafThreshold " << candidates[i].leafThreshold << ", maxDepth " << candidates[i].maxDepth
+			<< ": build " << buildTime << " seconds, trace " << traceTime << " seconds.\n";
+		if (traceTime < bestTime) {
+			bestTime = traceTime;
+			best = i;
+		}
+	}
+
+	std::cout << "Selected leafThreshold " << candidates[best].leafThreshold << ", maxDepth " << candidates[best].maxDepth << ".\n";
+	if (best != candidates.size() - 1) {
+		build(candidates[best]);
+	} else {
+		accelStructure->printStats(std::cout);
+		std::cout << '\n';
+	}
+	return candidates[best];
+}
+
+bool Accel::loadCache(const std::string& filename, const OctreeParameters& parameters, const bool autoTuned) {
+	if (structure != AccelStructure::Octree || isInstanced()) {
+		return false;
+	}
+
+	specter::Timer cacheTimer;
+	auto octreeStructure = std::make_unique<OctreeStructure>(parameters);
+	if (!octreeStructure->GetOctree().load(filename, computeCacheKey(parameters, autoTuned))) {
+		return false;
+	}
+	accelStructure = std::move(octreeStructure);
+	std::cout << "Loaded octree from " << filename << " in " << cacheTimer.elapsedTime() << " seconds.\n\n";
+	return true;
 }
 
-bool Accel::traceShadowRayTmax(const Ray& ray, const float t_max) const {
-	return octree.traverseAnyTmax(model.get(), ray, t_max);
+void Accel::saveCache(const std::string& filename, const OctreeParameters& parameters, const bool autoTuned) const {
+	const Octree* octree = GetOctree();
+	if (octree == nullptr) {
+		return;
+	}
+	octree->save(filename, computeCacheKey(parameters, autoTuned));
 }
 
+uint64_t Accel::computeCacheKey(const OctreeParameters& parameters, const bool autoTuned) const {
+	// The parameters are hashed field by field, because the padding of the structure is undefined.
+	uint64_t key = fnv1a_hash(model->GetVertices(), model->GetVertexCount() * sizeof(vec3f));
+	key = fnv1a_hash(model->GetFaces(), model->GetFaceCount() * sizeof(FaceElement), key);
+	key = fnv1a_hash(&parameters.leafThreshold, sizeof(parameters.leafThreshold), key);
+	key = fnv1a_hash(&parameters.maxDepth, sizeof(parameters.maxDepth), key);
+	key = fnv1a_hash(&parameters.triangleBlockBudget, sizeof(parameters.triangleBlockBudget), key);
+	key = fnv1a_hash(&parameters.loose, sizeof(parameters.loose), key);
+	return fnv1a_hash(&autoTuned, sizeof(autoTuned), key);
+}
+
+Octree* Accel::GetOctree() const {
+	auto* octreeStructure = dynamic_cast<OctreeStructure*>(accelStructure.get());
+	return octreeStructure != nullptr ? &octreeStructure->GetOctree() : nullptr;
+}
+
+AccelStats Accel::GetStats() const {
+	if (!isInstanced()) {
+		if (accelStructure == nullptr) {
+			throw std::runtime_error("Can't report the statistics of a structure, which hasn't been built or loaded");
+		}
+		return accelStructure->GetStats();
+	}
+
+	// The structures of the models are counted once, regardless of their number of instances
+	AccelStats stats;
+	for (uint32_t object = 0; object < topLevel.GetObjectCount(); ++object) {
+		if (!topLevel.hasObjectStructure(object)) {
+			throw std::runtime_error("Can't report the statistics of a structure, which hasn't been built or loaded");
+		}
+		stats.merge(topLevel.GetObjectStructure(object).GetStats());
+	}
+	return stats;
+}
 
-}
\ No newline at end of file
+void Accel::saveStatsReport(const std::string& filename) const {
+	nlohmann::json report = GetStats().toJson();
+	if (isInstanced()) {
+		report.erase("expectedRayCost");
+		report["structure"] = topLevel.GetObjectStructure(0).GetName();
+		report["models"] = topLevel.GetObjectCount();
+		report["instances"] = topLevel.GetInstanceCount();
+	} else {
+		report["structure"] = accelStructure->GetName();
+	}
+
+	std::ofstream file(filename);
+	if (!file) {
+		throw std::runtime_error("Can't write the statistics report " + filename);
+	}
+	file << report.dump(2) << '\n';
+}
+
+bool Accel::traceRay(const Ray& ray, Intersection& intersection) const {
+	if (isInstanced()) {
+		return topLevel.traverse(ray, intersection);
+	}
+	return accelStructure->traverse(model.get(), ray, intersection);
+}
+
+void Accel::traceRays(const Ray* rays, Intersection* intersections, const std::size_t nRays) const {
+	if (isInstanced()) {
+		for (std::size_t i = 0; i < nRays; ++i) {
+			topLevel.traverse(rays[i], intersections[i]);
+		}
+		return;
+	}
+	accelStructure->traverseBatch(model.get(), rays, intersections, nRays);
+}
+
+bool Accel::traceShadowRay(const Ray& ray) const {
+	if (isInstanced()) {
+		return topLevel.traverseAny(ray);
+	}
+	return accelStructure->traverseAny(model.get(), ray);
+}
+
+}
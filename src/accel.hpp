@@ -1,51 +1,124 @@
 #pragma once
+#include "accel_structure.hpp"
 #include "octree.hpp"
 #include "ray.hpp"
+#include "top_level_bvh.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
 
 namespace specter {
 
 // Structure used to accelerate ray tracing.
-// At the moment it is using an octree as it's internal accelerating structure.
-// However, it is very easy to replace with something else like a k-d tree or BVH.
-
-// Generally, we could make each data structure (octree, k-d, bvh etc.) inherit from 
-// a base interface and use a pointer to base in the accel data structure. This allows,
-// the specification of the data structure at runtime, which can be good.
-// Alternatively, we could use compile time flags to construct the Accel structure
-// at compile time using the preprocessor. This is a little bit trickier and it requires
-// a recompile if the user wants to change the internal accelerating structure. This solution,
-// is not good, because the cost of accessing the vtable is not measurable.
+// The internal accelerating structure is an octree, a SAH k-d tree, a LBVH or a binned SAH BVH, see setStructure().
+// The hierarchies can be collapsed into a wide hierarchy, see BVHParameters::wide,
+// whose boxes may be quantized, see BVHParameters::compressed.
+
+// The structures implement IAccelStructure and are selected at runtime, which allows to compare them
+// per scene without a recompile. The virtual call per ray is not measurable next to the traversal.
+// Batches of rays traced with traceRays() only dispatch once and run a loop compiled for the structure.
 class Accel {
 
 public:
 
 	// Adds model to the accelerating structure. 
-	// At the moment only one mesh is supported
+	// Only one model is supported this way, see addInstance() for scenes of several models.
 	void addModel(std::shared_ptr<Model>& model);
+
+	// Places an instance of the model in the scene, which switches to the two-level structure.
+	// All instances of a model share its structure. "transform" maps object space to world space,
+	// see TopLevelBVH::addInstance(). Returns the index of the instance.
+	uint32_t addInstance(std::shared_ptr<Model>& model, const mat4f& transform);
+
+	// Moves an instance, which takes effect after the next call to updateInstances()
+	void setInstanceTransform(const uint32_t instance, const mat4f& transform);
+
+	// Rebuilds the top level of the two-level structure after instances have been moved.
+	// The structures of the models are kept.
+	void updateInstances();
+
+	// Selects the internal accelerating structure, which is constructed by the next call to build().
+	void setStructure(const AccelStructure structure);
+
+	// Sets the parameters of the binned SAH BVH, which are used by the next call to build().
+	void setBVHParameters(const BVHParameters& parameters);
+
+	// Sets the parameters of the SAH k-d tree, which are used by the next call to build().
+	void setKdTreeParameters(const KdTreeParameters& parameters);
 	
 	// Construct the underlying accelerating structure object.
-	void build();
+	void build(const OctreeParameters& parameters = OctreeParameters());
+
+	// Updates the structure after the vertices of the models have moved, see Model::GetVertices().
+	// The hierarchies are refitted, which keeps their topology and costs a fraction of build().
+	// Structures, which can't be refitted or whose quality degraded too far, are rebuilt with "parameters",
+	// see BVHParameters::refitThreshold. The triangles of the models must not change.
+	void refit(const OctreeParameters& parameters = OctreeParameters());
+
+	// Construct the underlying octree for several candidate configurations
+	// and keep the one that traces "sampleRays" the fastest. Parameters that are not tuned,
+	// e.g. the triangle block budget, are taken from "parameters". Returns the selected configuration.
+	OctreeParameters autoTune(const std::vector<Ray>& sampleRays, const OctreeParameters& parameters = OctreeParameters());
+
+	// Load the accelerating structure from a cache file, which has been written by saveCache() for 
+	// the same geometry and parameters. Returns false if there is no such file.
+	// Only octrees are cached at the moment.
+	// "autoTuned" distinguishes structures selected by autoTune() from ones built with "parameters".
+	bool loadCache(const std::string& filename, const OctreeParameters& parameters, const bool autoTuned = false);
+
+	// Write the accelerating structure to a cache file. Throws std::runtime_error if the file can't be written.
+	void saveCache(const std::string& filename, const OctreeParameters& parameters, const bool autoTuned = false) const;
 
 	// Trace ray using the accelerating structure. Returns true if the ray collides with mesh geometry.
 	bool traceRay(const Ray& ray, Intersection& intersection) const;
 
+	// Trace a batch of rays, see traceRay(). The results are written to "intersections".
+	void traceRays(const Ray* rays, Intersection* intersections, const std::size_t nRays) const;
+
 	// Trace shadow ray. Returns true if any intersection is found. Returns false otherwise.
 	// The shadow ray functionality is currently deprecated, because I have switched the renderer.
 	// In the past, I used to seperate the scene from the lights, which allows direct shadow queries.
 	// Now, lights are simply treated as emitting surfaces, which are incorporated in the scene.
 	// The motivatin for this change was in the difficulty of handling transperent objects.
+	// Only intersections within the ray interval are considered, i.e. shadow rays towards 
+	// a point should set tmax to the distance of that point.
 	bool traceShadowRay(const Ray& ray) const;
-	bool traceShadowRayTmax(const Ray& ray, const float t_max) const;
 
-	// This should not really be used outside of debugging.
-	decltype(auto) GetOctree() {
-		return &octree;
-	}
+	// This should not really be used outside of debugging. Returns nullptr if the structure isn't an octree.
+	Octree* GetOctree() const;
+
+	// Returns the statistics of the structure, which has been built or loaded last.
+	// The statistics of an instanced scene are merged over its models and have no expected ray cost.
+	// Throws std::runtime_error if no structure has been built or loaded.
+	AccelStats GetStats() const;
+
+	// Writes the statistics of the structure as json file, which allows to compare the structures
+	// of different meshes. Throws std::runtime_error if no structure has been built or loaded, or if the file can't be written.
+	void saveStatsReport(const std::string& filename) const;
+
+private:
+
+	// Builds the structure for the model and reports its statistics
+	void buildStructure(IAccelStructure& accelStructure, std::shared_ptr<Model>& model);
+
+	// Refits the structure to the model and reports the time. Returns false if it has to be rebuilt.
+	bool refitStructure(IAccelStructure& accelStructure, std::shared_ptr<Model>& model);
+
+	// Returns true if the scene consists of instances, see addInstance()
+	bool isInstanced() const;
+
+	// Returns a hash of the geometry of the model and the parameters, which identifies cache files.
+	uint64_t computeCacheKey(const OctreeParameters& parameters, const bool autoTuned) const;
 
 private:
 
 	std::shared_ptr<Model> model;
-	Octree octree;
+	AccelStructure structure = AccelStructure::Octree;
+	BVHParameters bvhParameters;
+	KdTreeParameters kdTreeParameters;
+	std::unique_ptr<IAccelStructure> accelStructure;
+	TopLevelBVH topLevel;
 };
 
 }
\ No newline at end of file
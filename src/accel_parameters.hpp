@@ -0,0 +1,93 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace specter {
+
+// Data structures available to accelerate ray tracing
+enum class AccelStructure : uint8_t {
+	Octree,
+	LBVH,
+	BVH,
+	KdTree
+};
+
+// Ray/triangle intersection tests of the leaves. 
+// They can be selected with the "triangleTest" field of the "accel" field of the scene description.
+enum class TriangleTest : uint8_t {
+	// The moeller&trumbore test. Due to rounding, rays can slip through the edge shared by two triangles.
+	MoellerTrumbore,
+	// Transforms the triangle into the space of the ray, where the edge functions of a shared edge are exactly
+	// opposite, such that no ray slips through it. The transformation is precomputed once per ray.
+	// Reference: Woop, Benthin and Wald, Watertight Ray/Triangle Intersection
+	Watertight
+};
+
+// Instruction sets, for which the SIMD kernels of the box and triangle tests are compiled. Each level includes
+// the ones before. The highest level supported by the CPU is selected at startup, see simd_kernels.hpp.
+// The "simd" field of the "accel" field of the scene description can limit it to a lower level.
+enum class SimdLevel : uint8_t {
+	// Four lanes. Every x86-64 CPU specter runs on supports it, hence the rest of specter is compiled for it.
+	SSE42,
+	// Eight lanes, triangles are gathered from the mesh with hardware gathers
+	AVX2,
+	// Sixteen lanes for the triangle tests. The boxes of the eight children of a node are still tested with eight lanes.
+	AVX512
+};
+
+// Parameters of the octree construction. 
+// They can be specified in the "accel" field of the scene description.
+struct OctreeParameters {
+	// Nodes referencing at most this many triangles become leaves.
+	uint32_t leafThreshold = 10;
+	// Nodes deeper than this become leaves, regardless of their triangle count.
+	// This avoids infinite depth octrees in pathological cases. A negative value selects log8(nTriangles).
+	int maxDepth = -1;
+	// Number of bytes that may be spent on precomputed triangle blocks in the leaves.
+	// Leaves referencing the most triangles are converted first, until the budget is exhausted.
+	// A budget of zero disables the triangle blocks.
+	std::size_t triangleBlockBudget = 0;
+	// Builds a loose octree, in which every triangle is stored in exactly one node. A triangle is
+	// assigned to the subregion containing its centroid and the bounds of the subregion are 
+	// enlarged to contain it. Triangles larger than the subregion stay in the parent node.
+	// Otherwise, triangles are referenced by all overlapped subregions.
+	bool loose = false;
+};
+
+// Parameters of the construction of the bounding volume hierarchies, i.e. the LBVH and the binned SAH BVH.
+// They can be specified in the "accel" field of the scene description.
+struct BVHParameters {
+	// Nodes referencing at most this many triangles become leaves, if the surface area heuristic
+	// estimates that intersecting their triangles is cheaper than splitting them. Only used by the binned SAH BVH.
+	uint32_t maxLeafSize = 4;
+	// Number of rounds of treelet restructuring, which optimize the topology of the LBVH after its construction.
+	// Zero disables the optimization. Only used by the LBVH.
+	int treeletRounds = 0;
+	// Collapses the binary hierarchy into a hierarchy with eight children per node,
+	// whose boxes are intersected at once by the SIMD kernel of sAABB.
+	bool wide = false;
+	// Quantizes the child boxes of the wide hierarchy to 8 bits relative to their parent,
+	// which cuts the memory of the nodes by a factor of 3.2. Implies "wide".
+	bool compressed = false;
+	// Splits triangles, which straddle the split plane of a node, if that lowers the cost according to the
+	// surface area heuristic. Only used by the binned SAH BVH.
+	bool spatialSplits = false;
+	// Bounds the number of triangle references added by spatial splits, relative to the number of triangles.
+	float duplicationBudget = 0.25f;
+	// Refitting a hierarchy after the vertices have moved keeps its topology, which degrades as the geometry deforms.
+	// The hierarchy is rebuilt instead, once its expected ray cost exceeds the cost after the last build by this fraction.
+	// Only used by the LBVH and the binned SAH BVH, see Accel::refit().
+	float refitThreshold = 0.3f;
+};
+
+// Parameters of the construction of the SAH k-d tree.
+// They can be specified in the "accel" field of the scene description.
+struct KdTreeParameters {
+	// Nodes deeper than this become leaves, regardless of their triangle count.
+	// A negative value selects 8 + 1.3 * log2(nTriangles).
+	int maxDepth = -1;
+	// Relative reduction of the cost of splits, which cut off empty space, i.e. produce a child without triangles.
+	float emptySpaceBonus = 0.2f;
+};
+
+}
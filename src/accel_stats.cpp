@@ -0,0 +1,51 @@
+#include "accel_stats.hpp"
+
+#include <algorithm>
+
+namespace specter {
+
+void AccelStats::merge(const AccelStats& other) {
+	nodeCount += other.nodeCount;
+	leafCount += other.leafCount;
+	referenceCount += other.referenceCount;
+	triangleCount += other.triangleCount;
+	for (const auto& bucket : other.leafSizes) {
+		leafSizes[bucket.first] += bucket.second;
+	}
+	memoryUsage += other.memoryUsage;
+}
+
+nlohmann::json AccelStats::toJson() const {
+	// The keys of json objects are strings, which would be sorted lexicographically.
+	// Hence the histogram is an array of buckets in the order of the leaf sizes.
+	nlohmann::json histogram = nlohmann::json::array();
+	for (const auto& bucket : leafSizes) {
+		histogram.push_back({ { "triangles", bucket.first }, { "leaves", bucket.second } });
+	}
+
+	nlohmann::json json;
+	json["nodes"] = nodeCount;
+	json["leaves"] = leafCount;
+	json["triangleReferences"] = referenceCount;
+	json["uniqueTriangles"] = triangleCount;
+	json["referencesPerTriangle"] = triangleCount > 0 ? double(referenceCount) / triangleCount : 0.0;
+	json["averageLeafSize"] = leafCount > 0 ? double(referenceCount) / leafCount : 0.0;
+	json["leafSizeHistogram"] = histogram;
+	json["bytes"] = memoryUsage;
+	json["bytesPerTriangle"] = triangleCount > 0 ? double(memoryUsage) / triangleCount : 0.0;
+	json["expectedRayCost"] = expectedRayCost;
+	return json;
+}
+
+std::size_t countUniqueTriangles(const std::vector<uint32_t>& triIndices) {
+	if (triIndices.empty()) {
+		return 0;
+	}
+	std::vector<bool> referenced(*std::max_element(triIndices.begin(), triIndices.end()) + std::size_t(1), false);
+	for (const uint32_t triangle : triIndices) {
+		referenced[triangle] = true;
+	}
+	return std::count(referenced.begin(), referenced.end(), true);
+}
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <json.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+namespace specter {
+
+// Cost constants of the surface area heuristic, which estimates the cost of a ray. Every structure
+// uses them for its expected ray cost, such that the costs of the structures are comparable.
+// The traversal cost covers the work of visiting an interior node, i.e. testing the boxes of its two or eight
+// children in the hierarchies and the octree. The ratio of 1:1 reflects that the boxes are tested with SIMD kernels,
+// like the triangles of the leaves.
+constexpr float costTraversal = 1.f;
+constexpr float costIntersection = 1.f;
+
+// Number of leaves per number of referenced triangles. Empty leaves aren't counted.
+using LeafSizeHistogram = std::map<uint32_t, std::size_t>;
+
+// Statistics, which are reported for every structure after its construction
+struct AccelStats {
+
+	// Adds the statistics of another structure, e.g. of another model of a two-level structure.
+	// The expected ray cost is left unchanged, because the costs of the models in their object spaces don't add up
+	// to the cost of the scene. Merged statistics are reported without it.
+	void merge(const AccelStats& other);
+
+	// Returns the statistics as json object, which is written by Accel::saveStatsReport()
+	nlohmann::json toJson() const;
+
+	std::size_t nodeCount = 0;
+	std::size_t leafCount = 0;
+	// Number of triangle references stored in the leaves. Triangles may be referenced by several leaves.
+	std::size_t referenceCount = 0;
+	// Number of distinct triangles referenced by the leaves
+	std::size_t triangleCount = 0;
+	LeafSizeHistogram leafSizes;
+	// Number of bytes occupied by the nodes, the triangle references and any precomputed triangle data
+	std::size_t memoryUsage = 0;
+	// Expected cost of tracing a ray according to the surface area heuristic
+	float expectedRayCost = 0.f;
+};
+
+// Returns the number of distinct triangles in the index pool
+std::size_t countUniqueTriangles(const std::vector<uint32_t>& triIndices);
+
+}
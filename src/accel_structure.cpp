@@ -0,0 +1,281 @@
+#include "accel_structure.hpp"
+#include "timer.hpp"
+
+namespace specter {
+
+// Returns true if the expected ray cost of a refitted hierarchy is still acceptable compared to the cost after its build
+static bool acceptRefit(const char* name, const float builtRayCost, const float rayCost, const BVHParameters& parameters) {
+	if (rayCost <= builtRayCost * (1.f + parameters.refitThreshold)) {
+		return true;
+	}
+	std::cout << "Expected ray cost of the refitted " << name << " degraded from " << builtRayCost << " to " << rayCost << ".\n";
+	return false;
+}
+
+OctreeStructure::OctreeStructure(const OctreeParameters& parameters)
+	: parameters(parameters)
+{}
+
+const char* OctreeStructure::GetName() const {
+	return "octree";
+}
+
+void OctreeStructure::build(std::shared_ptr<Model>& model) {
+	octree.build(model, parameters);
+}
+
+bool OctreeStructure::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	return octree.traverse(model, ray, intersection);
+}
+
+bool OctreeStructure::traverseAny(const Model* model, const Ray& ray) const {
+	return octree.traverseAny(model, ray);
+}
+
+AccelStats OctreeStructure::GetStats() const {
+	AccelStats stats;
+	stats.nodeCount = octree.GetNodeCount();
+	stats.leafCount = octree.GetLeafCount();
+	stats.referenceCount = octree.GetReferenceCount();
+	stats.triangleCount = octree.GetUniqueTriangleCount();
+	stats.leafSizes = octree.GetLeafSizeHistogram();
+	stats.memoryUsage = octree.GetMemoryUsage();
+	stats.expectedRayCost = octree.ComputeExpectedRayCost();
+	return stats;
+}
+
+void OctreeStructure::printStats(std::ostream& os) const {
+	IAccelStructure::printStats(os);
+	if (parameters.triangleBlockBudget > 0) {
+		os << "Triangle blocks: " << octree.GetTriangleBlockLeafCount() << " of " << octree.GetLeafCount() << " leaves, "
+			<< octree.GetTriangleBlockMemory() / (1024.0 * 1024.0) << " MB (budget " << parameters.triangleBlockBudget / (1024.0 * 1024.0) << " MB).\n";
+	}
+}
+
+LBVHStructure::LBVHStructure(const BVHParameters& parameters)
+	: parameters(parameters)
+{}
+
+const char* LBVHStructure::GetName() const {
+	return "LBVH";
+}
+
+void LBVHStructure::build(std::shared_ptr<Model>& model) {
+	this->model = model.get();
+	lbvh.prepass(*model);
+	if (parameters.treeletRounds > 0) {
+		const float initialCost = lbvh.ComputeExpectedRayCost(*model);
+		specter::Timer treeletTimer;
+		lbvh.optimizeTreelets(*model, parameters.treeletRounds);
+		std::cout << "Restructured treelets in " << parameters.treeletRounds << " rounds in " << treeletTimer.elapsedTime()
+			<< " seconds, expected ray cost: " << initialCost << " -> " << lbvh.ComputeExpectedRayCost(*model) << ".\n";
+	}
+	builtRayCost = lbvh.ComputeExpectedRayCost(*model);
+}
+
+bool LBVHStructure::refit(std::shared_ptr<Model>& model) {
+	this->model = model.get();
+	lbvh.refit(*model);
+	return acceptRefit(GetName(), builtRayCost, lbvh.ComputeExpectedRayCost(*model), parameters);
+}
+
+bool LBVHStructure::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	return lbvh.traverse(model, ray, intersection);
+}
+
+bool LBVHStructure::traverseAny(const Model* model, const Ray& ray) const {
+	return lbvh.traverseAny(model, ray);
+}
+
+AccelStats LBVHStructure::GetStats() const {
+	// Every leaf of the LBVH is a single triangle
+	AccelStats stats;
+	stats.leafCount = lbvh.GetNumberOfInternalNodes() + 1;
+	stats.nodeCount = lbvh.GetNumberOfInternalNodes() + stats.leafCount;
+	stats.referenceCount = stats.leafCount;
+	stats.triangleCount = stats.leafCount;
+	stats.leafSizes[1] = stats.leafCount;
+	stats.memoryUsage = lbvh.GetMemoryUsage();
+	stats.expectedRayCost = lbvh.ComputeExpectedRayCost(*model);
+	return stats;
+}
+
+BVHStructure::BVHStructure(const BVHParameters& parameters)
+	: parameters(parameters)
+{}
+
+const char* BVHStructure::GetName() const {
+	return "BVH";
+}
+
+void BVHStructure::build(std::shared_ptr<Model>& model) {
+	bvh.build(*model, parameters);
+	builtRayCost = bvh.ComputeExpectedRayCost();
+}
+
+bool BVHStructure::refit(std::shared_ptr<Model>& model) {
+	bvh.refit(*model);
+	return acceptRefit(GetName(), builtRayCost, bvh.ComputeExpectedRayCost(), parameters);
+}
+
+bool BVHStructure::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	return bvh.traverse(model, ray, intersection);
+}
+
+bool BVHStructure::traverseAny(const Model* model, const Ray& ray) const {
+	return bvh.traverseAny(model, ray);
+}
+
+AccelStats BVHStructure::GetStats() const {
+	AccelStats stats;
+	stats.nodeCount = bvh.GetNodeCount();
+	stats.leafCount = bvh.GetLeafCount();
+	stats.referenceCount = bvh.GetReferenceCount();
+	stats.triangleCount = bvh.GetUniqueTriangleCount();
+	stats.leafSizes = bvh.GetLeafSizeHistogram();
+	stats.memoryUsage = bvh.GetMemoryUsage();
+	stats.expectedRayCost = bvh.ComputeExpectedRayCost();
+	return stats;
+}
+
+WideBVHStructure::WideBVHStructure(const AccelStructure source, const BVHParameters& parameters)
+	: source(source)
+	, parameters(parameters)
+{}
+
+const char* WideBVHStructure::GetName() const {
+	return source == AccelStructure::LBVH ? "wide LBVH" : "wide BVH";
+}
+
+void WideBVHStructure::build(std::shared_ptr<Model>& model) {
+	// Reports the binary hierarchy and collapses it
+	auto collapse = [&](auto& binary, auto&& buildWide) {
+		binary.build(model);
+		std::cout << "Built " << binary.GetName() << ", expected ray cost: " << binary.GetStats().expectedRayCost << ".\n";
+		specter::Timer collapseTimer;
+		buildWide(binary.GetHierarchy());
+		std::cout << "Collapsed into " << wideBVH.GetNodeCount() << " wide nodes of depth " << wideBVH.GetMaxDepth()
+			<< " in " << collapseTimer.elapsedTime() << " seconds.\n";
+	};
+
+	if (source == AccelStructure::LBVH) {
+		LBVHStructure binary(parameters);
+		collapse(binary, [&](const CPU_LBVH& lbvh) { wideBVH.build(lbvh, *model); });
+	} else {
+		BVHStructure binary(parameters);
+		collapse(binary, [&](const BVH& bvh) { wideBVH.build(bvh); });
+	}
+}
+
+bool WideBVHStructure::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	return wideBVH.traverse(model, ray, intersection);
+}
+
+bool WideBVHStructure::traverseAny(const Model* model, const Ray& ray) const {
+	return wideBVH.traverseAny(model, ray);
+}
+
+AccelStats WideBVHStructure::GetStats() const {
+	AccelStats stats;
+	stats.nodeCount = wideBVH.GetNodeCount();
+	stats.leafCount = wideBVH.GetLeafCount();
+	stats.referenceCount = wideBVH.GetTriangleIndices().size();
+	stats.triangleCount = wideBVH.GetUniqueTriangleCount();
+	stats.leafSizes = wideBVH.GetLeafSizeHistogram();
+	stats.memoryUsage = wideBVH.GetMemoryUsage();
+	stats.expectedRayCost = wideBVH.ComputeExpectedRayCost();
+	return stats;
+}
+
+CompressedBVHStructure::CompressedBVHStructure(const AccelStructure source, const BVHParameters& parameters)
+	: source(source)
+	, parameters(parameters)
+{}
+
+const char* CompressedBVHStructure::GetName() const {
+	return source == AccelStructure::LBVH ? "compressed wide LBVH" : "compressed wide BVH";
+}
+
+void CompressedBVHStructure::build(std::shared_ptr<Model>& model) {
+	WideBVHStructure wide(source, parameters);
+	wide.build(model);
+	specter::Timer compressTimer;
+	compressedBVH.build(wide.GetHierarchy());
+	const double nTriangles = static_cast<double>(model->GetTriangleCount());
+	std::cout << "Compressed in " << compressTimer.elapsedTime() << " seconds, bytes per triangle: "
+		<< wide.GetHierarchy().GetMemoryUsage() / nTriangles << " -> " << compressedBVH.GetMemoryUsage() / nTriangles << ".\n";
+}
+
+bool CompressedBVHStructure::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	return compressedBVH.traverse(model, ray, intersection);
+}
+
+bool CompressedBVHStructure::traverseAny(const Model* model, const Ray& ray) const {
+	return compressedBVH.traverseAny(model, ray);
+}
+
+AccelStats CompressedBVHStructure::GetStats() const {
+	AccelStats stats;
+	stats.nodeCount = compressedBVH.GetNodeCount();
+	stats.leafCount = compressedBVH.GetLeafCount();
+	stats.referenceCount = compressedBVH.GetReferenceCount();
+	stats.triangleCount = compressedBVH.GetUniqueTriangleCount();
+	stats.leafSizes = compressedBVH.GetLeafSizeHistogram();
+	stats.memoryUsage = compressedBVH.GetMemoryUsage();
+	stats.expectedRayCost = compressedBVH.ComputeExpectedRayCost();
+	return stats;
+}
+
+KdTreeStructure::KdTreeStructure(const KdTreeParameters& parameters)
+	: parameters(parameters)
+{}
+
+const char* KdTreeStructure::GetName() const {
+	return "k-d tree";
+}
+
+void KdTreeStructure::build(std::shared_ptr<Model>& model) {
+	kdTree.build(*model, parameters);
+}
+
+bool KdTreeStructure::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	return kdTree.traverse(model, ray, intersection);
+}
+
+bool KdTreeStructure::traverseAny(const Model* model, const Ray& ray) const {
+	return kdTree.traverseAny(model, ray);
+}
+
+AccelStats KdTreeStructure::GetStats() const {
+	AccelStats stats;
+	stats.nodeCount = kdTree.GetNodeCount();
+	stats.leafCount = kdTree.GetLeafCount();
+	stats.referenceCount = kdTree.GetReferenceCount();
+	stats.triangleCount = kdTree.GetUniqueTriangleCount();
+	stats.leafSizes = kdTree.GetLeafSizeHistogram();
+	stats.memoryUsage = kdTree.GetMemoryUsage();
+	stats.expectedRayCost = kdTree.ComputeExpectedRayCost();
+	return stats;
+}
+
+std::unique_ptr<IAccelStructure> createAccelStructure(	const AccelStructure structure, const OctreeParameters& octreeParameters,
+														const BVHParameters& bvhParameters, const KdTreeParameters& kdTreeParameters) {
+	if (structure == AccelStructure::Octree) {
+		return std::make_unique<OctreeStructure>(octreeParameters);
+	}
+	if (structure == AccelStructure::KdTree) {
+		return std::make_unique<KdTreeStructure>(kdTreeParameters);
+	}
+	if (bvhParameters.compressed) {
+		return std::make_unique<CompressedBVHStructure>(structure, bvhParameters);
+	}
+	if (bvhParameters.wide) {
+		return std::make_unique<WideBVHStructure>(structure, bvhParameters);
+	}
+	if (structure == AccelStructure::LBVH) {
+		return std::make_unique<LBVHStructure>(bvhParameters);
+	}
+	return std::make_unique<BVHStructure>(bvhParameters);
+}
+
+}
@@ -0,0 +1,219 @@
+#pragma once
+#include "accel_parameters.hpp"
+#include "accel_stats.hpp"
+#include "bvh.hpp"
+#include "compressed_bvh.hpp"
+#include "dev/cpu_lbvh.hpp"
+#include "kd_tree.hpp"
+#include "model.hpp"
+#include "octree.hpp"
+#include "ray.hpp"
+#include "wide_bvh.hpp"
+
+#include <iostream>
+#include <memory>
+
+namespace specter {
+
+// Interface of the structures, which accelerate ray tracing in Accel. The structure is selected at runtime,
+// see createAccelStructure(). Single rays pay a virtual call each, whereas traverseBatch() dispatches
+// once per batch and runs a loop, which is compiled for the structure.
+class IAccelStructure {
+
+public:
+
+	virtual ~IAccelStructure() {}
+
+	// Returns the name of the structure, which is used in reports
+	virtual const char* GetName() const = 0;
+
+	// Constructs the structure for the model. Builds, which consist of several stages, report the stages
+	// in between on std::cout. The parameters of a structure are passed to its constructor.
+	virtual void build(std::shared_ptr<Model>& model) = 0;
+
+	// Updates the structure after the vertices of the model have moved, keeping its topology. Returns false if
+	// the structure has to be rebuilt instead, because it can't be refitted or its quality degraded too far.
+	virtual bool refit(std::shared_ptr<Model>& /*model*/) {
+		return false;
+	}
+
+	// Returns true if the ray intersects geometry in the mesh.
+	// Additionally, it is guaranteed that the intersection point is the closest intersection point to the ray origin
+	virtual bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const = 0;
+
+	// Returns true if the ray intersects any geometry in the mesh within the ray interval.
+	virtual bool traverseAny(const Model* model, const Ray& ray) const = 0;
+
+	// Finds the closest intersection of every ray, see traverse().
+	virtual void traverseBatch(const Model* model, const Ray* rays, Intersection* intersections, const std::size_t nRays) const = 0;
+
+	virtual AccelStats GetStats() const = 0;
+
+	// Reports the statistics of the structure
+	virtual void printStats(std::ostream& os) const {
+		const AccelStats stats = GetStats();
+		os << "Nodes: " << stats.nodeCount << ", leaves: " << stats.leafCount << ", triangle references: " << stats.referenceCount
+			<< " of " << stats.triangleCount << " triangles, " << stats.memoryUsage / (1024.0 * 1024.0) << " MB"
+			<< ", expected ray cost: " << stats.expectedRayCost << ".\n";
+	}
+};
+
+// Implements traverseBatch() for "Structure", whose traverse() is called without virtual dispatch in the loop.
+template<typename Structure>
+class AccelStructureBase : public IAccelStructure {
+
+public:
+
+	void traverseBatch(const Model* model, const Ray* rays, Intersection* intersections, const std::size_t nRays) const override {
+		const Structure& structure = static_cast<const Structure&>(*this);
+		for (std::size_t i = 0; i < nRays; ++i) {
+			structure.Structure::traverse(model, rays[i], intersections[i]);
+		}
+	}
+};
+
+class OctreeStructure final : public AccelStructureBase<OctreeStructure> {
+
+public:
+
+	explicit OctreeStructure(const OctreeParameters& parameters);
+
+	const char* GetName() const override;
+	void build(std::shared_ptr<Model>& model) override;
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const override;
+	bool traverseAny(const Model* model, const Ray& ray) const override;
+	AccelStats GetStats() const override;
+	void printStats(std::ostream& os) const override;
+
+	Octree& GetOctree() {
+		return octree;
+	}
+
+private:
+
+	Octree octree;
+	OctreeParameters parameters;
+};
+
+class LBVHStructure final : public AccelStructureBase<LBVHStructure> {
+
+public:
+
+	explicit LBVHStructure(const BVHParameters& parameters);
+
+	const char* GetName() const override;
+	// Restructures the treelets after the construction, see BVHParameters::treeletRounds.
+	void build(std::shared_ptr<Model>& model) override;
+	// Fails once the expected ray cost exceeds the cost after the build, see BVHParameters::refitThreshold.
+	bool refit(std::shared_ptr<Model>& model) override;
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const override;
+	bool traverseAny(const Model* model, const Ray& ray) const override;
+	AccelStats GetStats() const override;
+
+	const CPU_LBVH& GetHierarchy() const {
+		return lbvh;
+	}
+
+private:
+
+	CPU_LBVH lbvh;
+	BVHParameters parameters;
+	const Model* model = nullptr;
+	float builtRayCost = 0.f;	// Expected ray cost after the last build
+};
+
+class BVHStructure final : public AccelStructureBase<BVHStructure> {
+
+public:
+
+	explicit BVHStructure(const BVHParameters& parameters);
+
+	const char* GetName() const override;
+	void build(std::shared_ptr<Model>& model) override;
+	// Fails once the expected ray cost exceeds the cost after the build, see BVHParameters::refitThreshold.
+	bool refit(std::shared_ptr<Model>& model) override;
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const override;
+	bool traverseAny(const Model* model, const Ray& ray) const override;
+	AccelStats GetStats() const override;
+
+	const BVH& GetHierarchy() const {
+		return bvh;
+	}
+
+private:
+
+	BVH bvh;
+	BVHParameters parameters;
+	float builtRayCost = 0.f;	// Expected ray cost after the last build
+};
+
+// Wide hierarchy, which is collapsed from a LBVH or a BVH. The binary hierarchy is released after the collapse.
+class WideBVHStructure final : public AccelStructureBase<WideBVHStructure> {
+
+public:
+
+	// "source" selects the binary hierarchy, either AccelStructure::LBVH or AccelStructure::BVH.
+	WideBVHStructure(const AccelStructure source, const BVHParameters& parameters);
+
+	const char* GetName() const override;
+	void build(std::shared_ptr<Model>& model) override;
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const override;
+	bool traverseAny(const Model* model, const Ray& ray) const override;
+	AccelStats GetStats() const override;
+
+	const WideBVH& GetHierarchy() const {
+		return wideBVH;
+	}
+
+private:
+
+	WideBVH wideBVH;
+	AccelStructure source;
+	BVHParameters parameters;
+};
+
+// Compressed wide hierarchy. The uncompressed wide hierarchy is released after the compression.
+class CompressedBVHStructure final : public AccelStructureBase<CompressedBVHStructure> {
+
+public:
+
+	// "source" selects the binary hierarchy, either AccelStructure::LBVH or AccelStructure::BVH.
+	CompressedBVHStructure(const AccelStructure source, const BVHParameters& parameters);
+
+	const char* GetName() const override;
+	void build(std::shared_ptr<Model>& model) override;
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const override;
+	bool traverseAny(const Model* model, const Ray& ray) const override;
+	AccelStats GetStats() const override;
+
+private:
+
+	CompressedBVH compressedBVH;
+	AccelStructure source;
+	BVHParameters parameters;
+};
+
+class KdTreeStructure final : public AccelStructureBase<KdTreeStructure> {
+
+public:
+
+	explicit KdTreeStructure(const KdTreeParameters& parameters);
+
+	const char* GetName() const override;
+	void build(std::shared_ptr<Model>& model) override;
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const override;
+	bool traverseAny(const Model* model, const Ray& ray) const override;
+	AccelStats GetStats() const override;
+
+private:
+
+	KdTree kdTree;
+	KdTreeParameters parameters;
+};
+
+// Creates the structure selected by "structure". The LBVH and the BVH are collapsed into
+// the wide or the compressed hierarchy, if BVHParameters::wide or BVHParameters::compressed is set.
+std::unique_ptr<IAccelStructure> createAccelStructure(	const AccelStructure structure, const OctreeParameters& octreeParameters,
+														const BVHParameters& bvhParameters, const KdTreeParameters& kdTreeParameters);
+
+}
@@ -15,10 +15,9 @@ vec3f AreaLight::scatter(const Accel& accel, const vec3f& point, const vec3f& no
 	constexpr float epsilon = 1e-3;
 	vec3f area_center = t0.v0 + ((t0.v2 - t0.v0) / 2.f);
 	vec3f sdir = normalize(area_center - (point + normal * epsilon));
-	Ray shadowRay(point + normal * epsilon, sdir);	// Displace origin to avoid self-shadowing
-	
-	float tmax = (area_center.x - shadowRay.o.x) / sdir.x;
+	float tmax = (area_center.x - (point.x + normal.x * epsilon)) / sdir.x;
+	Ray shadowRay(point + normal * epsilon, sdir, 0.f, tmax);	// Displace origin to avoid self-shadowing
 
-	return accel.traceShadowRayTmax(shadowRay, tmax) ? vec3f(0.f) : vec3f(1.f);
+	return accel.traceShadowRay(shadowRay) ? vec3f(0.f) : vec3f(1.f);
 }*/
 }
\ No newline at end of file
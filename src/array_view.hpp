@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+namespace specter {
+
+// Read-only view of a contiguous array, which is owned elsewhere, e.g. by a vector
+// or a memory mapped file. The view is invalidated if the owner reallocates.
+template<typename T>
+struct ArrayView {
+
+	ArrayView()
+		: ptr(nullptr)
+		, count(0)
+	{}
+
+	ArrayView(const T* ptr, const std::size_t count)
+		: ptr(ptr)
+		, count(count)
+	{}
+
+	template<typename Allocator>
+	ArrayView(const std::vector<T, Allocator>& v)
+		: ptr(v.data())
+		, count(v.size())
+	{}
+
+	const T& operator[](const std::size_t i) const {
+		return ptr[i];
+	}
+
+	const T* data() const {
+		return ptr;
+	}
+
+	std::size_t size() const {
+		return count;
+	}
+
+	bool empty() const {
+		return count == 0;
+	}
+
+	const T* begin() const {
+		return ptr;
+	}
+
+	const T* end() const {
+		return ptr + count;
+	}
+
+private:
+
+	const T* ptr;
+	std::size_t count;
+};
+
+}
@@ -0,0 +1,741 @@
+#include "bvh.hpp"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/parallel_reduce.h>
+
+#include <atomic>
+#include <memory>
+#include <numeric>	// For std::iota
+
+// Nodes deeper than this become leaves, regardless of their triangle count.
+#define nMaxBuildDepth (60)
+// Bounds the number of nodes on the traversal stack. The stack holds at most one node per level.
+#define nTraversalStackSize (nMaxBuildDepth + 4)
+
+// Nodes referencing at least this many triangles build their children in parallel.
+#define nParallelBuildThreshold (1 << 12)
+// Nodes referencing at least this many triangles bin their triangles in parallel.
+#define nParallelBinThreshold (1 << 15)
+
+// Spatial splits are only evaluated for nodes, whose object split produces children that overlap
+// by more than this fraction of the surface area of the root.
+#define spatialSplitOverlapThreshold (1e-5f)
+
+namespace specter {
+
+// Returns the bin of the centroid along the axis.
+// "scale" maps the centroid bounds of the node to [0, nBins], see BVH::buildRec().
+static int computeBinIndex(const vec3f& centroid, const int axis, const vec3f& cmin, const vec3f& scale) {
+	return std::min(BVH::nBins - 1, static_cast<int>((centroid[axis] - cmin[axis]) * scale[axis]));
+}
+
+// Returns a box, which contains nothing and becomes the other box when combined with it
+static AxisAlignedBoundingBox emptyBounds() {
+	return AxisAlignedBoundingBox(vec3f(std::numeric_limits<float>::max()), vec3f(std::numeric_limits<float>::lowest()));
+}
+
+// Returns true if the box contains nothing. Boxes of flat triangles are collapsed along an axis, but not empty.
+static bool isEmpty(const AxisAlignedBoundingBox& box) {
+	return !(box.min <= box.max);
+}
+
+// Returns the bounds of the triangle of the model
+static AxisAlignedBoundingBox computeTriangleBounds(const Model& model, const uint32_t triangle) {
+	const vec3f v0 = model.GetVertex(model.GetFace(triangle * 3 + 0).p);
+	const vec3f v1 = model.GetVertex(model.GetFace(triangle * 3 + 1).p);
+	const vec3f v2 = model.GetVertex(model.GetFace(triangle * 3 + 2).p);
+	return AxisAlignedBoundingBox(minComponent(minComponent(v0, v1), v2), maxComponent(maxComponent(v0, v1), v2));
+}
+
+// Returns true if the ray hits the bounding box of the node within the ray interval.
+// nearT is the distance at which the ray enters the box.
+static inline bool intersectBounds(const BVH::Node& node, const Ray& ray, float& nearT) {
+	const vec3f t0 = (node.bmin - ray.o) * ray.invd;
+	const vec3f t1 = (node.bmax - ray.o) * ray.invd;
+	nearT = std::max(maxComponent(minv(t0, t1)), ray.tmin);
+	const float farT = std::min(minComponent(maxv(t0, t1)) * robustFarScale, ray.tmax);
+	return nearT <= farT;
+}
+
+void BVH::build(const Model& model, const BVHParameters& parameters) {
+	const uint32_t nTriangles = static_cast<uint32_t>(model.GetTriangleCount());
+	if (nTriangles == 0) {
+		throw std::runtime_error("Can't build a BVH for a model without triangles");
+	}
+
+	std::vector<AxisAlignedBoundingBox> triangleBounds(nTriangles);
+	tbb::parallel_for(tbb::blocked_range<uint32_t>(0, nTriangles), [&](const tbb::blocked_range<uint32_t>& r) {
+		for (uint32_t i = r.begin(); i < r.end(); ++i) {
+			triangleBounds[i] = computeTriangleBounds(model, i);
+		}
+	});
+	buildHierarchy(&model, triangleBounds, parameters);
+}
+
+void BVH::build(const std::vector<AxisAlignedBoundingBox>& primitiveBounds, const BVHParameters& parameters) {
+	if (primitiveBounds.empty()) {
+		throw std::runtime_error("Can't build a BVH without primitives");
+	}
+	buildHierarchy(nullptr, primitiveBounds, parameters);
+}
+
+void BVH::refit(const Model& model) {
+	// The nodes don't store their parents, which are recovered from the child offsets.
+	// The root has no parent and the unused slot after it is skipped.
+	const uint32_t nNodes = static_cast<uint32_t>(nodes.size());
+	const uint32_t noParent = std::numeric_limits<uint32_t>::max();
+	std::vector<uint32_t> parents(nNodes, noParent);
+	std::unique_ptr<std::atomic<uint32_t>[]> atomic_counters(new std::atomic<uint32_t>[nNodes]);
+	tbb::parallel_for(tbb::blocked_range<uint32_t>(0, nNodes), [&](const tbb::blocked_range<uint32_t>& r) {
+		for (uint32_t i = r.begin(); i < r.end(); ++i) {
+			atomic_counters[i].store(0, std::memory_order_relaxed);
+			if (i != 1 && !nodes[i].IsLeaf()) {
+				parents[nodes[i].offset] = i;
+				parents[nodes[i].offset + 1] = i;
+			}
+		}
+	});
+
+	// Bottom up reduction as in CPU_LBVH::generateBV(). Every leaf recomputes its bounds from its triangles
+	// and walks up towards the root. The second thread arriving at a node combines the bounds of its children.
+	// Leaves built with spatial splits are refitted to the whole bounds of their triangles.
+	tbb::parallel_for(tbb::blocked_range<uint32_t>(0, nNodes), [&](const tbb::blocked_range<uint32_t>& r) {
+		for (uint32_t i = r.begin(); i < r.end(); ++i) {
+			Node& leaf = nodes[i];
+			if (i == 1 || !leaf.IsLeaf()) {
+				continue;
+			}
+
+			const AxisAlignedBoundingBox bounds = computeTriangleBounds(model, triIndices[leaf.offset]);
+			leaf.bmin = bounds.min;
+			leaf.bmax = bounds.max;
+			for (uint32_t k = leaf.offset + 1; k < leaf.offset + leaf.nTriangles; ++k) {
+				const AxisAlignedBoundingBox triangleBounds = computeTriangleBounds(model, triIndices[k]);
+				leaf.bmin = minComponent(leaf.bmin, triangleBounds.min);
+				leaf.bmax = maxComponent(leaf.bmax, triangleBounds.max);
+			}
+
+			uint32_t parentIdx = parents[i];
+			while (parentIdx != noParent) {
+				// The acquire-release ordering makes the bounds written by the first thread visible to the second one.
+				if (atomic_counters[parentIdx].fetch_add(1, std::memory_order_acq_rel) == 0) {
+					break;
+				}
+				Node& parent = nodes[parentIdx];
+				parent.bmin = minComponent(nodes[parent.offset].bmin, nodes[parent.offset + 1].bmin);
+				parent.bmax = maxComponent(nodes[parent.offset].bmax, nodes[parent.offset + 1].bmax);
+				parentIdx = parents[parentIdx];
+			}
+		}
+	});
+}
+
+void BVH::buildHierarchy(const Model* model, const std::vector<AxisAlignedBoundingBox>& primitiveBounds, const BVHParameters& parameters) {
+	const uint32_t nPrimitives = static_cast<uint32_t>(primitiveBounds.size());
+	std::vector<vec3f> centroids(nPrimitives);
+	tbb::parallel_for(tbb::blocked_range<uint32_t>(0, nPrimitives), [&](const tbb::blocked_range<uint32_t>& r) {
+		for (uint32_t i = r.begin(); i < r.end(); ++i) {
+			centroids[i] = primitiveBounds[i].center();
+		}
+	});
+
+	const BuildBounds rootBounds = tbb::parallel_reduce(tbb::blocked_range<uint32_t>(0, nPrimitives), BuildBounds::Empty(),
+		[&](const tbb::blocked_range<uint32_t>& r, BuildBounds bounds) {
+			for (uint32_t i = r.begin(); i < r.end(); ++i) {
+				bounds.extend(primitiveBounds[i], centroids[i]);
+			}
+			return bounds;
+		},
+		[](BuildBounds b0, const BuildBounds& b1) {
+			b0.extend(b1);
+			return b0;
+		});
+
+	// A binary tree with n leaves has 2n - 1 nodes. Together with the unused slot after the root,
+	// which aligns the sibling pairs to cache lines, the hierarchy has at most 2n nodes.
+	// With spatial splits, n is the number of references instead of primitives.
+	nodes.clear();
+	std::atomic<uint32_t> nodeCount(2);
+
+	BuildContext context;
+	context.primitiveBounds = primitiveBounds.data();
+	context.centroids = centroids.data();
+	context.nodeCount = &nodeCount;
+	context.maxLeafSize = std::max(parameters.maxLeafSize, 1u);
+
+	if (parameters.spatialSplits && model != nullptr) {
+		const uint32_t maxReferences = nPrimitives + static_cast<uint32_t>(nPrimitives * std::max(parameters.duplicationBudget, 0.f));
+		std::vector<Reference> references(nPrimitives);
+		for (uint32_t i = 0; i < nPrimitives; ++i) {
+			references[i] = { primitiveBounds[i], i };
+		}
+		triIndices.resize(maxReferences);
+		nodes.resize(std::size_t(maxReferences) * 2);
+		std::atomic<uint32_t> referenceCount(nPrimitives);
+		std::atomic<uint32_t> leafReferenceCount(0);
+
+		context.model = model;
+		context.referenceCount = &referenceCount;
+		context.leafReferenceCount = &leafReferenceCount;
+		context.maxReferences = maxReferences;
+		context.rootArea = rootBounds.surfaceArea();
+		buildSpatialRec(context, 0, references, rootBounds, 0);
+
+		triIndices.resize(leafReferenceCount.load());
+		triIndices.shrink_to_fit();
+	} else {
+		triIndices.resize(nPrimitives);
+		std::iota(triIndices.begin(), triIndices.end(), 0);
+		nodes.resize(std::size_t(nPrimitives) * 2);
+		buildRec(context, 0, 0, nPrimitives, rootBounds, 0);
+	}
+
+	nodes.resize(nodeCount.load());
+	nodes.shrink_to_fit();
+}
+
+void BVH::buildRec(const BuildContext& context, const uint32_t nodeIdx, const uint32_t begin, const uint32_t end, const BuildBounds& bounds, const int depth) {
+	Node& node = nodes[nodeIdx];
+	node.bmin = bounds.bmin;
+	node.bmax = bounds.bmax;
+
+	const uint32_t nTriangles = end - begin;
+	if (nTriangles == 1 || depth >= nMaxBuildDepth) {
+		node.offset = begin;
+		node.nTriangles = nTriangles;
+		return;
+	}
+
+	// Axes, along which all centroids coincide, can't be split and are skipped.
+	const vec3f extent = bounds.cmax - bounds.cmin;
+	vec3f scale;
+	for (int axis = 0; axis < 3; ++axis) {
+		scale[axis] = extent[axis] > 0.f ? nBins / extent[axis] : 0.f;
+	}
+
+	auto binTriangles = [&](const uint32_t first, const uint32_t last, Binning& binning) {
+		for (uint32_t i = first; i < last; ++i) {
+			const uint32_t triangle = triIndices[i];
+			const vec3f& centroid = context.centroids[triangle];
+			for (int axis = 0; axis < 3; ++axis) {
+				binning.bins[axis][computeBinIndex(centroid, axis, bounds.cmin, scale)].add(context.primitiveBounds[triangle], centroid);
+			}
+		}
+	};
+
+	Binning binning;
+	if (nTriangles >= nParallelBinThreshold) {
+		binning = tbb::parallel_reduce(tbb::blocked_range<uint32_t>(begin, end), Binning(),
+			[&](const tbb::blocked_range<uint32_t>& r, Binning b) {
+				binTriangles(r.begin(), r.end(), b);
+				return b;
+			},
+			[](Binning b0, const Binning& b1) {
+				b0.merge(b1);
+				return b0;
+			});
+	} else {
+		binTriangles(begin, end, binning);
+	}
+
+	const float area = bounds.surfaceArea();
+	const ObjectSplit split = findObjectSplit(binning, scale, area > 0.f ? 1.f / area : 1.f);
+
+	// Small nodes become leaves, if intersecting all of their triangles is cheaper than splitting them.
+	if (nTriangles <= context.maxLeafSize && costIntersection * nTriangles <= split.cost) {
+		node.offset = begin;
+		node.nTriangles = nTriangles;
+		return;
+	}
+
+	uint32_t middle;
+	BuildBounds leftBounds = BuildBounds::Empty();
+	BuildBounds rightBounds = BuildBounds::Empty();
+	if (split.axis != -1) {
+		const uint32_t* first = std::partition(triIndices.data() + begin, triIndices.data() + end, [&](const uint32_t triangle) {
+			return computeBinIndex(context.centroids[triangle], split.axis, bounds.cmin, scale) <= split.bin;
+		});
+		middle = static_cast<uint32_t>(first - triIndices.data());
+		binning.GetSplitBounds(split, leftBounds, rightBounds);
+	} else {
+		// All centroids coincide, hence the triangles are distributed evenly.
+		middle = begin + nTriangles / 2;
+		for (uint32_t i = begin; i < end; ++i) {
+			const uint32_t triangle = triIndices[i];
+			(i < middle ? leftBounds : rightBounds).extend(context.primitiveBounds[triangle], context.centroids[triangle]);
+		}
+	}
+
+	const uint32_t leftIdx = context.nodeCount->fetch_add(2);
+	node.offset = leftIdx;
+	node.nTriangles = 0;
+
+	if (nTriangles >= nParallelBuildThreshold) {
+		tbb::parallel_invoke(
+			[&] { buildRec(context, leftIdx, begin, middle, leftBounds, depth + 1); },
+			[&] { buildRec(context, leftIdx + 1, middle, end, rightBounds, depth + 1); });
+	} else {
+		buildRec(context, leftIdx, begin, middle, leftBounds, depth + 1);
+		buildRec(context, leftIdx + 1, middle, end, rightBounds, depth + 1);
+	}
+}
+
+void BVH::buildSpatialRec(const BuildContext& context, const uint32_t nodeIdx, std::vector<Reference>& references, const BuildBounds& bounds, const int depth) {
+	Node& node = nodes[nodeIdx];
+	node.bmin = bounds.bmin;
+	node.bmax = bounds.bmax;
+
+	const uint32_t nReferences = static_cast<uint32_t>(references.size());
+	auto makeLeaf = [&] {
+		node.offset = context.leafReferenceCount->fetch_add(nReferences);
+		node.nTriangles = nReferences;
+		for (uint32_t i = 0; i < nReferences; ++i) {
+			triIndices[node.offset + i] = references[i].triangle;
+		}
+	};
+
+	if (nReferences == 1 || depth >= nMaxBuildDepth) {
+		makeLeaf();
+		return;
+	}
+
+	const vec3f extent = bounds.cmax - bounds.cmin;
+	vec3f scale;
+	for (int axis = 0; axis < 3; ++axis) {
+		scale[axis] = extent[axis] > 0.f ? nBins / extent[axis] : 0.f;
+	}
+
+	auto binReferences = [&](const uint32_t first, const uint32_t last, Binning& binning) {
+		for (uint32_t i = first; i < last; ++i) {
+			const vec3f centroid = references[i].bounds.center();
+			for (int axis = 0; axis < 3; ++axis) {
+				binning.bins[axis][computeBinIndex(centroid, axis, bounds.cmin, scale)].add(references[i].bounds, centroid);
+			}
+		}
+	};
+
+	Binning binning;
+	if (nReferences >= nParallelBinThreshold) {
+		binning = tbb::parallel_reduce(tbb::blocked_range<uint32_t>(0, nReferences), Binning(),
+			[&](const tbb::blocked_range<uint32_t>& r, Binning b) {
+				binReferences(r.begin(), r.end(), b);
+				return b;
+			},
+			[](Binning b0, const Binning& b1) {
+				b0.merge(b1);
+				return b0;
+			});
+	} else {
+		binReferences(0, nReferences, binning);
+	}
+
+	const float area = bounds.surfaceArea();
+	const float invArea = area > 0.f ? 1.f / area : 1.f;
+	const ObjectSplit objectSplit = findObjectSplit(binning, scale, invArea);
+	BuildBounds leftBounds = BuildBounds::Empty();
+	BuildBounds rightBounds = BuildBounds::Empty();
+	if (objectSplit.axis != -1) {
+		binning.GetSplitBounds(objectSplit, leftBounds, rightBounds);
+	}
+
+	// Spatial splits only pay off, where the children of the object split overlap considerably.
+	// Comparing the overlap to the root keeps the deep nodes from consuming the duplication budget.
+	SpatialSplit spatialSplit;
+	if (context.referenceCount->load(std::memory_order_relaxed) < context.maxReferences) {
+		bool overlapping = objectSplit.axis == -1;
+		if (!overlapping) {
+			const AxisAlignedBoundingBox overlap(maxComponent(leftBounds.bmin, rightBounds.bmin), minComponent(leftBounds.bmax, rightBounds.bmax));
+			overlapping = !isEmpty(overlap) && overlap.surfaceArea() > spatialSplitOverlapThreshold * context.rootArea;
+		}
+		if (overlapping) {
+			spatialSplit = findSpatialSplit(context, references, bounds, invArea);
+		}
+	}
+
+	// Small nodes become leaves, if intersecting all of their triangles is cheaper than splitting them.
+	if (nReferences <= context.maxLeafSize && costIntersection * nReferences <= std::min(objectSplit.cost, spatialSplit.cost)) {
+		makeLeaf();
+		return;
+	}
+
+	auto computeBounds = [](const std::vector<Reference>& part) {
+		BuildBounds partBounds = BuildBounds::Empty();
+		for (const Reference& reference : part) {
+			partBounds.extend(reference.bounds, reference.bounds.center());
+		}
+		return partBounds;
+	};
+
+	std::vector<Reference> left, right;
+	if (spatialSplit.cost < objectSplit.cost && partitionReferences(context, references, spatialSplit, bounds, left, right)) {
+		leftBounds = computeBounds(left);
+		rightBounds = computeBounds(right);
+	} else if (objectSplit.axis != -1) {
+		for (const Reference& reference : references) {
+			const bool isLeft = computeBinIndex(reference.bounds.center(), objectSplit.axis, bounds.cmin, scale) <= objectSplit.bin;
+			(isLeft ? left : right).push_back(reference);
+		}
+	} else {
+		// All centroids coincide, hence the references are distributed evenly.
+		left.assign(references.begin(), references.begin() + nReferences / 2);
+		right.assign(references.begin() + nReferences / 2, references.end());
+		leftBounds = computeBounds(left);
+		rightBounds = computeBounds(right);
+	}
+
+	// The references are owned by the children from now on
+	std::vector<Reference>().swap(references);
+
+	const uint32_t leftIdx = context.nodeCount->fetch_add(2);
+	node.offset = leftIdx;
+	node.nTriangles = 0;
+
+	if (nReferences >= nParallelBuildThreshold) {
+		tbb::parallel_invoke(
+			[&] { buildSpatialRec(context, leftIdx, left, leftBounds, depth + 1); },
+			[&] { buildSpatialRec(context, leftIdx + 1, right, rightBounds, depth + 1); });
+	} else {
+		buildSpatialRec(context, leftIdx, left, leftBounds, depth + 1);
+		buildSpatialRec(context, leftIdx + 1, right, rightBounds, depth + 1);
+	}
+}
+
+BVH::ObjectSplit BVH::findObjectSplit(const Binning& binning, const vec3f& scale, const float invArea) {
+	// Evaluate the surface area heuristic at the boundaries between the bins. The areas of the right sides
+	// are accumulated in a backward sweep first. Empty bins don't add split candidates and are skipped.
+	ObjectSplit best;
+	for (int axis = 0; axis < 3; ++axis) {
+		if (scale[axis] == 0.f) {
+			continue;
+		}
+
+		const Bin* bins = binning.bins[axis];
+		float rightAreas[nBins];
+		uint32_t rightCounts[nBins];
+		BuildBounds right = BuildBounds::Empty();
+		uint32_t nRight = 0;
+		for (int k = nBins - 1; k > 0; --k) {
+			if (bins[k].count > 0) {
+				right.extend(bins[k].bounds);
+				nRight += bins[k].count;
+			}
+			rightAreas[k] = nRight > 0 ? right.surfaceArea() : 0.f;
+			rightCounts[k] = nRight;
+		}
+
+		BuildBounds left = BuildBounds::Empty();
+		uint32_t nLeft = 0;
+		for (int k = 0; k < nBins - 1; ++k) {
+			if (bins[k].count == 0) {
+				continue;
+			}
+			left.extend(bins[k].bounds);
+			nLeft += bins[k].count;
+			if (rightCounts[k + 1] == 0) {
+				break;
+			}
+			const float cost = costTraversal + costIntersection * invArea
+				* (left.surfaceArea() * nLeft + rightAreas[k + 1] * rightCounts[k + 1]);
+			if (cost < best.cost) {
+				best.cost = cost;
+				best.axis = axis;
+				best.bin = k;
+			}
+		}
+	}
+	return best;
+}
+
+BVH::SpatialSplit BVH::findSpatialSplit(const BuildContext& context, const std::vector<Reference>& references, const BuildBounds& bounds, const float invArea) {
+	// The bins divide the bounds of the node evenly. A reference enters the bin of its minimum and exits
+	// the bin of its maximum. It is clipped at the boundaries of the bins in between.
+	const vec3f extent = bounds.bmax - bounds.bmin;
+	vec3f scale;
+	for (int axis = 0; axis < 3; ++axis) {
+		scale[axis] = extent[axis] > 0.f ? nBins / extent[axis] : 0.f;
+	}
+
+	const uint32_t nReferences = static_cast<uint32_t>(references.size());
+	SpatialSplit best;
+	for (int axis = 0; axis < 3; ++axis) {
+		if (scale[axis] == 0.f) {
+			continue;
+		}
+
+		AxisAlignedBoundingBox binBounds[nBins];
+		uint32_t entries[nBins] = {};
+		uint32_t exits[nBins] = {};
+		for (int k = 0; k < nBins; ++k) {
+			binBounds[k] = emptyBounds();
+		}
+
+		for (const Reference& reference : references) {
+			const int first = computeBinIndex(reference.bounds.min, axis, bounds.bmin, scale);
+			const int last = computeBinIndex(reference.bounds.max, axis, bounds.bmin, scale);
+			++entries[first];
+			++exits[last];
+
+			Reference remaining = reference;
+			for (int k = first; k < last; ++k) {
+				Reference leftPart, rightPart;
+				splitReference(*context.model, remaining, axis, bounds.bmin[axis] + (k + 1) / scale[axis], leftPart, rightPart);
+				if (!isEmpty(leftPart.bounds)) {
+					binBounds[k] = combine(binBounds[k], leftPart.bounds);
+				}
+				remaining = rightPart;
+			}
+			if (!isEmpty(remaining.bounds)) {
+				binBounds[last] = combine(binBounds[last], remaining.bounds);
+			}
+		}
+
+		AxisAlignedBoundingBox rightBoxes[nBins];
+		uint32_t rightCounts[nBins];
+		AxisAlignedBoundingBox right = emptyBounds();
+		uint32_t nRight = 0;
+		for (int k = nBins - 1; k > 0; --k) {
+			right = combine(right, binBounds[k]);
+			nRight += exits[k];
+			rightBoxes[k] = right;
+			rightCounts[k] = nRight;
+		}
+
+		AxisAlignedBoundingBox left = emptyBounds();
+		uint32_t nLeft = 0;
+		for (int k = 0; k < nBins - 1; ++k) {
+			left = combine(left, binBounds[k]);
+			nLeft += entries[k];
+			// Splits, which keep all references on one side, don't make progress
+			if (nLeft == 0 || rightCounts[k + 1] == 0 || nLeft == nReferences || rightCounts[k + 1] == nReferences
+				|| isEmpty(left) || isEmpty(rightBoxes[k + 1])) {
+				continue;
+			}
+			const float cost = costTraversal + costIntersection * invArea
+				* (left.surfaceArea() * nLeft + rightBoxes[k + 1].surfaceArea() * rightCounts[k + 1]);
+			if (cost < best.cost) {
+				best.cost = cost;
+				best.axis = axis;
+				best.bin = k;
+				best.nLeft = nLeft;
+				best.nRight = rightCounts[k + 1];
+				best.left = left;
+				best.right = rightBoxes[k + 1];
+			}
+		}
+	}
+	return best;
+}
+
+bool BVH::partitionReferences(	const BuildContext& context, const std::vector<Reference>& references, const SpatialSplit& split,
+								const BuildBounds& bounds, std::vector<Reference>& left, std::vector<Reference>& right) {
+	// Reserve the duplicates for all straddling references. Unsplit references return their share afterwards.
+	const uint32_t nReferences = static_cast<uint32_t>(references.size());
+	const uint32_t nStraddling = split.nLeft + split.nRight - nReferences;
+	if (context.referenceCount->fetch_add(nStraddling) + nStraddling > context.maxReferences) {
+		context.referenceCount->fetch_sub(nStraddling);
+		return false;
+	}
+
+	const float scale = nBins / (bounds.bmax[split.axis] - bounds.bmin[split.axis]);
+	const float position = bounds.bmin[split.axis] + (split.bin + 1) / scale;
+	const vec3f scales(scale);
+	const float leftArea = split.left.surfaceArea();
+	const float rightArea = split.right.surfaceArea();
+	uint32_t nDuplicates = 0;
+	for (const Reference& reference : references) {
+		const int first = computeBinIndex(reference.bounds.min, split.axis, bounds.bmin, scales);
+		const int last = computeBinIndex(reference.bounds.max, split.axis, bounds.bmin, scales);
+		if (last <= split.bin) {
+			left.push_back(reference);
+			continue;
+		}
+		if (first > split.bin) {
+			right.push_back(reference);
+			continue;
+		}
+
+		// Moving the whole reference to one side may be cheaper than splitting it
+		const float splitCost = leftArea * split.nLeft + rightArea * split.nRight;
+		const float leftCost = combine(split.left, reference.bounds).surfaceArea() * split.nLeft + rightArea * (split.nRight - 1);
+		const float rightCost = leftArea * (split.nLeft - 1) + combine(split.right, reference.bounds).surfaceArea() * split.nRight;
+		if (leftCost < splitCost && leftCost <= rightCost) {
+			left.push_back(reference);
+		} else if (rightCost < splitCost) {
+			right.push_back(reference);
+		} else {
+			Reference leftPart, rightPart;
+			splitReference(*context.model, reference, split.axis, position, leftPart, rightPart);
+			const bool hasLeft = !isEmpty(leftPart.bounds);
+			const bool hasRight = !isEmpty(rightPart.bounds);
+			if (hasLeft) {
+				left.push_back(leftPart);
+			}
+			if (hasRight) {
+				right.push_back(rightPart);
+			}
+			if (hasLeft && hasRight) {
+				++nDuplicates;
+			} else if (!hasLeft && !hasRight) {
+				// Only for degenerate triangles, which are kept as a whole
+				left.push_back(reference);
+			}
+		}
+	}
+
+	context.referenceCount->fetch_sub(nStraddling - nDuplicates);
+	if (left.empty() || right.empty()) {
+		context.referenceCount->fetch_sub(nDuplicates);
+		left.clear();
+		right.clear();
+		return false;
+	}
+	return true;
+}
+
+void BVH::splitReference(const Model& model, const Reference& reference, const int axis, const float position, Reference& left, Reference& right) {
+	const vec3f vertices[3] = {
+		model.GetVertex(model.GetFace(reference.triangle * 3 + 0).p),
+		model.GetVertex(model.GetFace(reference.triangle * 3 + 1).p),
+		model.GetVertex(model.GetFace(reference.triangle * 3 + 2).p)
+	};
+	splitTriangleBounds(vertices, reference.bounds, axis, position, left.bounds, right.bounds);
+	left.triangle = right.triangle = reference.triangle;
+}
+
+bool BVH::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	// The interval of the local ray is shrunk, whenever a closer intersection is found.
+	Ray r(ray);
+	r.tmax = std::min(ray.tmax, intersection.t);
+
+	// Nodes, whose bounding box is hit by the ray, are pushed onto the stack
+	// together with the distance at which the ray enters the bounding box.
+	struct StackEntry {
+		uint32_t nodeIdx;
+		float nearT;
+	};
+	StackEntry stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	float nearT;
+	if (intersectBounds(nodes[0], r, nearT)) {
+		stack[stackSize++] = { 0, nearT };
+	}
+
+	float u, v, t;
+	float best_u, best_v;
+	uint32_t best_i = std::numeric_limits<uint32_t>::max();
+	while (stackSize > 0) {
+		const StackEntry entry = stack[--stackSize];
+		// The bounding box lies behind the closest intersection found so far
+		if (entry.nearT > r.tmax) {
+			continue;
+		}
+
+		const Node& node = nodes[entry.nodeIdx];
+		if (node.IsLeaf()) {
+			const int hitIdx = model->rayIntersectionClosest(r, triIndices.data() + node.offset, node.nTriangles, u, v, t);
+			if (hitIdx >= 0) {
+				r.tmax = t;
+				intersection.t = t;
+				best_u = u;
+				best_v = v;
+				best_i = triIndices[node.offset + hitIdx];
+			}
+			continue;
+		}
+
+		StackEntry hits[2];
+		int nHits = 0;
+		for (uint32_t c = node.offset; c < node.offset + 2; ++c) {
+			if (intersectBounds(nodes[c], r, nearT)) {
+				hits[nHits++] = { c, nearT };
+			}
+		}
+
+		// The closer child is pushed last, such that it is visited first
+		if (nHits == 2 && hits[0].nearT < hits[1].nearT) {
+			std::swap(hits[0], hits[1]);
+		}
+		for (int k = 0; k < nHits; ++k) {
+			stack[stackSize++] = hits[k];
+		}
+	}
+
+	if (best_i != std::numeric_limits<uint32_t>::max()) {
+		model->computeSurfaceInteraction(best_i, best_u, best_v, r, intersection);
+		return true;
+	}
+	return intersection.isValid();
+}
+
+bool BVH::traverseAny(const Model* model, const Ray& ray) const {
+	uint32_t stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	float nearT;
+	if (intersectBounds(nodes[0], ray, nearT)) {
+		stack[stackSize++] = 0;
+	}
+
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		if (node.IsLeaf()) {
+			// Any triangle found, therefore further processing can stop.
+			if (model->rayIntersectionAny(ray, triIndices.data() + node.offset, node.nTriangles)) {
+				return true;
+			}
+			continue;
+		}
+
+		for (uint32_t c = node.offset; c < node.offset + 2; ++c) {
+			if (intersectBounds(nodes[c], ray, nearT)) {
+				stack[stackSize++] = c;
+			}
+		}
+	}
+	return false;
+}
+
+std::size_t BVH::GetNodeCount() const {
+	// The slot after the root is unused
+	return nodes.size() - 1;
+}
+
+std::size_t BVH::GetLeafCount() const {
+	return std::count_if(nodes.begin(), nodes.end(), [](const Node& node) { return node.IsLeaf(); });
+}
+
+LeafSizeHistogram BVH::GetLeafSizeHistogram() const {
+	LeafSizeHistogram histogram;
+	for (const Node& node : nodes) {
+		if (node.IsLeaf()) {
+			++histogram[node.nTriangles];
+		}
+	}
+	return histogram;
+}
+
+float BVH::ComputeExpectedRayCost() const {
+	// The probability that a ray hitting the root also hits a node is the ratio of their surface areas.
+	// It is evaluated in parallel, because refit() checks it for every update.
+	const float rootArea = nodes[0].GetBounds().surfaceArea();
+	const double cost = tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, nodes.size()), 0.0,
+		[&](const tbb::blocked_range<std::size_t>& r, double cost) {
+			for (std::size_t i = r.begin(); i < r.end(); ++i) {
+				if (i == 1) {
+					continue;
+				}
+				const Node& node = nodes[i];
+				cost += node.GetBounds().surfaceArea() * (node.IsLeaf() ? costIntersection * node.nTriangles : costTraversal);
+			}
+			return cost;
+		},
+		[](const double c0, const double c1) {
+			return c0 + c1;
+		});
+	return rootArea > 0.f ? cost / rootArea : 0.f;
+}
+
+}
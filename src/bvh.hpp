@@ -0,0 +1,253 @@
+#pragma once
+#include "aabb.hpp"
+#include "accel_parameters.hpp"
+#include "accel_stats.hpp"
+#include "model.hpp"
+#include "vec3.hpp"
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include <atomic>
+#include <vector>
+
+namespace specter {
+
+// Binary bounding volume hierarchy, which is built top-down with the binned surface area heuristic.
+// Reference: Ingo Wald, On fast Construction of SAH-based Bounding Volume Hierarchies
+struct BVH {
+
+	// Represents a single node of the hierarchy. The two children of an interior node
+	// are stored next to each other, such that a pair of siblings occupies one cache line.
+	struct Node {
+
+		bool IsLeaf() const {
+			return nTriangles != 0;
+		}
+
+		AxisAlignedBoundingBox GetBounds() const {
+			return AxisAlignedBoundingBox(bmin, bmax);
+		}
+
+		vec3f bmin;
+		// For interior nodes, this is the index of the left child. The right child follows it.
+		// For leaf nodes, this is the position of the first triangle index in the index pool.
+		uint32_t offset;
+		vec3f bmax;
+		// Specifies the number of triangles of a leaf node. Interior nodes have no triangles.
+		uint32_t nTriangles;
+	};
+
+	static_assert(sizeof(Node) * 2 == 64, "A pair of sibling nodes has to fit into a single cache line");
+
+	void build(const Model& model, const BVHParameters& parameters = BVHParameters());
+
+	// Builds the hierarchy over arbitrary primitives, which are given by their bounds. The leaves reference
+	// the indices of the primitives. Spatial splits need the triangles of a model, hence they are ignored.
+	void build(const std::vector<AxisAlignedBoundingBox>& primitiveBounds, const BVHParameters& parameters = BVHParameters());
+
+	// Updates the bounds of the nodes bottom-up after the vertices of the model have moved. The topology is kept,
+	// hence the triangles of the model have to be the same as during the construction.
+	void refit(const Model& model);
+
+	// Traverse the hierarchy. Returns true if the ray intersects geometry in the mesh.
+	// Additionally, it is guaranteed that the intersection point is the closest intersection point to the ray origin
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const;
+
+	// Traverse the hierarchy. Returns true if the ray intersects any geometry in the mesh
+	// within the ray interval.
+	bool traverseAny(const Model* model, const Ray& ray) const;
+
+	// Returns the nodes of the hierarchy. The root is stored at index 0, index 1 is unused.
+	const std::vector<Node, tbb::cache_aligned_allocator<Node>>& GetNodes() const {
+		return nodes;
+	}
+
+	// Returns the pool of triangle indices referenced by the leaves
+	const std::vector<uint32_t>& GetTriangleIndices() const {
+		return triIndices;
+	}
+
+	std::size_t GetNodeCount() const;
+	std::size_t GetLeafCount() const;
+	// Returns the number of triangle references of the leaves. Spatial splits reference triangles in several leaves.
+	std::size_t GetReferenceCount() const {
+		return triIndices.size();
+	}
+	// Returns the number of distinct triangles referenced by the leaves
+	std::size_t GetUniqueTriangleCount() const {
+		return countUniqueTriangles(triIndices);
+	}
+	LeafSizeHistogram GetLeafSizeHistogram() const;
+	// Returns the number of bytes occupied by the nodes and the triangle indices
+	std::size_t GetMemoryUsage() const {
+		return nodes.size() * sizeof(Node) + triIndices.size() * sizeof(uint32_t);
+	}
+	// Returns the expected cost of tracing a ray according to the surface area heuristic
+	float ComputeExpectedRayCost() const;
+
+	// Number of bins per axis, in which the triangle centroids are sorted to evaluate the split candidates.
+	static constexpr int nBins = 16;
+
+private:
+
+	// Bounds of a set of triangles and of their centroids. The centroid bounds determine the bins.
+	// The bounds are uninitialized by default, see Empty().
+	struct BuildBounds {
+
+		// Returns bounds, which don't contain anything
+		static BuildBounds Empty() {
+			BuildBounds bounds;
+			bounds.bmin = bounds.cmin = vec3f(std::numeric_limits<float>::max());
+			bounds.bmax = bounds.cmax = vec3f(std::numeric_limits<float>::lowest());
+			return bounds;
+		}
+
+		void extend(const AxisAlignedBoundingBox& bounds, const vec3f& centroid) {
+			bmin = minComponent(bmin, bounds.min);
+			bmax = maxComponent(bmax, bounds.max);
+			cmin = minComponent(cmin, centroid);
+			cmax = maxComponent(cmax, centroid);
+		}
+
+		void extend(const BuildBounds& other) {
+			bmin = minComponent(bmin, other.bmin);
+			bmax = maxComponent(bmax, other.bmax);
+			cmin = minComponent(cmin, other.cmin);
+			cmax = maxComponent(cmax, other.cmax);
+		}
+
+		float surfaceArea() const {
+			return AxisAlignedBoundingBox(bmin, bmax).surfaceArea();
+		}
+
+		vec3f bmin, bmax;
+		vec3f cmin, cmax;
+	};
+
+	// The bounds of a bin are only valid, if it holds any triangle. This saves the initialization
+	// of the bins, which dominates the construction of the many small nodes.
+	struct Bin {
+
+		void add(const AxisAlignedBoundingBox& triangleBounds, const vec3f& centroid) {
+			if (count++ == 0) {
+				bounds.bmin = triangleBounds.min;
+				bounds.bmax = triangleBounds.max;
+				bounds.cmin = bounds.cmax = centroid;
+			} else {
+				bounds.extend(triangleBounds, centroid);
+			}
+		}
+
+		BuildBounds bounds;
+		uint32_t count = 0;
+	};
+
+	// Partition of the triangles of a node at the boundary after the bin, according to their centroids
+	struct ObjectSplit {
+		float cost = std::numeric_limits<float>::max();
+		int axis = -1;	// -1 if there is no valid split
+		int bin = 0;
+	};
+
+	// Reference to a triangle during the construction with spatial splits. The bounds of a reference
+	// to a triangle, which has been split, only cover the part of the triangle on its side of the split planes.
+	struct Reference {
+		AxisAlignedBoundingBox bounds;
+		uint32_t triangle;
+	};
+
+	// Partition of the space of a node at the boundary after the bin. References straddling the plane are split.
+	struct SpatialSplit {
+		float cost = std::numeric_limits<float>::max();
+		int axis = -1;	// -1 if there is no valid split
+		int bin = 0;
+		uint32_t nLeft = 0, nRight = 0;	// Number of references on either side, before unsplitting
+		AxisAlignedBoundingBox left, right;
+	};
+
+	// Bins of all three axes. The triangles are binned along every axis in the same pass.
+	struct Binning {
+
+		void merge(const Binning& other) {
+			for (int axis = 0; axis < 3; ++axis) {
+				for (int k = 0; k < nBins; ++k) {
+					Bin& bin = bins[axis][k];
+					const Bin& otherBin = other.bins[axis][k];
+					if (bin.count == 0) {
+						bin = otherBin;
+					} else if (otherBin.count > 0) {
+						bin.bounds.extend(otherBin.bounds);
+						bin.count += otherBin.count;
+					}
+				}
+			}
+		}
+
+		// Returns the bounds of the bins on either side of the split
+		void GetSplitBounds(const ObjectSplit& split, BuildBounds& left, BuildBounds& right) const {
+			for (int k = 0; k < nBins; ++k) {
+				const Bin& bin = bins[split.axis][k];
+				if (bin.count > 0) {
+					(k <= split.bin ? left : right).extend(bin.bounds);
+				}
+			}
+		}
+
+		Bin bins[3][nBins];
+	};
+
+	// State shared by all nodes during the construction of the hierarchy
+	struct BuildContext {
+		const AxisAlignedBoundingBox* primitiveBounds;	// Bounds of every primitive, usually the triangles of the model
+		const vec3f* centroids;	// Centroids of the bounds of every primitive
+		std::atomic<uint32_t>* nodeCount;
+		uint32_t maxLeafSize;
+
+		// Only used by the construction with spatial splits
+		const Model* model;
+		std::atomic<uint32_t>* referenceCount;	// Number of references including the duplicates created so far
+		std::atomic<uint32_t>* leafReferenceCount;	// Number of references stored in leaves so far
+		uint32_t maxReferences;
+		float rootArea;
+	};
+
+	// Builds the hierarchy over the primitives. "model" is only needed for spatial splits and may be nullptr.
+	void buildHierarchy(const Model* model, const std::vector<AxisAlignedBoundingBox>& primitiveBounds, const BVHParameters& parameters);
+
+	// Returns the split with the lowest cost according to the surface area heuristic.
+	// "scale" maps the centroid bounds of the node to the bins. Axes with a scale of zero are skipped.
+	static ObjectSplit findObjectSplit(const Binning& binning, const vec3f& scale, const float invArea);
+
+	// Build the hierarchy recursively. This is initially called by the public function build()
+	// The node references the triangles in triIndices[begin, end), which are reordered,
+	// such that the triangles of each child are stored contiguously.
+	void buildRec(	const BuildContext& context, const uint32_t nodeIdx, const uint32_t begin, const uint32_t end,
+					const BuildBounds& bounds, const int depth);
+
+	// Build the hierarchy recursively with spatial splits. The references of the node are distributed
+	// to the children and released. The leaves copy the triangles of their references into triIndices.
+	// Reference: Stich et al., Spatial Splits in Bounding Volume Hierarchies
+	void buildSpatialRec(	const BuildContext& context, const uint32_t nodeIdx, std::vector<Reference>& references,
+							const BuildBounds& bounds, const int depth);
+
+	// Returns the spatial split with the lowest cost according to the surface area heuristic
+	static SpatialSplit findSpatialSplit(	const BuildContext& context, const std::vector<Reference>& references,
+											const BuildBounds& bounds, const float invArea);
+
+	// Distributes the references to the sides of the spatial split. References straddling the plane are split,
+	// unless moving them to one side is cheaper. Returns false, if the duplication budget is exhausted.
+	static bool partitionReferences(const BuildContext& context, const std::vector<Reference>& references,
+									const SpatialSplit& split, const BuildBounds& bounds,
+									std::vector<Reference>& left, std::vector<Reference>& right);
+
+	// Splits the reference at the plane, whose normal is the axis. The parts are invalid, if they are empty.
+	static void splitReference(	const Model& model, const Reference& reference, const int axis, const float position,
+								Reference& left, Reference& right);
+
+private:
+
+	std::vector<Node, tbb::cache_aligned_allocator<Node>> nodes;	// Nodes of the hierarchy. The root is stored at index 0.
+	std::vector<uint32_t> triIndices;	// Shared pool of the triangle indices referenced by leaf nodes.
+};
+
+}
@@ -22,5 +22,14 @@ unsigned long djb2_hash(unsigned char* str) {
 	return hash;
 }
 
+uint64_t fnv1a_hash(const void* data, const std::size_t nBytes, uint64_t seed) {
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t hash = seed;
+	for (std::size_t i = 0; i < nBytes; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
 
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 	Any non-vector, non-matrix definitions/operations go in this file.
 */
 #pragma once
+#include <cstddef>
+#include <cstdint>
 
 namespace specter {
 
@@ -20,4 +22,8 @@ float log8(const float x);
 // Source: http://www.cse.yorku.ca/~oz/hash.html
 unsigned long djb2_hash(unsigned char* str);
 
+// 64-bit FNV-1a hash of a block of memory. Previous hash values can be passed as 
+// "seed" to hash multiple blocks. Source: http://www.isthe.com/chongo/tech/comp/fnv/
+uint64_t fnv1a_hash(const void* data, const std::size_t nBytes, uint64_t seed = 14695981039346656037ull);
+
 }
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include "compressed_bvh.hpp"
+#include "simd_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#define nWidth (8)
+
+// Bounds the depth of the hierarchy like the depth of the wide hierarchy, which it is built from.
+#define nMaxTraversalDepth (128)
+// Every visited node replaces itself on the stack by at most eight children.
+#define nTraversalStackSize ((nWidth - 1) * nMaxTraversalDepth + 1)
+
+namespace specter {
+
+// Returns 2^exponent. The exponents are restricted to the range of normalized floats.
+static inline float exp2i(const int exponent) {
+	const uint32_t bits = static_cast<uint32_t>(exponent + 127) << 23;
+	float result;
+	std::memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+// Returns the smallest exponent, such that 255 steps of 2^exponent cover the extent
+static int computeExponent(const float extent) {
+	// extent / 255 = m * 2^exponent with m in [0.5, 1), hence 255 * 2^exponent > extent
+	int exponent;
+	std::frexp(extent / 255.f, &exponent);
+	return std::min(std::max(exponent, -126), 127);
+}
+
+// Stores the box of the k-th child quantized relative to the origin of the node.
+// The dequantized coordinates origin + q * 2^exponent are rounded outwards,
+// which is verified with the same float operations as in dequantize().
+static void quantizeBox(const AxisAlignedBoundingBox& box, CompressedBVH::Node& node, const int k) {
+	for (int axis = 0; axis < 3; ++axis) {
+		const float origin = node.origin[axis];
+		const float scale = exp2i(node.exponents[axis]);
+
+		int qmin = std::max(0, static_cast<int>(std::floor((box.min[axis] - origin) / scale)));
+		while (qmin > 0 && origin + qmin * scale > box.min[axis]) {
+			--qmin;
+		}
+		int qmax = std::min(255, static_cast<int>(std::ceil((box.max[axis] - origin) / scale)));
+		while (qmax < 255 && origin + qmax * scale < box.max[axis]) {
+			++qmax;
+		}
+		node.qmin[axis][k] = static_cast<uint8_t>(qmin);
+		node.qmax[axis][k] = static_cast<uint8_t>(std::max(qmin, qmax));
+	}
+}
+
+// Dequantizes the child boxes of the node with the SIMD kernels. The products of the 8-bit coordinates
+// and the powers of two are exact, hence the boxes only round once, like in quantizeBox().
+static inline void dequantize(const CompressedBVH::Node& node, sAABB& boxes) {
+	const vec3f scale(exp2i(node.exponents[0]), exp2i(node.exponents[1]), exp2i(node.exponents[2]));
+	GetSimdKernels().dequantizeBoxes(node.qmin, node.qmax, node.origin, scale, boxes);
+}
+
+static AxisAlignedBoundingBox extractBox(const sAABB& boxes, const int i) {
+	return AxisAlignedBoundingBox(	vec3f(boxes.minx[i], boxes.miny[i], boxes.minz[i]),
+									vec3f(boxes.maxx[i], boxes.maxy[i], boxes.maxz[i]));
+}
+
+void CompressedBVH::build(const WideBVH& wideBVH) {
+	struct PendingNode {
+		uint32_t nodeIdx;
+		uint32_t wideIdx;
+	};
+
+	const auto& wideNodes = wideBVH.GetNodes();
+	const auto& wideTriIndices = wideBVH.GetTriangleIndices();
+	nodes.clear();
+	triIndices.clear();
+	nodes.reserve(wideNodes.size());
+	triIndices.reserve(wideTriIndices.size());
+	bounds = wideBVH.GetBounds();
+
+	nodes.emplace_back();
+	std::vector<PendingNode> pending;
+	pending.push_back({ 0, 0 });
+	while (!pending.empty()) {
+		const PendingNode current = pending.back();
+		pending.pop_back();
+		const WideBVH::Node& source = wideNodes[current.wideIdx];
+
+		// The children are quantized in the union of their boxes, which is contained in the box of the node.
+		AxisAlignedBoundingBox frame;
+		bool empty = true;
+		for (int k = 0; k < nWidth; ++k) {
+			if (source.children[k].IsValid()) {
+				frame = empty ? extractBox(source.boxes, k) : combine(frame, extractBox(source.boxes, k));
+				empty = false;
+			}
+		}
+
+		Node node = {};
+		node.origin = frame.min;
+		for (int axis = 0; axis < 3; ++axis) {
+			node.exponents[axis] = static_cast<int8_t>(computeExponent(frame.max[axis] - frame.min[axis]));
+		}
+		node.childBase = static_cast<uint32_t>(nodes.size());
+		node.triangleBase = static_cast<uint32_t>(triIndices.size());
+
+		for (int k = 0; k < nWidth; ++k) {
+			const WideBVH::Child& child = source.children[k];
+			if (!child.IsValid()) {
+				continue;
+			}
+
+			quantizeBox(extractBox(source.boxes, k), node, k);
+			if (child.IsInterior()) {
+				node.interiorMask |= 1 << k;
+				pending.push_back({ static_cast<uint32_t>(nodes.size()), child.offset });
+				nodes.emplace_back();
+			} else {
+				if (child.nTriangles > MaxLeafTriangles) {
+					throw std::runtime_error("A leaf has too many triangles for the compressed hierarchy");
+				}
+				node.triangleCounts[k] = static_cast<uint8_t>(child.nTriangles);
+				triIndices.insert(triIndices.end(), wideTriIndices.begin() + child.offset, wideTriIndices.begin() + child.offset + child.nTriangles);
+			}
+		}
+		nodes[current.nodeIdx] = node;
+	}
+
+	nodes.shrink_to_fit();
+}
+
+bool CompressedBVH::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	// The interval of the local ray is shrunk, whenever a closer intersection is found.
+	Ray r(ray);
+	r.tmax = std::min(ray.tmax, intersection.t);
+
+	// Nodes, whose bounding box is hit by the ray, are pushed onto the stack
+	// together with the distance at which the ray enters the bounding box.
+	struct StackEntry {
+		uint32_t nodeIdx;
+		float nearT;
+	};
+	StackEntry stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	float rootNearT, rootFarT;
+	if (bounds.rayIntersectv2(r, rootNearT, rootFarT)) {
+		stack[stackSize++] = { 0, rootNearT };
+	}
+
+	sAABB boxes;
+	alignas(32) float nearT[nWidth];
+	alignas(32) float farT[nWidth];
+	float u, v, t;
+	float best_u = 0.f, best_v = 0.f;
+	uint32_t best_i = std::numeric_limits<uint32_t>::max();
+	while (stackSize > 0) {
+		const StackEntry entry = stack[--stackSize];
+		// The bounding box lies behind the closest intersection found so far
+		if (entry.nearT > r.tmax) {
+			continue;
+		}
+
+		const Node& node = nodes[entry.nodeIdx];
+		dequantize(node, boxes);
+		for (int k = 0; k < nWidth; ++k) {
+			nearT[k] = r.tmin;
+			farT[k] = r.tmax;
+		}
+		boxes.rayIntersect(r, nearT, farT);
+
+		// Leaves are intersected directly. Interior children are sorted by distance afterwards,
+		// such that they are culled by intersections found in the leaves.
+		StackEntry hits[nWidth];
+		int nHits = 0;
+		uint32_t childIdx = node.childBase;
+		uint32_t offset = node.triangleBase;
+		for (int k = 0; k < nWidth; ++k) {
+			const bool hit = nearT[k] <= farT[k];
+			if (node.IsInterior(k)) {
+				if (hit) {
+					hits[nHits++] = { childIdx, nearT[k] };
+				}
+				++childIdx;
+				continue;
+			}
+
+			const int hitIdx = hit ? model->rayIntersectionClosest(r, triIndices.data() + offset, node.triangleCounts[k], u, v, t) : -1;
+			if (hitIdx >= 0) {
+				r.tmax = t;
+				intersection.t = t;
+				best_u = u;
+				best_v = v;
+				best_i = triIndices[offset + hitIdx];
+			}
+			offset += node.triangleCounts[k];
+		}
+
+		// Sort the hits by decreasing distance, such that the closest child is visited first.
+		for (int i = 1; i < nHits; ++i) {
+			const StackEntry hit = hits[i];
+			int j = i - 1;
+			for (; j >= 0 && hits[j].nearT < hit.nearT; --j) {
+				hits[j + 1] = hits[j];
+			}
+			hits[j + 1] = hit;
+		}
+		for (int k = 0; k < nHits; ++k) {
+			if (hits[k].nearT <= r.tmax) {
+				stack[stackSize++] = hits[k];
+			}
+		}
+	}
+
+	if (best_i != std::numeric_limits<uint32_t>::max()) {
+		model->computeSurfaceInteraction(best_i, best_u, best_v, r, intersection);
+		return true;
+	}
+	return intersection.isValid();
+}
+
+bool CompressedBVH::traverseAny(const Model* model, const Ray& ray) const {
+	uint32_t stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	float rootNearT, rootFarT;
+	if (bounds.rayIntersectv2(ray, rootNearT, rootFarT)) {
+		stack[stackSize++] = 0;
+	}
+
+	sAABB boxes;
+	alignas(32) float nearT[nWidth];
+	alignas(32) float farT[nWidth];
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		dequantize(node, boxes);
+		for (int k = 0; k < nWidth; ++k) {
+			nearT[k] = ray.tmin;
+			farT[k] = ray.tmax;
+		}
+		boxes.rayIntersect(ray, nearT, farT);
+
+		uint32_t childIdx = node.childBase;
+		uint32_t offset = node.triangleBase;
+		for (int k = 0; k < nWidth; ++k) {
+			const bool hit = nearT[k] <= farT[k];
+			if (node.IsInterior(k)) {
+				if (hit) {
+					stack[stackSize++] = childIdx;
+				}
+				++childIdx;
+				continue;
+			}
+
+			// Any triangle found, therefore further processing can stop.
+			if (hit && model->rayIntersectionAny(ray, triIndices.data() + offset, node.triangleCounts[k])) {
+				return true;
+			}
+			offset += node.triangleCounts[k];
+		}
+	}
+	return false;
+}
+
+std::size_t CompressedBVH::GetLeafCount() const {
+	std::size_t nLeaves = 0;
+	for (const Node& node : nodes) {
+		nLeaves += std::count_if(node.triangleCounts, node.triangleCounts + nWidth, [](const uint8_t count) { return count > 0; });
+	}
+	return nLeaves;
+}
+
+LeafSizeHistogram CompressedBVH::GetLeafSizeHistogram() const {
+	LeafSizeHistogram histogram;
+	for (const Node& node : nodes) {
+		for (int k = 0; k < nWidth; ++k) {
+			if (node.triangleCounts[k] > 0) {
+				++histogram[node.triangleCounts[k]];
+			}
+		}
+	}
+	return histogram;
+}
+
+float CompressedBVH::ComputeExpectedRayCost() const {
+	// The probability that a ray hitting the root also hits a node is the ratio of their surface areas.
+	const float rootArea = bounds.surfaceArea();
+	double cost = rootArea * costTraversal;
+	sAABB boxes;
+	for (const Node& node : nodes) {
+		dequantize(node, boxes);
+		for (int k = 0; k < nWidth; ++k) {
+			if (node.IsInterior(k)) {
+				cost += extractBox(boxes, k).surfaceArea() * costTraversal;
+			} else if (node.triangleCounts[k] > 0) {
+				cost += extractBox(boxes, k).surfaceArea() * costIntersection * node.triangleCounts[k];
+			}
+		}
+	}
+	return rootArea > 0.f ? cost / rootArea : 0.f;
+}
+
+}
@@ -0,0 +1,87 @@
+#pragma once
+#include "aabb.hpp"
+#include "model.hpp"
+#include "wide_bvh.hpp"
+
+#include <vector>
+
+namespace specter {
+
+// Wide bounding volume hierarchy, whose child boxes are quantized to 8 bits relative to the box of their parent.
+// A node occupies 80 bytes instead of the 256 bytes of a WideBVH node. The boxes are rounded outwards,
+// such that a dequantized box contains the exact box. Rays are tested against the dequantized boxes,
+// which are computed during the traversal.
+// Reference: Ylitie et al., Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs
+struct CompressedBVH {
+
+	struct Node {
+
+		bool IsInterior(const int k) const {
+			return (interiorMask & (1 << k)) != 0;
+		}
+
+		vec3f origin;	// Minimum of the box of the node, relative to which the child boxes are quantized
+		int8_t exponents[3];	// Along each axis, the quantized coordinates are multiples of 2^exponent
+		uint8_t interiorMask;	// Bit k is set, if the k-th child is an interior node
+		// Index of the first interior child. The interior children of a node are stored contiguously,
+		// ordered as their slots.
+		uint32_t childBase;
+		// Position of the triangle indices of the first leaf child in the index pool.
+		// The triangles of the leaf children follow each other, ordered as their slots.
+		uint32_t triangleBase;
+		uint8_t triangleCounts[8];	// Number of triangles of each leaf child. Zero for interior children and unused slots.
+		uint8_t qmin[3][8];	// Quantized minimum of each child box along each axis
+		uint8_t qmax[3][8];	// Quantized maximum of each child box along each axis
+	};
+
+	static_assert(sizeof(Node) == 80, "A node has to occupy exactly 80 bytes");
+
+	// Leaves with more triangles than this can't be represented.
+	static constexpr uint32_t MaxLeafTriangles = std::numeric_limits<uint8_t>::max();
+
+	// Quantizes the wide hierarchy. Throws std::runtime_error if a leaf has more than MaxLeafTriangles triangles.
+	void build(const WideBVH& wideBVH);
+
+	// Traverse the hierarchy. Returns true if the ray intersects geometry in the mesh.
+	// Additionally, it is guaranteed that the intersection point is the closest intersection point to the ray origin
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const;
+
+	// Traverse the hierarchy. Returns true if the ray intersects any geometry in the mesh
+	// within the ray interval.
+	bool traverseAny(const Model* model, const Ray& ray) const;
+
+	std::size_t GetNodeCount() const {
+		return nodes.size();
+	}
+
+	std::size_t GetLeafCount() const;
+
+	// Returns the number of triangle references of the leaves
+	std::size_t GetReferenceCount() const {
+		return triIndices.size();
+	}
+
+	// Returns the number of distinct triangles referenced by the leaves
+	std::size_t GetUniqueTriangleCount() const {
+		return countUniqueTriangles(triIndices);
+	}
+
+	LeafSizeHistogram GetLeafSizeHistogram() const;
+
+	// Returns the number of bytes occupied by the nodes and the triangle indices
+	std::size_t GetMemoryUsage() const {
+		return nodes.size() * sizeof(Node) + triIndices.size() * sizeof(uint32_t);
+	}
+
+	// Returns the expected cost of tracing a ray according to the surface area heuristic.
+	// The dequantized boxes are slightly larger than the boxes of the wide hierarchy.
+	float ComputeExpectedRayCost() const;
+
+private:
+
+	std::vector<Node> nodes;	// Nodes of the hierarchy. The root is stored at index 0.
+	std::vector<uint32_t> triIndices;	// Shared pool of the triangle indices referenced by leaf children.
+	AxisAlignedBoundingBox bounds;	// Bounding box of the root node, which isn't quantized.
+};
+
+}
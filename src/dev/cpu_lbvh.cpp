@@ -1,5 +1,18 @@
 #include "cpu_lbvh.hpp"
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+#include <atomic>
+#include <vector>
+
+// Hierarchies deeper than this can't be traversed, see checkTraversalDepth(). The construction is bounded by the
+// number of bits of the morton codes plus the number of bits of the primitive indices, but treelet restructuring isn't.
+#define nMaxTraversalDepth (128)
+// Every visited node replaces itself on the stack by at most two children.
+#define nTraversalStackSize (nMaxTraversalDepth + 1)
+
 namespace specter {
 
 static void assignObjectID(const int idx, InternalNode* internalNodes, LeafNode* leafNodes, PrimitiveIdentifier* sortedObjects) {
@@ -14,12 +27,14 @@ static void assignObjectID(const int idx, InternalNode* internalNodes, LeafNode*
 
 static int clz(int i, int j, std::size_t nTriangles, PrimitiveIdentifier* pIds) {
 	if (j < 0 || j > nTriangles - 1) return -1;
-	const unsigned k0 = pIds[i].mortonCode;
-	const unsigned k1 = pIds[j].mortonCode;
+	const uint64_t k0 = pIds[i].mortonCode;
+	const uint64_t k1 = pIds[j].mortonCode;
 	if (k0 == k1) {
-		return 31;	// Avoid log2(0)
+		// Duplicate morton codes are distinguished by their position, as if the 
+		// index was appended to the code. Note, i != j and therefore i ^ j != 0.
+		return 64 + countLeadingZeros(static_cast<uint32_t>(i ^ j));
 	}
-	return 31 - int(log2(float(k0 ^ k1)));
+	return countLeadingZeros(k0 ^ k1);
 }
 
 static int sign(float v) {
@@ -27,55 +42,107 @@ static int sign(float v) {
 }
 
 CPU_LBVH::~CPU_LBVH() {
-	if (output_aabbs != nullptr) {
-		delete[] output_aabbs;
-	}
-	if (internalNodes != nullptr) {
-		delete[] internalNodes;
-	}
-	if (leafNodes != nullptr) {
-		delete[] leafNodes;
-	}
+	release();
+}
+
+void CPU_LBVH::release() {
+	delete[] output_aabbs;
+	delete[] internalNodes;
+	delete[] leafNodes;
+	output_aabbs = nullptr;
+	internalNodes = nullptr;
+	leafNodes = nullptr;
 }
 
 void CPU_LBVH::prepass(Model& model) {
+	release();
 	nTriangles = model.GetFaceCount() / 3;
+	if (nTriangles < 2) {
+		throw std::runtime_error("The LBVH requires at least two triangles!");
+	}
+
 	PrimitiveIdentifier* pIds = new PrimitiveIdentifier[nTriangles];
-	int* atomic_counters = new int[nTriangles - 1]();
 	internalNodes = new InternalNode[nTriangles - 1];
 	leafNodes = new LeafNode[nTriangles];
 	aabbs = new AxisAlignedBoundingBox[nTriangles];	
 	output_aabbs = new AxisAlignedBoundingBox[nTriangles - 1];
 
-	const AxisAlignedBoundingBox scene_box = model.computeBoundingBox();
-
-	for (int i = 0; i < nTriangles; ++i) {
-		aabbs[i] = constructAABBFromPaddedTriangle(
-			model.GetVertex(model.GetFace(i).p),
-			model.GetVertex(model.GetFace(i * 3 + 1).p),
-			model.GetVertex(model.GetFace(i * 3 + 2).p));
-	}
+	// Every stage, except for the sort, processes the primitives or nodes independently. 
+	// The centroids of the bounding boxes of the triangles are reduced to their bounding box,
+	// which is the domain of the morton codes.
+	const int n = nTriangles;
+	const AxisAlignedBoundingBox centroid_box = tbb::parallel_reduce(tbb::blocked_range<int>(0, n), 
+		AxisAlignedBoundingBox(vec3f(std::numeric_limits<float>::max()), vec3f(std::numeric_limits<float>::lowest())),
+		[&](const tbb::blocked_range<int>& r, AxisAlignedBoundingBox box) {
+			for (int i = r.begin(); i < r.end(); ++i) {
+				aabbs[i] = constructAABBFromPaddedTriangle(
+					model.GetVertex(model.GetFace(i * 3).p),
+					model.GetVertex(model.GetFace(i * 3 + 1).p),
+					model.GetVertex(model.GetFace(i * 3 + 2).p));
+				const vec3f centroid = aabbs[i].center();
+				box = combine(box, AxisAlignedBoundingBox(centroid, centroid));
+			}
+			return box;
+		},
+		[](const AxisAlignedBoundingBox& b0, const AxisAlignedBoundingBox& b1) {
+			return combine(b0, b1);
+		});
 
-	for (int i = 0; i < nTriangles; ++i) {
-		computeMortonCode(pIds, aabbs, i, scene_box.min, scene_box.max);
-	}
+	tbb::parallel_for(tbb::blocked_range<int>(0, n), [&](const tbb::blocked_range<int>& r) {
+		for (int i = r.begin(); i < r.end(); ++i) {
+			computeMortonCode(pIds, aabbs, i, centroid_box.min, centroid_box.max);
+		}
+	});
 
 	// Sort primitives according to their morton codes
 	radixsort(pIds, nTriangles);
 
-	assignObjectID(nTriangles - 1, internalNodes, leafNodes, pIds);
-	for (int i = 0; i < nTriangles - 1; ++i) {
-		assignObjectID(i, internalNodes, leafNodes, pIds);
-	}
+	tbb::parallel_for(tbb::blocked_range<int>(0, n - 1), [&](const tbb::blocked_range<int>& r) {
+		for (int i = r.begin(); i < r.end(); ++i) {
+			assignObjectID(i, internalNodes, leafNodes, pIds);
+		}
+	});
+	// There is one more leaf node than internal nodes
+	leafNodes[n - 1].parentIdx = -1;
+	leafNodes[n - 1].leafIdx = pIds[n - 1].objectId;
 
-	for (int i = 0; i < nTriangles - 1; ++i) {
-		generateHierarchy(i, nTriangles, pIds);
-	}
+	// Every node writes its own children and the parent index of its children. 
+	// Since every node has exactly one parent, there are no conflicting writes.
+	tbb::parallel_for(tbb::blocked_range<int>(0, n - 1), [&](const tbb::blocked_range<int>& r) {
+		for (int i = r.begin(); i < r.end(); ++i) {
+			generateHierarchy(i, n, pIds);
+		}
+	});
 
 	generateBV(nTriangles);
 
 	delete[] pIds;
 	delete[] aabbs;
+	aabbs = nullptr;
+
+	checkTraversalDepth();
+}
+
+void CPU_LBVH::refit(const Model& model) {
+	if (model.GetFaceCount() / 3 != nTriangles) {
+		throw std::runtime_error("The LBVH can only be refitted to the triangles it has been constructed for!");
+	}
+
+	const int n = nTriangles;
+	aabbs = new AxisAlignedBoundingBox[nTriangles];
+	tbb::parallel_for(tbb::blocked_range<int>(0, n), [&](const tbb::blocked_range<int>& r) {
+		for (int i = r.begin(); i < r.end(); ++i) {
+			aabbs[i] = constructAABBFromPaddedTriangle(
+				model.GetVertex(model.GetFace(i * 3).p),
+				model.GetVertex(model.GetFace(i * 3 + 1).p),
+				model.GetVertex(model.GetFace(i * 3 + 2).p));
+		}
+	});
+
+	generateBV(nTriangles);
+
+	delete[] aabbs;
+	aabbs = nullptr;
 }
 
 void CPU_LBVH::generateHierarchy(const int i, const int nPrimitives, PrimitiveIdentifier* pIds) {
@@ -130,32 +197,37 @@ void CPU_LBVH::generateHierarchy(const int i, const int nPrimitives, PrimitiveId
 }
 
 void CPU_LBVH::generateBV(const int nTriangles) {
-	// Bottom up reduction to create bounding volumes.
-	const int nAtomicCounters = nTriangles;
+	// Bottom up reduction to create bounding volumes. Every leaf walks up towards the root.
+	// The first thread arriving at a node terminates, whereas the second one computes the
+	// bounding volume of the node, because the bounding volumes of both children are complete.
+	const int nAtomicCounters = nTriangles - 1;
 	const int nLeafNodes = nTriangles;
-	bool* atomic_counters = new bool[nAtomicCounters](false);
-
-	int* tmp_parentIdx = new int[nLeafNodes];
-	for (int i = 0; i < nLeafNodes; ++i) {
-		tmp_parentIdx[i] = leafNodes[i].parentIdx;
+	std::atomic<int>* atomic_counters = new std::atomic<int>[nAtomicCounters];
+	for (int i = 0; i < nAtomicCounters; ++i) {
+		atomic_counters[i].store(0, std::memory_order_relaxed);
 	}
 
-	for (int i = 0; i < nLeafNodes; ++i) {
-		AxisAlignedBoundingBox aabb = aabbs[leafNodes[i].leafIdx];
-		int parentIdx = tmp_parentIdx[i];
-		while (parentIdx != -1) {
-			if (atomic_counters[parentIdx] == false) {
-				atomic_counters[parentIdx] = true;
-				output_aabbs[parentIdx] = aabb;
-				break;
+	auto childBV = [this](const InternalNode& node, const int child) -> const AxisAlignedBoundingBox& {
+		const int idx = child == 0 ? node.leftIdx : node.rightIdx;
+		return (node.childLeaf & (1 << child)) ? aabbs[idx] : output_aabbs[idx];
+	};
+
+	tbb::parallel_for(tbb::blocked_range<int>(0, nLeafNodes), [&](const tbb::blocked_range<int>& r) {
+		for (int i = r.begin(); i < r.end(); ++i) {
+			int parentIdx = leafNodes[i].parentIdx;
+			while (parentIdx != -1) {
+				// The acquire-release ordering makes the bounding volume written by the 
+				// first thread visible to the second one.
+				if (atomic_counters[parentIdx].fetch_add(1, std::memory_order_acq_rel) == 0) {
+					break;
+				}
+				const InternalNode& node = internalNodes[parentIdx];
+				output_aabbs[parentIdx] = combine(childBV(node, 0), childBV(node, 1));
+				parentIdx = node.parentIdx;
 			}
-			output_aabbs[parentIdx] = combine(output_aabbs[parentIdx], aabb);
-			aabb = output_aabbs[parentIdx];
-			parentIdx = internalNodes[parentIdx].parentIdx;
 		}
-	}
+	});
 
-	delete[] tmp_parentIdx;
 	delete[] atomic_counters;
 }
 
@@ -167,6 +239,128 @@ void CPU_LBVH::generateBVBottomUpRecursively(const int nodeIdx, const int parent
 	}
 }
 
+bool CPU_LBVH::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	// The interval of the local ray is shrunk, whenever a closer intersection is found.
+	Ray r(ray);
+	r.tmax = std::min(ray.tmax, intersection.t);
+
+	// Internal nodes, whose bounding volume is hit by the ray, are pushed onto the stack
+	// together with the distance at which the ray enters the bounding volume.
+	struct StackEntry {
+		int nodeIdx;
+		float nearT;
+	};
+	StackEntry stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	float nearT, farT;
+	if (output_aabbs[0].rayIntersect(r, nearT, farT)) {
+		stack[stackSize++] = { 0, nearT };
+	}
+
+	float u, v, t;
+	float best_u = 0.f, best_v = 0.f;
+	int best_i = -1;
+	while (stackSize > 0) {
+		const StackEntry entry = stack[--stackSize];
+		// The bounding volume lies behind the closest intersection found so far
+		if (entry.nearT > r.tmax) {
+			continue;
+		}
+
+		const InternalNode& node = internalNodes[entry.nodeIdx];
+		const int children[2] = { node.leftIdx, node.rightIdx };
+		StackEntry hits[2];
+		int nHits = 0;
+
+		// Leaves hold a single triangle, which is intersected directly. 
+		// The bounding volumes of internal children are tested afterwards, 
+		// such that they are culled by intersections found in the leaves.
+		for (int c = 0; c < 2; ++c) {
+			if ((node.childLeaf & (1 << c)) && model->rayIntersection(r, children[c], u, v, t)) {
+				r.tmax = t;
+				intersection.t = t;
+				best_u = u;
+				best_v = v;
+				best_i = children[c];
+			}
+		}
+
+		for (int c = 0; c < 2; ++c) {
+			if (!(node.childLeaf & (1 << c)) && output_aabbs[children[c]].rayIntersect(r, nearT, farT)) {
+				hits[nHits++] = { children[c], nearT };
+			}
+		}
+
+		// The closer child is pushed last, such that it is visited first
+		if (nHits == 2 && hits[0].nearT < hits[1].nearT) {
+			std::swap(hits[0], hits[1]);
+		}
+		for (int k = 0; k < nHits; ++k) {
+			stack[stackSize++] = hits[k];
+		}
+	}
+
+	if (best_i != -1) {
+		model->computeSurfaceInteraction(best_i, best_u, best_v, r, intersection);
+		return true;
+	}
+	return intersection.isValid();
+}
+
+bool CPU_LBVH::traverseAny(const Model* model, const Ray& ray) const {
+	int stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	float nearT, farT;
+	if (output_aabbs[0].rayIntersect(ray, nearT, farT)) {
+		stack[stackSize++] = 0;
+	}
+
+	float u, v, t;
+	while (stackSize > 0) {
+		const InternalNode& node = internalNodes[stack[--stackSize]];
+		const int children[2] = { node.leftIdx, node.rightIdx };
+		for (int c = 0; c < 2; ++c) {
+			if (node.childLeaf & (1 << c)) {
+				// Any triangle found, therefore further processing can stop.
+				if (model->rayIntersection(ray, children[c], u, v, t)) {
+					return true;
+				}
+			} else if (output_aabbs[children[c]].rayIntersect(ray, nearT, farT)) {
+				stack[stackSize++] = children[c];
+			}
+		}
+	}
+	return false;
+}
+
+void CPU_LBVH::checkTraversalDepth() const {
+	struct PendingNode {
+		int nodeIdx;
+		unsigned depth;
+	};
+
+	// Only internal nodes are pushed onto the traversal stacks, hence leaves don't count.
+	std::vector<PendingNode> pending;
+	pending.push_back({ 0, 1 });
+	while (!pending.empty()) {
+		const PendingNode current = pending.back();
+		pending.pop_back();
+		if (current.depth > nMaxTraversalDepth) {
+			throw std::runtime_error("The LBVH is too deep to be traversed");
+		}
+
+		const InternalNode& node = internalNodes[current.nodeIdx];
+		if (!(node.childLeaf & 1)) {
+			pending.push_back({ node.leftIdx, current.depth + 1 });
+		}
+		if (!(node.childLeaf & 2)) {
+			pending.push_back({ node.rightIdx, current.depth + 1 });
+		}
+	}
+}
+
 int CPU_LBVH::GetRootIndex() {
 	int nodeIdx = leafNodes[0].parentIdx;
 	while (internalNodes[nodeIdx].parentIdx != -1) {
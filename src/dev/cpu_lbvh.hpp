@@ -36,14 +36,51 @@ struct CPU_LBVH {
 	
 	void prepass(Model& model);
 
+	// Updates the bounding volumes after the vertices of the model have moved, see generateBV().
+	// The topology is kept, hence the triangles of the model have to be the same as during the construction.
+	void refit(const Model& model);
+
+	// Optimizes the topology of the hierarchy by treelet restructuring, which runs "nRounds" bottom-up
+	// passes. Every pass replaces small treelets by their topology of minimal SAH cost.
+	// Reference: Tero Karras and Timo Aila, Fast Parallel Construction of High-Quality Bounding Volume Hierarchies
+	void optimizeTreelets(const Model& model, const int nRounds);
+
+	// Returns the expected cost of tracing a ray according to the surface area heuristic.
+	// The bounds of the leaves are computed from the triangles of the model.
+	float ComputeExpectedRayCost(const Model& model) const;
+
+	// Traverse the hierarchy. Returns true if the ray intersects geometry in the mesh.
+	// Additionally, it is guaranteed that the intersection point is the closest intersection point to the ray origin
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const;
+
+	// Traverse the hierarchy. Returns true if the ray intersects any geometry in the mesh
+	// within the ray interval.
+	bool traverseAny(const Model* model, const Ray& ray) const;
+
 	AxisAlignedBoundingBox* GetBoundingVolumes() {
 		return output_aabbs;
 	}
 
+	// Returns the bounding volumes of the internal nodes
+	const AxisAlignedBoundingBox* GetBoundingVolumes() const {
+		return output_aabbs;
+	}
+
+	// Returns the internal nodes. The root is stored at index 0. Leaf children are
+	// marked in childLeaf, their index is the index of the triangle.
+	const InternalNode* GetInternalNodes() const {
+		return internalNodes;
+	}
+
 	std::size_t GetNumberOfInternalNodes() const {
 		return nTriangles - 1;
 	}
 
+	// Returns the number of bytes occupied by the internal nodes, their bounding volumes and the leaf nodes
+	std::size_t GetMemoryUsage() const {
+		return (nTriangles - 1) * (sizeof(InternalNode) + sizeof(AxisAlignedBoundingBox)) + nTriangles * sizeof(LeafNode);
+	}
+
 	int GetRootIndex();
 
 	bool isValid();
@@ -52,18 +89,29 @@ struct CPU_LBVH {
 
 protected:
 
+	void release();
+
 	void generateHierarchy(const int i, const int nPrimitives, PrimitiveIdentifier* pids);
 
+	// Computes the bounding volumes of the internal nodes in parallel, using atomic counters
+	// as outlined by Tero Karras.
 	void generateBV(const int nTriangles);
-	
-	// On the GPU, this action is relatively easy to implement using atomic counters as outlined
-	// by Tero Karras. However, on the CPU you can also consider performing a DFS for O(1) 
-	// memory complexity. In the CPU implementation, I will not be using atomic counters. Instead,
-	// I will treat the layers of a tree as if they were in contigious memory,
+
+	// On the CPU, you can also consider performing a DFS for O(1) memory complexity. 
 	void generateBVBottomUpRecursively(const int nodeIdx, const int parentIdx);
 
 	void isValid_Rec(int parentIdx, int nodeIdx, bool& result);
 
+	// Throws, if the hierarchy is deeper than the traversal stacks allow
+	void checkTraversalDepth() const;
+
+	// Arrays shared by the treelet restructuring of all nodes, see cpu_lbvh_treelet.cpp
+	struct TreeletContext;
+
+	// Replaces the treelet rooted at the node by its optimal topology, if that reduces the SAH cost.
+	// The subtrees below the leaves of the treelet have to be final.
+	void restructureTreelet(const int nodeIdx, const TreeletContext& context);
+
 protected:
 
 	std::size_t nTriangles;
@@ -1,13 +1,40 @@
 #pragma once 
+#include <cstdint>
 #include <utility>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include "../aabb.hpp"
 #include "../vec4.hpp"
 
 namespace specter {
 
+// Returns the number of leading zero bits of x, which must not be zero.
+// This compiles to a single bit scan instruction.
+inline int countLeadingZeros(const uint32_t x) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, x);
+	return 31 - static_cast<int>(index);
+#else
+	return __builtin_clz(x);
+#endif
+}
+
+// Returns the number of leading zero bits of x, which must not be zero.
+inline int countLeadingZeros(const uint64_t x) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse64(&index, x);
+	return 63 - static_cast<int>(index);
+#else
+	return __builtin_clzll(x);
+#endif
+}
+
 struct PrimitiveIdentifier {
 	int objectId;
-	unsigned mortonCode;
+	uint64_t mortonCode;	// 63-bit morton code, 21 bits per axis
 	friend void swap(PrimitiveIdentifier& p0, PrimitiveIdentifier& p1) {
 		using std::swap;
 		swap(p0.objectId, p1.objectId);
@@ -17,10 +44,15 @@ struct PrimitiveIdentifier {
 
 AxisAlignedBoundingBox constructAABBFromPaddedTriangle(const vec3f& v0, const vec3f& v1, const vec3f& v2);
 
-unsigned expandBits(unsigned u);
+// Inserts two zero bits in front of each of the lower 21 bits of v
+uint64_t expandBits(uint64_t v);
 
+// Computes the morton code of the centroid of the idx-th bounding box. The centroid is quantized 
+// relative to the bounds [nStart, nEnd], which should be the bounds of all centroids.
 void computeMortonCode(PrimitiveIdentifier* pIds, AxisAlignedBoundingBox* aabbs, unsigned int idx, const vec3f& nStart, const vec3f& nEnd);
 
-void radixsort(PrimitiveIdentifier* ids, std::size_t n, uint32_t mask = 0x8000'0000);
+// Sorts the identifiers by their morton codes. Implements a parallel least significant
+// digit radix sort, which is stable, i.e. identifiers with equal codes keep their order.
+void radixsort(PrimitiveIdentifier* ids, std::size_t n);
 
 }
\ No newline at end of file
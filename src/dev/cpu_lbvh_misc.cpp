@@ -1,5 +1,17 @@
 #include "cpu_lbvh_helpers.hpp"
 
+#include <tbb/parallel_for.h>
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+// Number of bits sorted per pass of the radix sort. Six passes sort the 63-bit morton codes.
+#define nRadixDigitBits (11)
+#define nRadixBuckets (1 << nRadixDigitBits)
+// Number of elements counted and scattered by a single task of the radix sort.
+#define nRadixChunkSize (1 << 16)
+
 namespace specter {
 
 AxisAlignedBoundingBox constructAABBFromPaddedTriangle(const vec3f& v0, const vec3f& v1, const vec3f& v2) {
@@ -14,45 +26,93 @@ AxisAlignedBoundingBox constructAABBFromPaddedTriangle(const vec3f& v0, const ve
 	return AxisAlignedBoundingBox(tmin, tmax);
 }
 
-void radixsort(PrimitiveIdentifier* ids, std::size_t n, uint32_t mask) {
+void radixsort(PrimitiveIdentifier* ids, std::size_t n) {
 	if (n <= 1) return;
 
-	uint32_t nElements = n;
-	int i = 0;
-	while (i < n) {
-		if (ids[i].mortonCode & mask) {
-			std::swap(ids[i], ids[n - 1]);
-			--n;
-		} else {
-			++i;
+	// The array is split into chunks, which are counted and scattered in parallel. 
+	// Every chunk has its own histogram, which determines where the chunk writes
+	// each digit to. Chunks and elements within a chunk are processed in order, 
+	// which keeps the sort stable.
+	using Histogram = std::array<uint32_t, nRadixBuckets>;
+	const std::size_t nChunks = (n + nRadixChunkSize - 1) / nRadixChunkSize;
+	std::vector<Histogram> histograms(nChunks);
+	std::vector<PrimitiveIdentifier> buffer(n);
+	PrimitiveIdentifier* src = ids;
+	PrimitiveIdentifier* dst = buffer.data();
+
+	for (int shift = 0; shift < 63; shift += nRadixDigitBits) {
+		auto digit = [shift](const PrimitiveIdentifier& id) {
+			return static_cast<uint32_t>(id.mortonCode >> shift) & (nRadixBuckets - 1);
+		};
+
+		tbb::parallel_for(std::size_t(0), nChunks, [&](const std::size_t c) {
+			Histogram& histogram = histograms[c];
+			histogram.fill(0);
+			const std::size_t end = std::min(n, (c + 1) * nRadixChunkSize);
+			for (std::size_t i = c * nRadixChunkSize; i < end; ++i) {
+				histogram[digit(src[i])]++;
+			}
+		});
+
+		// Turn the counts into the positions of the chunks within the output. 
+		// Passes, in which all codes have the same digit, are skipped.
+		uint32_t offset = 0;
+		bool uniformDigit = false;
+		for (uint32_t b = 0; b < nRadixBuckets; ++b) {
+			const uint32_t bucketStart = offset;
+			for (std::size_t c = 0; c < nChunks; ++c) {
+				const uint32_t count = histograms[c][b];
+				histograms[c][b] = offset;
+				offset += count;
+			}
+			uniformDigit |= offset - bucketStart == n;
+		}
+		if (uniformDigit) {
+			continue;
 		}
+
+		tbb::parallel_for(std::size_t(0), nChunks, [&](const std::size_t c) {
+			Histogram& positions = histograms[c];
+			const std::size_t end = std::min(n, (c + 1) * nRadixChunkSize);
+			for (std::size_t i = c * nRadixChunkSize; i < end; ++i) {
+				dst[positions[digit(src[i])]++] = src[i];
+			}
+		});
+
+		std::swap(src, dst);
 	}
 
-	if (mask != 1) {
-		radixsort(ids, i, mask >> 1);
-		radixsort(&ids[i], nElements - n, mask >> 1);
+	if (src != ids) {
+		std::copy(src, src + n, ids);
 	}
 }
 
-unsigned expandBits(unsigned v) {
-	v = (v * 0x00010001u) & 0xFF0000FFu;
-	v = (v * 0x00000101u) & 0x0F00F00Fu;
-	v = (v * 0x00000011u) & 0xC30C30C3u;
-	v = (v * 0x00000005u) & 0x49249249u;
+uint64_t expandBits(uint64_t v) {
+	v &= 0x1FFFFFull;
+	v = (v | (v << 32)) & 0x001F00000000FFFFull;
+	v = (v | (v << 16)) & 0x001F0000FF0000FFull;
+	v = (v | (v << 8)) & 0x100F00F00F00F00Full;
+	v = (v | (v << 4)) & 0x10C30C30C30C30C3ull;
+	v = (v | (v << 2)) & 0x1249249249249249ull;
 	return v;
 }
 
 void computeMortonCode(PrimitiveIdentifier* pIds, AxisAlignedBoundingBox* aabbs, unsigned int idx, const vec3f& nStart, const vec3f& nEnd) {
-	vec3f mappedInput = aabbs[idx].center();
-	mappedInput = (1.f / (nEnd - nStart)) * (mappedInput - nStart);
+	// Each axis is quantized to 21 bits. Degenerate extents of the bounds map to zero.
+	const vec3f extent = nEnd - nStart;
+	vec3f mappedInput = aabbs[idx].center() - nStart;
+	mappedInput.x = extent.x > 0.f ? mappedInput.x / extent.x : 0.f;
+	mappedInput.y = extent.y > 0.f ? mappedInput.y / extent.y : 0.f;
+	mappedInput.z = extent.z > 0.f ? mappedInput.z / extent.z : 0.f;
 
-	mappedInput.x = std::min(std::max(mappedInput.x * 1024.f, 0.f), 1023.f);
-	mappedInput.y = std::min(std::max(mappedInput.y * 1024.f, 0.f), 1023.f);
-	mappedInput.z = std::min(std::max(mappedInput.z * 1024.f, 0.f), 1023.f);
+	constexpr float resolution = 1 << 21;
+	mappedInput.x = std::min(std::max(mappedInput.x * resolution, 0.f), resolution - 1.f);
+	mappedInput.y = std::min(std::max(mappedInput.y * resolution, 0.f), resolution - 1.f);
+	mappedInput.z = std::min(std::max(mappedInput.z * resolution, 0.f), resolution - 1.f);
 	
-	unsigned x = expandBits((unsigned)mappedInput.x);
-	unsigned y = expandBits((unsigned)mappedInput.y);
-	unsigned z = expandBits((unsigned)mappedInput.z);
+	const uint64_t x = expandBits(static_cast<uint64_t>(mappedInput.x));
+	const uint64_t y = expandBits(static_cast<uint64_t>(mappedInput.y));
+	const uint64_t z = expandBits(static_cast<uint64_t>(mappedInput.z));
 
 	pIds[idx].objectId = idx;
 	pIds[idx].mortonCode = x * 4 + y * 2 + z;
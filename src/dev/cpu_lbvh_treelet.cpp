@@ -0,0 +1,251 @@
+#include "cpu_lbvh.hpp"
+#include "../accel_stats.hpp"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+// Number of leaves of a treelet, whose topology is optimized at once.
+// The optimization enumerates all subsets of the leaves.
+#define nTreeletLeaves (7)
+#define nTreeletSubsets (1 << nTreeletLeaves)
+
+namespace specter {
+
+struct CPU_LBVH::TreeletContext {
+	const AxisAlignedBoundingBox* triangleBounds;	// Bounds of every triangle of the model
+	const int* leafPositions;	// Position of the leaf node of every triangle
+	float* costs;	// SAH cost of the subtree of every internal node, not normalized by the area of the root
+	int* triangleCounts;	// Number of triangles in the subtree of every internal node
+};
+
+// Child of a node of the treelet. The index of a leaf is the index of its triangle.
+struct TreeletNode {
+	int index;
+	bool leaf;
+};
+
+static int childOf(const InternalNode& node, const int c, bool& leaf) {
+	leaf = (node.childLeaf & (1 << c)) != 0;
+	return c == 0 ? node.leftIdx : node.rightIdx;
+}
+
+void CPU_LBVH::optimizeTreelets(const Model& model, const int nRounds) {
+	const int n = static_cast<int>(nTriangles);
+	std::vector<AxisAlignedBoundingBox> triangleBounds(n);
+	std::vector<int> leafPositions(n);
+	std::vector<float> costs(n - 1);
+	std::vector<int> triangleCounts(n - 1);
+	std::unique_ptr<std::atomic<int>[]> atomic_counters(new std::atomic<int>[n - 1]);
+
+	tbb::parallel_for(tbb::blocked_range<int>(0, n), [&](const tbb::blocked_range<int>& r) {
+		for (int i = r.begin(); i < r.end(); ++i) {
+			triangleBounds[i] = constructAABBFromPaddedTriangle(
+				model.GetVertex(model.GetFace(i * 3).p),
+				model.GetVertex(model.GetFace(i * 3 + 1).p),
+				model.GetVertex(model.GetFace(i * 3 + 2).p));
+			leafPositions[leafNodes[i].leafIdx] = i;
+		}
+	});
+
+	TreeletContext context;
+	context.triangleBounds = triangleBounds.data();
+	context.leafPositions = leafPositions.data();
+	context.costs = costs.data();
+	context.triangleCounts = triangleCounts.data();
+
+	for (int round = 0; round < nRounds; ++round) {
+		for (int i = 0; i < n - 1; ++i) {
+			atomic_counters[i].store(0, std::memory_order_relaxed);
+		}
+
+		// Bottom up traversal as in generateBV(). The second thread arriving at a node
+		// restructures the treelet rooted at it, because the subtrees below are final.
+		// The restructuring only rewires nodes below the root, hence the walk continues at its parent.
+		tbb::parallel_for(tbb::blocked_range<int>(0, n), [&](const tbb::blocked_range<int>& r) {
+			for (int i = r.begin(); i < r.end(); ++i) {
+				int nodeIdx = leafNodes[i].parentIdx;
+				while (nodeIdx != -1) {
+					if (atomic_counters[nodeIdx].fetch_add(1, std::memory_order_acq_rel) == 0) {
+						break;
+					}
+
+					const InternalNode& node = internalNodes[nodeIdx];
+					costs[nodeIdx] = costTraversal * output_aabbs[nodeIdx].surfaceArea();
+					triangleCounts[nodeIdx] = 0;
+					for (int c = 0; c < 2; ++c) {
+						bool leaf;
+						const int child = childOf(node, c, leaf);
+						costs[nodeIdx] += leaf ? costIntersection * triangleBounds[child].surfaceArea() : costs[child];
+						triangleCounts[nodeIdx] += leaf ? 1 : triangleCounts[child];
+					}
+
+					// Smaller subtrees can't form a complete treelet
+					if (triangleCounts[nodeIdx] >= nTreeletLeaves) {
+						restructureTreelet(nodeIdx, context);
+					}
+					nodeIdx = node.parentIdx;
+				}
+			}
+		});
+	}
+
+	// The optimal topology of a treelet may be deeper than the one it replaces
+	checkTraversalDepth();
+}
+
+void CPU_LBVH::restructureTreelet(const int nodeIdx, const TreeletContext& context) {
+	auto boundsOf = [&](const TreeletNode& t) -> const AxisAlignedBoundingBox& {
+		return t.leaf ? context.triangleBounds[t.index] : output_aabbs[t.index];
+	};
+
+	// Form the treelet by expanding the leaf with the largest surface area, until it has enough leaves.
+	// The internal nodes of the treelet are reused for the optimized topology.
+	TreeletNode leaves[nTreeletLeaves];
+	int internals[nTreeletLeaves - 1];
+	int nLeaves = 0;
+	int nInternals = 0;
+	internals[nInternals++] = nodeIdx;
+	for (int c = 0; c < 2; ++c) {
+		leaves[nLeaves].index = childOf(internalNodes[nodeIdx], c, leaves[nLeaves].leaf);
+		++nLeaves;
+	}
+	while (nLeaves < nTreeletLeaves) {
+		int largest = -1;
+		float largestArea = -1.f;
+		for (int k = 0; k < nLeaves; ++k) {
+			if (!leaves[k].leaf && boundsOf(leaves[k]).surfaceArea() > largestArea) {
+				largest = k;
+				largestArea = boundsOf(leaves[k]).surfaceArea();
+			}
+		}
+		if (largest == -1) {
+			break;
+		}
+
+		const InternalNode& expanded = internalNodes[leaves[largest].index];
+		internals[nInternals++] = leaves[largest].index;
+		leaves[largest].index = childOf(expanded, 0, leaves[largest].leaf);
+		leaves[nLeaves].index = childOf(expanded, 1, leaves[nLeaves].leaf);
+		++nLeaves;
+	}
+
+	// Find the optimal topology by dynamic programming over the subsets of the leaves.
+	// A subset is split into two, where only the part containing the lowest leaf is enumerated.
+	AxisAlignedBoundingBox subsetBounds[nTreeletSubsets];
+	float subsetCosts[nTreeletSubsets];
+	int subsetCounts[nTreeletSubsets];
+	uint8_t subsetPartitions[nTreeletSubsets];
+	for (int k = 0; k < nLeaves; ++k) {
+		const TreeletNode& leaf = leaves[k];
+		subsetBounds[1 << k] = boundsOf(leaf);
+		subsetCosts[1 << k] = leaf.leaf ? costIntersection * subsetBounds[1 << k].surfaceArea() : context.costs[leaf.index];
+		subsetCounts[1 << k] = leaf.leaf ? 1 : context.triangleCounts[leaf.index];
+	}
+
+	const int nSubsets = 1 << nLeaves;
+	for (int s = 1; s < nSubsets; ++s) {
+		const int lowest = s & -s;
+		if (s == lowest) {
+			continue;
+		}
+		subsetBounds[s] = combine(subsetBounds[lowest], subsetBounds[s ^ lowest]);
+		subsetCounts[s] = subsetCounts[lowest] + subsetCounts[s ^ lowest];
+
+		// The parts are the lowest leaf together with every proper subset of the remaining leaves
+		const int rest = s ^ lowest;
+		float bestCost = std::numeric_limits<float>::max();
+		for (int q = (rest - 1) & rest; ; q = (q - 1) & rest) {
+			const int p = q | lowest;
+			const float cost = subsetCosts[p] + subsetCosts[s ^ p];
+			if (cost < bestCost) {
+				bestCost = cost;
+				subsetPartitions[s] = static_cast<uint8_t>(p);
+			}
+			if (q == 0) {
+				break;
+			}
+		}
+		subsetCosts[s] = costTraversal * subsetBounds[s].surfaceArea() + bestCost;
+	}
+
+	// Keep the treelet, unless the optimized topology is noticeably cheaper
+	const int all = nSubsets - 1;
+	if (!(subsetCosts[all] < context.costs[nodeIdx] * (1.f - 1e-5f))) {
+		return;
+	}
+
+	// Rewire the internal nodes of the treelet top-down. The bounds and costs of the subsets are final.
+	struct PendingNode {
+		int subset;
+		int nodeIdx;
+	};
+	PendingNode pending[nTreeletLeaves - 1];
+	int nPending = 0;
+	int nextInternal = 1;
+	pending[nPending++] = { all, nodeIdx };
+	while (nPending > 0) {
+		const PendingNode current = pending[--nPending];
+		InternalNode& node = internalNodes[current.nodeIdx];
+		output_aabbs[current.nodeIdx] = subsetBounds[current.subset];
+		context.costs[current.nodeIdx] = subsetCosts[current.subset];
+		context.triangleCounts[current.nodeIdx] = subsetCounts[current.subset];
+
+		const int parts[2] = { subsetPartitions[current.subset], current.subset ^ subsetPartitions[current.subset] };
+		node.childLeaf = 0;
+		for (int c = 0; c < 2; ++c) {
+			TreeletNode child;
+			const int part = parts[c];
+			if ((part & (part - 1)) == 0) {
+				// A single leaf, whose position is the index of the bit
+				child = leaves[31 - countLeadingZeros(static_cast<uint32_t>(part))];
+			} else {
+				child = { internals[nextInternal++], false };
+				pending[nPending++] = { part, child.index };
+			}
+
+			(c == 0 ? node.leftIdx : node.rightIdx) = child.index;
+			if (child.leaf) {
+				node.childLeaf |= 1 << c;
+				leafNodes[context.leafPositions[child.index]].parentIdx = current.nodeIdx;
+			} else {
+				internalNodes[child.index].parentIdx = current.nodeIdx;
+			}
+		}
+	}
+}
+
+float CPU_LBVH::ComputeExpectedRayCost(const Model& model) const {
+	// The probability that a ray hitting the root also hits a node is the ratio of their surface areas.
+	// It is evaluated in parallel, because refit() checks it for every update.
+	const float rootArea = output_aabbs[0].surfaceArea();
+	const double cost = tbb::parallel_reduce(tbb::blocked_range<std::size_t>(0, nTriangles - 1), 0.0,
+		[&](const tbb::blocked_range<std::size_t>& r, double cost) {
+			for (std::size_t i = r.begin(); i < r.end(); ++i) {
+				const InternalNode& node = internalNodes[i];
+				cost += costTraversal * output_aabbs[i].surfaceArea();
+				for (int c = 0; c < 2; ++c) {
+					bool leaf;
+					const int child = childOf(node, c, leaf);
+					if (leaf) {
+						const AxisAlignedBoundingBox triangleBounds = constructAABBFromPaddedTriangle(
+							model.GetVertex(model.GetFace(child * 3).p),
+							model.GetVertex(model.GetFace(child * 3 + 1).p),
+							model.GetVertex(model.GetFace(child * 3 + 2).p));
+						cost += costIntersection * triangleBounds.surfaceArea();
+					}
+				}
+			}
+			return cost;
+		},
+		[](const double c0, const double c1) {
+			return c0 + c1;
+		});
+	return rootArea > 0.f ? cost / rootArea : 0.f;
+}
+
+}
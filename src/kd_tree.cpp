@@ -0,0 +1,573 @@
+#include "kd_tree.hpp"
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
+
+#include <algorithm>
+#include <cmath>
+
+// Nodes deeper than this become leaves, regardless of their triangle count.
+#define nMaxBuildDepth (60)
+// Bounds the number of nodes on the traversal stack. The stack holds at most one node per level.
+#define nTraversalStackSize (nMaxBuildDepth + 4)
+
+// Nodes referencing at least this many triangles build their children in parallel.
+#define nParallelBuildThreshold (1 << 12)
+// Nodes referencing at least this many triangles sweep and partition the events of the three axes in parallel.
+#define nParallelSweepThreshold (1 << 15)
+
+// Cost constants of the surface area heuristic, which decide about the splits during the construction.
+// The traversal cost covers the intersection of a ray with the split plane of an interior node, which is cheaper
+// than the box tests of the other structures. The expected ray cost uses the shared constants of accel_stats.hpp.
+// Reference: Wald and Havran use a ratio of 15 to 20 between them
+#define splitCostTraversal (1.f)
+#define splitCostIntersection (1.5f)
+
+namespace specter {
+
+// Returns true if the ray hits the box within the ray interval.
+// The ray is inside the box in the interval [nearT, farT].
+static inline bool intersectBounds(const AxisAlignedBoundingBox& box, const Ray& ray, float& nearT, float& farT) {
+	const vec3f t0 = (box.min - ray.o) * ray.invd;
+	const vec3f t1 = (box.max - ray.o) * ray.invd;
+	nearT = std::max(maxComponent(minv(t0, t1)), ray.tmin);
+	farT = std::min(minComponent(maxv(t0, t1)) * robustFarScale, ray.tmax);
+	return nearT <= farT;
+}
+
+// Returns true if the box contains anything. Boxes of flat triangles are collapsed along an axis, but not empty.
+static bool isValid(const AxisAlignedBoundingBox& box) {
+	return box.min <= box.max;
+}
+
+void KdTree::build(const Model& model, const KdTreeParameters& parameters) {
+	const uint32_t nTriangles = static_cast<uint32_t>(model.GetTriangleCount());
+	if (nTriangles == 0) {
+		throw std::runtime_error("Can't build a k-d tree for a model without triangles");
+	}
+
+	std::vector<Reference> references(nTriangles);
+	bounds = tbb::parallel_reduce(tbb::blocked_range<uint32_t>(0, nTriangles),
+		AxisAlignedBoundingBox(vec3f(std::numeric_limits<float>::max()), vec3f(std::numeric_limits<float>::lowest())),
+		[&](const tbb::blocked_range<uint32_t>& r, AxisAlignedBoundingBox box) {
+			for (uint32_t i = r.begin(); i < r.end(); ++i) {
+				const vec3f v0 = model.GetVertex(model.GetFace(i * 3 + 0).p);
+				const vec3f v1 = model.GetVertex(model.GetFace(i * 3 + 1).p);
+				const vec3f v2 = model.GetVertex(model.GetFace(i * 3 + 2).p);
+				references[i].bounds = AxisAlignedBoundingBox(minComponent(minComponent(v0, v1), v2), maxComponent(maxComponent(v0, v1), v2));
+				references[i].triangle = i;
+				box = combine(box, references[i].bounds);
+			}
+			return box;
+		},
+		[](const AxisAlignedBoundingBox& b0, const AxisAlignedBoundingBox& b1) {
+			return combine(b0, b1);
+		});
+
+	// The events are only sorted once. The children inherit the order from their parent.
+	EventLists events;
+	tbb::parallel_for(0, 3, [&](const int axis) {
+		events[axis].reserve(std::size_t(nTriangles) * 2);
+		for (uint32_t i = 0; i < nTriangles; ++i) {
+			const float bmin = references[i].bounds.min[axis];
+			const float bmax = references[i].bounds.max[axis];
+			if (bmin == bmax) {
+				events[axis].push_back({ bmin, i, Event::Planar });
+			} else {
+				events[axis].push_back({ bmin, i, Event::Start });
+				events[axis].push_back({ bmax, i, Event::End });
+			}
+		}
+		tbb::parallel_sort(events[axis].begin(), events[axis].end());
+	});
+
+	BuildContext context;
+	context.model = &model;
+	context.maxDepth = parameters.maxDepth < 0 ? static_cast<int>(8.f + 1.3f * std::log2(static_cast<float>(nTriangles))) : parameters.maxDepth;
+	context.maxDepth = std::min(context.maxDepth, nMaxBuildDepth);
+	context.emptySpaceBonus = std::clamp(parameters.emptySpaceBonus, 0.f, 1.f);
+
+	// Like in the BVH, the slot after the root is unused, such that the children of every node are aligned.
+	BuildFragment fragment;
+	fragment.nodes.resize(2);
+	buildRec(fragment, context, 0, bounds, references, events, 0);
+
+	if (fragment.subtrees.empty()) {
+		nodes.assign(fragment.nodes.begin(), fragment.nodes.end());
+		triIndices = std::move(fragment.triIndices);
+	} else {
+		linearize(fragment);
+	}
+}
+
+void KdTree::buildRec(	BuildFragment& fragment, const BuildContext& context, const uint32_t nodeIdx, const AxisAlignedBoundingBox& voxel,
+						std::vector<Reference>& references, EventLists& events, const int depth) const {
+	const uint32_t nReferences = static_cast<uint32_t>(references.size());
+	Split split;
+	if (depth < context.maxDepth && nReferences > 0) {
+		split = findSplit(context, voxel, nReferences, events);
+	}
+
+	// Intersecting the triangles of the node is cheaper than any split
+	if (split.axis == -1 || split.cost >= splitCostIntersection * nReferences) {
+		Node& leaf = fragment.nodes[nodeIdx];
+		leaf.offset = static_cast<uint32_t>(fragment.triIndices.size());
+		leaf.data = (nReferences << 2) | Node::LeafTag;
+		for (const Reference& reference : references) {
+			fragment.triIndices.push_back(reference.triangle);
+		}
+		return;
+	}
+
+	std::vector<Reference> leftReferences, rightReferences;
+	EventLists leftEvents, rightEvents;
+	partition(context, split, references, events, leftReferences, leftEvents, rightReferences, rightEvents);
+	std::vector<Reference>().swap(references);
+	for (int axis = 0; axis < 3; ++axis) {
+		std::vector<Event>().swap(events[axis]);
+	}
+
+	AxisAlignedBoundingBox leftVoxel(voxel), rightVoxel(voxel);
+	leftVoxel.max[split.axis] = split.position;
+	rightVoxel.min[split.axis] = split.position;
+
+	const uint32_t children = static_cast<uint32_t>(fragment.nodes.size());
+	fragment.nodes.resize(children + 2);
+	Node& node = fragment.nodes[nodeIdx];
+	node.split = split.position;
+	node.data = (children << 2) | static_cast<uint32_t>(split.axis);
+
+	if (nReferences >= nParallelBuildThreshold) {
+		// The roots of the subtrees take the place of the children, when the fragments are linearized
+		auto left = std::make_unique<BuildFragment>();
+		auto right = std::make_unique<BuildFragment>();
+		left->nodes.resize(2);
+		right->nodes.resize(2);
+		tbb::parallel_invoke(
+			[&] { buildRec(*left, context, 0, leftVoxel, leftReferences, leftEvents, depth + 1); },
+			[&] { buildRec(*right, context, 0, rightVoxel, rightReferences, rightEvents, depth + 1); });
+		fragment.subtrees.emplace_back(children, std::move(left));
+		fragment.subtrees.emplace_back(children + 1, std::move(right));
+	} else {
+		buildRec(fragment, context, children, leftVoxel, leftReferences, leftEvents, depth + 1);
+		buildRec(fragment, context, children + 1, rightVoxel, rightReferences, rightEvents, depth + 1);
+	}
+}
+
+KdTree::Split KdTree::findSplit(const BuildContext& context, const AxisAlignedBoundingBox& voxel, const uint32_t nReferences, const EventLists& events) {
+	const float area = voxel.surfaceArea();
+	if (!(area > 0.f)) {
+		return Split();
+	}
+	const float invArea = 1.f / area;
+	const vec3f extent = voxel.max - voxel.min;
+
+	auto computeCost = [&](const float leftProbability, const float rightProbability, const uint32_t nLeft, const uint32_t nRight) {
+		const float cost = splitCostTraversal + splitCostIntersection * (leftProbability * nLeft + rightProbability * nRight);
+		return (nLeft == 0 || nRight == 0) ? cost * (1.f - context.emptySpaceBonus) : cost;
+	};
+
+	// The events at the same position are grouped by their type. References ending at the plane belong to the
+	// child below it, references starting at the plane to the child above it. References lying in the plane
+	// are assigned to the cheaper side.
+	Split splits[3];
+	auto sweep = [&](const int axis) {
+		Split& best = splits[axis];
+		const std::vector<Event>& list = events[axis];
+
+		// The surface areas of the children are linear in the position of the plane
+		const float capArea = 2.f * extent[(axis + 1) % 3] * extent[(axis + 2) % 3];
+		const float perimeter = 2.f * (extent[(axis + 1) % 3] + extent[(axis + 2) % 3]);
+
+		uint32_t nLeft = 0;
+		uint32_t nRight = nReferences;
+		std::size_t i = 0;
+		while (i < list.size()) {
+			const float position = list[i].position;
+			uint32_t nEnding = 0, nPlanar = 0, nStarting = 0;
+			while (i < list.size() && list[i].position == position && list[i].type == Event::End) {
+				++nEnding;
+				++i;
+			}
+			while (i < list.size() && list[i].position == position && list[i].type == Event::Planar) {
+				++nPlanar;
+				++i;
+			}
+			while (i < list.size() && list[i].position == position && list[i].type == Event::Start) {
+				++nStarting;
+				++i;
+			}
+
+			nRight -= nPlanar + nEnding;
+			// Planes on the boundary of the voxel don't separate anything
+			if (position > voxel.min[axis] && position < voxel.max[axis]) {
+				const float leftProbability = (capArea + perimeter * (position - voxel.min[axis])) * invArea;
+				const float rightProbability = (capArea + perimeter * (voxel.max[axis] - position)) * invArea;
+				const float leftCost = computeCost(leftProbability, rightProbability, nLeft + nPlanar, nRight);
+				const float rightCost = computeCost(leftProbability, rightProbability, nLeft, nRight + nPlanar);
+				if (leftCost < best.cost) {
+					best.cost = leftCost;
+					best.axis = axis;
+					best.position = position;
+					best.planarLeft = true;
+				}
+				if (rightCost < best.cost) {
+					best.cost = rightCost;
+					best.axis = axis;
+					best.position = position;
+					best.planarLeft = false;
+				}
+			}
+			nLeft += nStarting + nPlanar;
+		}
+	};
+
+	if (nReferences >= nParallelSweepThreshold) {
+		tbb::parallel_for(0, 3, sweep);
+	} else {
+		for (int axis = 0; axis < 3; ++axis) {
+			sweep(axis);
+		}
+	}
+
+	Split best;
+	for (int axis = 0; axis < 3; ++axis) {
+		if (splits[axis].cost < best.cost) {
+			best = splits[axis];
+		}
+	}
+	return best;
+}
+
+void KdTree::partition(	const BuildContext& context, const Split& split, const std::vector<Reference>& references, const EventLists& events,
+						std::vector<Reference>& leftReferences, EventLists& leftEvents,
+						std::vector<Reference>& rightReferences, EventLists& rightEvents) {
+	enum Side : uint8_t {
+		Both,
+		LeftOnly,
+		RightOnly
+	};
+
+	// Classify the references by the events along the axis of the plane. References, which have no event
+	// that places them on one side, straddle the plane.
+	const uint32_t nReferences = static_cast<uint32_t>(references.size());
+	std::vector<uint8_t> sides(nReferences, Both);
+	for (const Event& event : events[split.axis]) {
+		if (event.type == Event::End && event.position <= split.position) {
+			sides[event.reference] = LeftOnly;
+		} else if (event.type == Event::Start && event.position >= split.position) {
+			sides[event.reference] = RightOnly;
+		} else if (event.type == Event::Planar) {
+			const bool left = event.position < split.position || (event.position == split.position && split.planarLeft);
+			sides[event.reference] = left ? LeftOnly : RightOnly;
+		}
+	}
+
+	// Straddling references are split at the plane. A part is dropped, if the triangle doesn't reach its side.
+	std::vector<uint32_t> leftIndices(nReferences), rightIndices(nReferences);
+	std::vector<uint32_t> splitReferences;
+	for (uint32_t i = 0; i < nReferences; ++i) {
+		const Reference& reference = references[i];
+		if (sides[i] == LeftOnly) {
+			leftIndices[i] = static_cast<uint32_t>(leftReferences.size());
+			leftReferences.push_back(reference);
+		} else if (sides[i] == RightOnly) {
+			rightIndices[i] = static_cast<uint32_t>(rightReferences.size());
+			rightReferences.push_back(reference);
+		} else {
+			const Model& model = *context.model;
+			const vec3f vertices[3] = {
+				model.GetVertex(model.GetFace(reference.triangle * 3 + 0).p),
+				model.GetVertex(model.GetFace(reference.triangle * 3 + 1).p),
+				model.GetVertex(model.GetFace(reference.triangle * 3 + 2).p)
+			};
+			AxisAlignedBoundingBox left, right;
+			splitTriangleBounds(vertices, reference.bounds, split.axis, split.position, left, right);
+			leftIndices[i] = rightIndices[i] = std::numeric_limits<uint32_t>::max();
+			if (isValid(left)) {
+				leftIndices[i] = static_cast<uint32_t>(leftReferences.size());
+				leftReferences.push_back({ left, reference.triangle });
+			}
+			if (isValid(right)) {
+				rightIndices[i] = static_cast<uint32_t>(rightReferences.size());
+				rightReferences.push_back({ right, reference.triangle });
+			}
+			splitReferences.push_back(i);
+		}
+	}
+
+	// The events of the references on one side keep their order. The events of the split references
+	// are sorted separately and merged, which is cheap, because few references straddle the plane.
+	auto partitionAxis = [&](const int axis) {
+		std::vector<Event> leftOnly, rightOnly;
+		leftOnly.reserve(events[axis].size());
+		rightOnly.reserve(events[axis].size());
+		for (const Event& event : events[axis]) {
+			if (sides[event.reference] == LeftOnly) {
+				leftOnly.push_back({ event.position, leftIndices[event.reference], event.type });
+			} else if (sides[event.reference] == RightOnly) {
+				rightOnly.push_back({ event.position, rightIndices[event.reference], event.type });
+			}
+		}
+
+		std::vector<Event> leftSplit, rightSplit;
+		auto addEvents = [axis](std::vector<Event>& list, const Reference& reference, const uint32_t index) {
+			const float bmin = reference.bounds.min[axis];
+			const float bmax = reference.bounds.max[axis];
+			if (bmin == bmax) {
+				list.push_back({ bmin, index, Event::Planar });
+			} else {
+				list.push_back({ bmin, index, Event::Start });
+				list.push_back({ bmax, index, Event::End });
+			}
+		};
+		for (const uint32_t i : splitReferences) {
+			if (leftIndices[i] != std::numeric_limits<uint32_t>::max()) {
+				addEvents(leftSplit, leftReferences[leftIndices[i]], leftIndices[i]);
+			}
+			if (rightIndices[i] != std::numeric_limits<uint32_t>::max()) {
+				addEvents(rightSplit, rightReferences[rightIndices[i]], rightIndices[i]);
+			}
+		}
+		std::sort(leftSplit.begin(), leftSplit.end());
+		std::sort(rightSplit.begin(), rightSplit.end());
+
+		leftEvents[axis].resize(leftOnly.size() + leftSplit.size());
+		std::merge(leftOnly.begin(), leftOnly.end(), leftSplit.begin(), leftSplit.end(), leftEvents[axis].begin());
+		rightEvents[axis].resize(rightOnly.size() + rightSplit.size());
+		std::merge(rightOnly.begin(), rightOnly.end(), rightSplit.begin(), rightSplit.end(), rightEvents[axis].begin());
+	};
+
+	if (nReferences >= nParallelSweepThreshold) {
+		tbb::parallel_for(0, 3, partitionAxis);
+	} else {
+		for (int axis = 0; axis < 3; ++axis) {
+			partitionAxis(axis);
+		}
+	}
+}
+
+void KdTree::linearize(const BuildFragment& root) {
+	// Describes where the nodes and triangle indices of a fragment are copied to. The root of a linked fragment
+	// takes the place of the node it is linked to, hence only the root fragment copies its first two slots.
+	struct Placement {
+		const BuildFragment* fragment;
+		uint32_t nodeOffset;
+		uint32_t triangleOffset;
+		uint32_t firstNode;
+	};
+
+	auto relocate = [](Node node, const Placement& placement) {
+		if (node.IsLeaf()) {
+			node.offset += placement.triangleOffset;
+		} else {
+			node.data += placement.nodeOffset << 2;
+		}
+		return node;
+	};
+
+	std::vector<Placement> placements;
+	std::vector<std::pair<uint32_t, std::size_t>> links;	// [Final node index, placement of the linked fragment]
+	uint32_t nNodes = static_cast<uint32_t>(root.nodes.size());
+	uint32_t nTriIndices = static_cast<uint32_t>(root.triIndices.size());
+	placements.push_back({ &root, 0, 0, 0 });
+
+	for (std::size_t p = 0; p < placements.size(); ++p) {
+		const Placement parent = placements[p];
+		for (const auto& [nodeIdx, subtree] : parent.fragment->subtrees) {
+			links.emplace_back(nodeIdx + parent.nodeOffset, placements.size());
+			placements.push_back({ subtree.get(), nNodes - 2, nTriIndices, 2 });
+			nNodes += static_cast<uint32_t>(subtree->nodes.size()) - 2;
+			nTriIndices += static_cast<uint32_t>(subtree->triIndices.size());
+		}
+	}
+
+	nodes.resize(nNodes);
+	triIndices.resize(nTriIndices);
+
+	tbb::parallel_for(std::size_t(0), placements.size(), [&](const std::size_t p) {
+		const Placement& placement = placements[p];
+		const BuildFragment& fragment = *placement.fragment;
+		for (uint32_t i = placement.firstNode; i < fragment.nodes.size(); ++i) {
+			nodes[i + placement.nodeOffset] = relocate(fragment.nodes[i], placement);
+		}
+		std::copy(fragment.triIndices.begin(), fragment.triIndices.end(), triIndices.begin() + placement.triangleOffset);
+	});
+
+	for (const auto& [nodeIdx, p] : links) {
+		nodes[nodeIdx] = relocate(placements[p].fragment->nodes[0], placements[p]);
+	}
+}
+
+bool KdTree::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	// The interval of the local ray is shrunk, whenever a closer intersection is found.
+	Ray r(ray);
+	r.tmax = std::min(ray.tmax, intersection.t);
+
+	float tMin, tMax;
+	if (!intersectBounds(bounds, r, tMin, tMax)) {
+		return intersection.isValid();
+	}
+
+	// The far children, which the ray passes through, are pushed onto the stack together with
+	// the interval of the ray within them. The stack is sorted front to back, its top is the closest.
+	struct StackEntry {
+		uint32_t nodeIdx;
+		float tMin, tMax;
+	};
+	StackEntry stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	float u, v, t;
+	float best_u, best_v;
+	uint32_t best_i = std::numeric_limits<uint32_t>::max();
+	uint32_t nodeIdx = 0;
+	while (true) {
+		const Node& node = nodes[nodeIdx];
+		if (!node.IsLeaf()) {
+			const int axis = node.GetAxis();
+			const float tPlane = (node.split - r.o[axis]) * r.invd[axis];
+			// The child on the side of the ray origin is visited first
+			const bool belowFirst = r.o[axis] < node.split || (r.o[axis] == node.split && r.d[axis] <= 0.f);
+			const uint32_t first = node.GetChildren() + (belowFirst ? 0 : 1);
+			const uint32_t second = node.GetChildren() + (belowFirst ? 1 : 0);
+			// Planes crossed within the rounding error of the interval visit both children, see robustFarScale
+			if (tPlane > tMax * robustFarScale || tPlane <= 0.f) {
+				nodeIdx = first;
+			} else if (tPlane * robustFarScale < tMin) {
+				nodeIdx = second;
+			} else {
+				stack[stackSize++] = { second, tPlane, tMax };
+				nodeIdx = first;
+				tMax = tPlane;
+			}
+			continue;
+		}
+
+		const int hitIdx = model->rayIntersectionClosest(r, triIndices.data() + node.offset, node.GetTriangleCount(), u, v, t);
+		if (hitIdx >= 0) {
+			r.tmax = t;
+			intersection.t = t;
+			best_u = u;
+			best_v = v;
+			best_i = triIndices[node.offset + hitIdx];
+		}
+
+		// The remaining nodes lie behind the closest intersection found so far
+		if (stackSize == 0 || stack[stackSize - 1].tMin > r.tmax) {
+			break;
+		}
+		const StackEntry& entry = stack[--stackSize];
+		nodeIdx = entry.nodeIdx;
+		tMin = entry.tMin;
+		tMax = entry.tMax;
+	}
+
+	if (best_i != std::numeric_limits<uint32_t>::max()) {
+		model->computeSurfaceInteraction(best_i, best_u, best_v, r, intersection);
+		return true;
+	}
+	return intersection.isValid();
+}
+
+bool KdTree::traverseAny(const Model* model, const Ray& ray) const {
+	float tMin, tMax;
+	if (!intersectBounds(bounds, ray, tMin, tMax)) {
+		return false;
+	}
+
+	struct StackEntry {
+		uint32_t nodeIdx;
+		float tMin, tMax;
+	};
+	StackEntry stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	uint32_t nodeIdx = 0;
+	while (true) {
+		const Node& node = nodes[nodeIdx];
+		if (!node.IsLeaf()) {
+			const int axis = node.GetAxis();
+			const float tPlane = (node.split - ray.o[axis]) * ray.invd[axis];
+			const bool belowFirst = ray.o[axis] < node.split || (ray.o[axis] == node.split && ray.d[axis] <= 0.f);
+			const uint32_t first = node.GetChildren() + (belowFirst ? 0 : 1);
+			const uint32_t second = node.GetChildren() + (belowFirst ? 1 : 0);
+			if (tPlane > tMax * robustFarScale || tPlane <= 0.f) {
+				nodeIdx = first;
+			} else if (tPlane * robustFarScale < tMin) {
+				nodeIdx = second;
+			} else {
+				stack[stackSize++] = { second, tPlane, tMax };
+				nodeIdx = first;
+				tMax = tPlane;
+			}
+			continue;
+		}
+
+		if (model->rayIntersectionAny(ray, triIndices.data() + node.offset, node.GetTriangleCount())) {
+			return true;
+		}
+
+		if (stackSize == 0) {
+			return false;
+		}
+		const StackEntry& entry = stack[--stackSize];
+		nodeIdx = entry.nodeIdx;
+		tMin = entry.tMin;
+		tMax = entry.tMax;
+	}
+}
+
+std::size_t KdTree::GetNodeCount() const {
+	// The slot after the root is unused
+	return nodes.size() - 1;
+}
+
+std::size_t KdTree::GetLeafCount() const {
+	std::size_t nLeaves = 0;
+	for (std::size_t i = 0; i < nodes.size(); ++i) {
+		nLeaves += i != 1 && nodes[i].IsLeaf() && nodes[i].GetTriangleCount() > 0;
+	}
+	return nLeaves;
+}
+
+LeafSizeHistogram KdTree::GetLeafSizeHistogram() const {
+	LeafSizeHistogram histogram;
+	for (std::size_t i = 0; i < nodes.size(); ++i) {
+		if (i != 1 && nodes[i].IsLeaf() && nodes[i].GetTriangleCount() > 0) {
+			++histogram[nodes[i].GetTriangleCount()];
+		}
+	}
+	return histogram;
+}
+
+float KdTree::ComputeExpectedRayCost() const {
+	// The probability that a ray hitting the root also hits a node is the ratio of the surface areas of their voxels.
+	// The voxels aren't stored, hence they are recovered top-down.
+	const float rootArea = bounds.surfaceArea();
+	double cost = 0.0;
+	std::vector<std::pair<uint32_t, AxisAlignedBoundingBox>> stack;
+	stack.emplace_back(0, bounds);
+	while (!stack.empty()) {
+		const auto [nodeIdx, voxel] = stack.back();
+		stack.pop_back();
+		const Node& node = nodes[nodeIdx];
+		if (node.IsLeaf()) {
+			cost += voxel.surfaceArea() * costIntersection * node.GetTriangleCount();
+			continue;
+		}
+
+		cost += voxel.surfaceArea() * costTraversal;
+		AxisAlignedBoundingBox below(voxel), above(voxel);
+		below.max[node.GetAxis()] = node.split;
+		above.min[node.GetAxis()] = node.split;
+		stack.emplace_back(node.GetChildren(), below);
+		stack.emplace_back(node.GetChildren() + 1, above);
+	}
+	return rootArea > 0.f ? cost / rootArea : 0.f;
+}
+
+}
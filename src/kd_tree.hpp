@@ -0,0 +1,165 @@
+#pragma once
+#include "aabb.hpp"
+#include "accel_parameters.hpp"
+#include "accel_stats.hpp"
+#include "model.hpp"
+#include "vec3.hpp"
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace specter {
+
+// k-d tree, whose split planes are selected with the surface area heuristic. The candidate planes of a node
+// are the bounds of its triangles, clipped to the node. They are evaluated in one sweep over events, which are
+// sorted once at the root and kept sorted while they are distributed to the children, i.e. in O(N log N).
+// Triangles straddling a plane are referenced by both children.
+// Reference: Ingo Wald and Vlastimil Havran, On building fast kd-Trees for Ray Tracing, and on doing that in O(N log N)
+struct KdTree {
+
+	// Represents a single node of the tree. The two children of an interior node are stored next to each other.
+	struct Node {
+
+		// Marks a leaf in the axis bits of the data field
+		static constexpr uint32_t LeafTag = 3;
+
+		bool IsLeaf() const {
+			return (data & 3) == LeafTag;
+		}
+
+		// Returns the axis of the split plane of an interior node
+		int GetAxis() const {
+			return data & 3;
+		}
+
+		// Returns the index of the child below the split plane of an interior node. The child above follows it.
+		uint32_t GetChildren() const {
+			return data >> 2;
+		}
+
+		uint32_t GetTriangleCount() const {
+			return data >> 2;
+		}
+
+		union {
+			float split;	// Position of the split plane of an interior node
+			uint32_t offset;	// Position of the first triangle index of a leaf in the index pool
+		};
+		// The lowest two bits hold the axis of the split plane, or LeafTag for leaves. The remaining bits hold
+		// the index of the children of interior nodes, or the number of triangles of leaves.
+		uint32_t data;
+	};
+
+	static_assert(sizeof(Node) == 8, "A cache line has to hold eight nodes");
+
+	void build(const Model& model, const KdTreeParameters& parameters = KdTreeParameters());
+
+	// Traverse the tree front to back. Returns true if the ray intersects geometry in the mesh.
+	// Additionally, it is guaranteed that the intersection point is the closest intersection point to the ray origin
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const;
+
+	// Traverse the tree. Returns true if the ray intersects any geometry in the mesh
+	// within the ray interval.
+	bool traverseAny(const Model* model, const Ray& ray) const;
+
+	std::size_t GetNodeCount() const;
+	// Returns the number of leaves, which reference any triangles. Empty leaves cut off empty space.
+	std::size_t GetLeafCount() const;
+	// Returns the number of triangle references of the leaves. Triangles straddling a plane are referenced several times.
+	std::size_t GetReferenceCount() const {
+		return triIndices.size();
+	}
+	// Returns the number of distinct triangles referenced by the leaves
+	std::size_t GetUniqueTriangleCount() const {
+		return countUniqueTriangles(triIndices);
+	}
+	LeafSizeHistogram GetLeafSizeHistogram() const;
+	// Returns the number of bytes occupied by the nodes and the triangle indices
+	std::size_t GetMemoryUsage() const {
+		return nodes.size() * sizeof(Node) + triIndices.size() * sizeof(uint32_t);
+	}
+	// Returns the expected cost of tracing a ray according to the surface area heuristic
+	float ComputeExpectedRayCost() const;
+
+private:
+
+	// Part of a triangle, which overlaps a node. The bounds are clipped to the planes of the ancestors of the node.
+	struct Reference {
+		AxisAlignedBoundingBox bounds;
+		uint32_t triangle;
+	};
+
+	// Candidate plane at the bounds of a reference along one axis. At equal positions,
+	// the events are sorted by their type, such that the sweep sees the ending references first.
+	struct Event {
+
+		enum Type : uint32_t {
+			End = 0,
+			Planar = 1,	// The reference lies in the plane
+			Start = 2
+		};
+
+		bool operator<(const Event& other) const {
+			return position < other.position || (position == other.position && type < other.type);
+		}
+
+		float position;
+		uint32_t reference;	// Position of the reference in the list of the node
+		Type type;
+	};
+
+	// Events of a node along every axis, which are sorted
+	using EventLists = std::vector<Event>[3];
+
+	// Split plane with the lowest cost according to the surface area heuristic
+	struct Split {
+		float cost = std::numeric_limits<float>::max();
+		int axis = -1;	// -1 if there is no valid split
+		float position = 0.f;
+		bool planarLeft = false;	// References lying in the plane are assigned to the child below it
+	};
+
+	// Storage of a subtree during construction. Subtrees that are built in parallel are written to their own fragment,
+	// which is linked to the parent fragment. The layout is the same as that of the final tree.
+	struct BuildFragment {
+		std::vector<Node> nodes;
+		std::vector<uint32_t> triIndices;
+		// Fragments of the subtrees, whose roots belong to the node indices of this fragment.
+		std::vector<std::pair<uint32_t, std::unique_ptr<BuildFragment>>> subtrees;
+	};
+
+	// State shared by all nodes during the construction of the tree
+	struct BuildContext {
+		const Model* model;
+		int maxDepth;
+		float emptySpaceBonus;
+	};
+
+	// Build the tree recursively. This is initially called by the public function build()
+	// The references and events of the node are released before its children are built.
+	void buildRec(	BuildFragment& fragment, const BuildContext& context, const uint32_t nodeIdx, const AxisAlignedBoundingBox& voxel,
+					std::vector<Reference>& references, EventLists& events, const int depth) const;
+
+	// Returns the split with the lowest cost according to the surface area heuristic
+	static Split findSplit(const BuildContext& context, const AxisAlignedBoundingBox& voxel, const uint32_t nReferences, const EventLists& events);
+
+	// Distributes the references and the events of a node to its children. References straddling the plane
+	// are split and their events are regenerated, sorted and merged into the events of the children.
+	static void partition(	const BuildContext& context, const Split& split, const std::vector<Reference>& references, const EventLists& events,
+							std::vector<Reference>& leftReferences, EventLists& leftEvents,
+							std::vector<Reference>& rightReferences, EventLists& rightEvents);
+
+	// Copies the fragment and all of its linked subtrees into the node and triangle index arrays.
+	void linearize(const BuildFragment& root);
+
+private:
+
+	std::vector<Node, tbb::cache_aligned_allocator<Node>> nodes;	// Nodes of the tree. The root is stored at index 0, index 1 is unused.
+	std::vector<uint32_t> triIndices;	// Shared pool of the triangle indices referenced by leaf nodes.
+	AxisAlignedBoundingBox bounds;	// Bounding box of the root node.
+};
+
+}
@@ -0,0 +1,91 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace specter {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+	: base(nullptr)
+	, length(0)
+	, file(INVALID_HANDLE_VALUE)
+	, mapping(nullptr)
+{
+	file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Could not open file: " + filename);
+	}
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		throw std::runtime_error("Could not map empty file: " + filename);
+	}
+	length = static_cast<std::size_t>(fileSize.QuadPart);
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		CloseHandle(file);
+		throw std::runtime_error("Could not map file: " + filename);
+	}
+
+	base = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (base == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Could not map file: " + filename);
+	}
+}
+
+MappedFile::~MappedFile() {
+	UnmapViewOfFile(base);
+	CloseHandle(mapping);
+	CloseHandle(file);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename)
+	: base(nullptr)
+	, length(0)
+	, file(-1)
+{
+	file = open(filename.c_str(), O_RDONLY);
+	if (file == -1) {
+		throw std::runtime_error("Could not open file: " + filename);
+	}
+
+	struct stat fileStatus;
+	if (fstat(file, &fileStatus) != 0 || fileStatus.st_size == 0) {
+		close(file);
+		throw std::runtime_error("Could not map empty file: " + filename);
+	}
+	length = static_cast<std::size_t>(fileStatus.st_size);
+
+	void* ptr = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, file, 0);
+	if (ptr == MAP_FAILED) {
+		close(file);
+		throw std::runtime_error("Could not map file: " + filename);
+	}
+	base = static_cast<const unsigned char*>(ptr);
+}
+
+MappedFile::~MappedFile() {
+	munmap(const_cast<unsigned char*>(base), length);
+	close(file);
+}
+
+#endif
+
+}
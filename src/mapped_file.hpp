@@ -0,0 +1,40 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace specter {
+
+// Read-only memory mapping of a whole file. The pages are loaded lazily by the 
+// operating system on first access. The mapping is released on destruction.
+class MappedFile {
+
+public:
+
+	// Maps the file into memory. Throws std::runtime_error if the file can't be mapped.
+	explicit MappedFile(const std::string& filename);
+	~MappedFile();
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const unsigned char* data() const {
+		return base;
+	}
+
+	std::size_t size() const {
+		return length;
+	}
+
+private:
+
+	const unsigned char* base;
+	std::size_t length;
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int file;
+#endif
+};
+
+}
@@ -272,6 +272,49 @@ mat4<T> transpose(const mat4<T>& m) {
 	return tmat;
 }
 
+// Returns the inverse of m. The result is undefined, if m is singular.
+template<typename T>
+mat4<T> inverse(const mat4<T>& m) {
+	const T* a = m.data;
+	mat4<T> inv;
+	T* r = inv.data;
+	r[0] = a[5] * a[10] * a[15] - a[5] * a[11] * a[14] - a[9] * a[6] * a[15] + a[9] * a[7] * a[14] + a[13] * a[6] * a[11] - a[13] * a[7] * a[10];
+	r[4] = -a[4] * a[10] * a[15] + a[4] * a[11] * a[14] + a[8] * a[6] * a[15] - a[8] * a[7] * a[14] - a[12] * a[6] * a[11] + a[12] * a[7] * a[10];
+	r[8] = a[4] * a[9] * a[15] - a[4] * a[11] * a[13] - a[8] * a[5] * a[15] + a[8] * a[7] * a[13] + a[12] * a[5] * a[11] - a[12] * a[7] * a[9];
+	r[12] = -a[4] * a[9] * a[14] + a[4] * a[10] * a[13] + a[8] * a[5] * a[14] - a[8] * a[6] * a[13] - a[12] * a[5] * a[10] + a[12] * a[6] * a[9];
+	r[1] = -a[1] * a[10] * a[15] + a[1] * a[11] * a[14] + a[9] * a[2] * a[15] - a[9] * a[3] * a[14] - a[13] * a[2] * a[11] + a[13] * a[3] * a[10];
+	r[5] = a[0] * a[10] * a[15] - a[0] * a[11] * a[14] - a[8] * a[2] * a[15] + a[8] * a[3] * a[14] + a[12] * a[2] * a[11] - a[12] * a[3] * a[10];
+	r[9] = -a[0] * a[9] * a[15] + a[0] * a[11] * a[13] + a[8] * a[1] * a[15] - a[8] * a[3] * a[13] - a[12] * a[1] * a[11] + a[12] * a[3] * a[9];
+	r[13] = a[0] * a[9] * a[14] - a[0] * a[10] * a[13] - a[8] * a[1] * a[14] + a[8] * a[2] * a[13] + a[12] * a[1] * a[10] - a[12] * a[2] * a[9];
+	r[2] = a[1] * a[6] * a[15] - a[1] * a[7] * a[14] - a[5] * a[2] * a[15] + a[5] * a[3] * a[14] + a[13] * a[2] * a[7] - a[13] * a[3] * a[6];
+	r[6] = -a[0] * a[6] * a[15] + a[0] * a[7] * a[14] + a[4] * a[2] * a[15] - a[4] * a[3] * a[14] - a[12] * a[2] * a[7] + a[12] * a[3] * a[6];
+	r[10] = a[0] * a[5] * a[15] - a[0] * a[7] * a[13] - a[4] * a[1] * a[15] + a[4] * a[3] * a[13] + a[12] * a[1] * a[7] - a[12] * a[3] * a[5];
+	r[14] = -a[0] * a[5] * a[14] + a[0] * a[6] * a[13] + a[4] * a[1] * a[14] - a[4] * a[2] * a[13] - a[12] * a[1] * a[6] + a[12] * a[2] * a[5];
+	r[3] = -a[1] * a[6] * a[11] + a[1] * a[7] * a[10] + a[5] * a[2] * a[11] - a[5] * a[3] * a[10] - a[9] * a[2] * a[7] + a[9] * a[3] * a[6];
+	r[7] = a[0] * a[6] * a[11] - a[0] * a[7] * a[10] - a[4] * a[2] * a[11] + a[4] * a[3] * a[10] + a[8] * a[2] * a[7] - a[8] * a[3] * a[6];
+	r[11] = -a[0] * a[5] * a[11] + a[0] * a[7] * a[9] + a[4] * a[1] * a[11] - a[4] * a[3] * a[9] - a[8] * a[1] * a[7] + a[8] * a[3] * a[5];
+	r[15] = a[0] * a[5] * a[10] - a[0] * a[6] * a[9] - a[4] * a[1] * a[10] + a[4] * a[2] * a[9] + a[8] * a[1] * a[6] - a[8] * a[2] * a[5];
+
+	const T det = a[0] * r[0] + a[1] * r[4] + a[2] * r[8] + a[3] * r[12];
+	return inv / det;
+}
+
+// Transforms the point p by the affine transform m, whose translation is stored in the last column.
+template<typename T>
+vec3<T> transformPoint(const mat4<T>& m, const vec3<T>& p) {
+	return vec3<T>(	m.data[0] * p.x + m.data[1] * p.y + m.data[2] * p.z + m.data[3],
+					m.data[4] * p.x + m.data[5] * p.y + m.data[6] * p.z + m.data[7],
+					m.data[8] * p.x + m.data[9] * p.y + m.data[10] * p.z + m.data[11]);
+}
+
+// Transforms the direction v by the affine transform m, ignoring its translation.
+template<typename T>
+vec3<T> transformVector(const mat4<T>& m, const vec3<T>& v) {
+	return vec3<T>(	m.data[0] * v.x + m.data[1] * v.y + m.data[2] * v.z,
+					m.data[4] * v.x + m.data[5] * v.y + m.data[6] * v.z,
+					m.data[8] * v.x + m.data[9] * v.y + m.data[10] * v.z);
+}
+
 template<typename T>
 bool isIdentity(const mat4<T>& m) {
 	bool isDiagonalOne = m[0][0] == m[1][1] == m[2][2] == m[3][3] == static_cast<T>(1);
@@ -7,6 +7,7 @@
 #include "material_metal.hpp"
 #include "ray.hpp"
 #include "timer.hpp"
+#include "triangle.hpp"
 
 namespace specter {
 
@@ -168,40 +169,80 @@ public:
 		return std::numeric_limits<uint32_t>::infinity();
 	}
 
-	// Implements the mller&trumbore algorithm.
-	// For implementation reference: Real-time rendering 4th ed, 22.8 Ray/Triangle Intersection
-	bool rayIntersection(const specter::Ray& ray, const std::size_t index, float& u, float& v, float& t) const {
-		const float epsilon = 1e-7;
-		const unsigned i0 = faces[index * 3 + 0].p;
-		const unsigned i1 = faces[index * 3 + 1].p;
-		const unsigned i2 = faces[index * 3 + 2].p;
-		const specter::vec3f v0 = vertices[i0];
-		const specter::vec3f v1 = vertices[i1];
-		const specter::vec3f v2 = vertices[i2];
+	// Selects the ray/triangle intersection test of rayIntersection() and of the packet tests
+	void setTriangleTest(const TriangleTest test) {
+		triangleTest = test;
+	}
 
-		const specter::vec3f e0 = v1 - v0;
-		const specter::vec3f e1 = v2 - v0;
+	TriangleTest GetTriangleTest() const {
+		return triangleTest;
+	}
 
-		const specter::vec3f q = cross(ray.d, e1);
-		const float a = specter::dot(e0, q);
+	// Intersects the ray with the triangle "index" using the selected test, see TriangleTest.
+	// Returns true only if the intersection lies within the ray interval (tmin, tmax).
+	bool rayIntersection(const specter::Ray& ray, const std::size_t index, float& u, float& v, float& t) const {
+		const specter::vec3f& v0 = vertices[faces[index * 3 + 0].p];
+		const specter::vec3f& v1 = vertices[faces[index * 3 + 1].p];
+		const specter::vec3f& v2 = vertices[faces[index * 3 + 2].p];
+		return specter::rayIntersectTriangle(triangleTest, ray, v0, v1, v2, u, v, t);
+	}
 
-		if (a > -epsilon && a < epsilon) {
-			return false;
+	// Smallest number of triangles, which are tested in packets. Gathering fewer triangles
+	// into a packet is slower than testing them one at a time.
+	static constexpr uint32_t minPacketSize = 3;
+
+	// Intersects the ray with the triangles in indices[0, count), with the SIMD kernels. Returns the position in "indices"
+	// of the closest intersection within the ray interval (tmin, tmax), or -1 if there is none.
+	int rayIntersectionClosest(const specter::Ray& ray, const uint32_t* indices, const uint32_t count, float& u, float& v, float& t) const {
+		int closest = -1;
+		if (count < minPacketSize) {
+			// The scalar test writes the barycentric coordinates even if it misses
+			specter::Ray r(ray);
+			float uu, vv, tt;
+			for (uint32_t i = 0; i < count; ++i) {
+				if (rayIntersection(r, indices[i], uu, vv, tt)) {
+					r.tmax = t = tt;
+					u = uu;
+					v = vv;
+					closest = static_cast<int>(i);
+				}
+			}
+			return closest;
 		}
 
-		const float f = 1.f / a;
-		const specter::vec3f s = ray.o - v0;
-		u = f * specter::dot(s, q);
-
-		if (u < 0.f) return false;
+		return specter::GetSimdKernels().intersectTriangles(triangleTest, ray, faces.data(), vertices.data(), indices, count, u, v, t);
+	}
 
-		const specter::vec3f r = cross(s, e0);
-		v = f * specter::dot(ray.d, r);
+	// Returns true if the ray intersects any of the triangles in indices[0, count) within the ray interval
+	bool rayIntersectionAny(const specter::Ray& ray, const uint32_t* indices, const uint32_t count) const {
+		if (count < minPacketSize) {
+			float u, v, t;
+			for (uint32_t i = 0; i < count; ++i) {
+				if (rayIntersection(ray, indices[i], u, v, t)) {
+					return true;
+				}
+			}
+			return false;
+		}
 
-		if (v < 0.f || u + v > 1.f) return false;
+		return specter::GetSimdKernels().intersectTrianglesAny(triangleTest, ray, faces.data(), vertices.data(), indices, count);
+	}
 
-		t = f * specter::dot(e1, r);
-		return true;
+	// Fills the shading information of the intersection "its" with triangle "index" at the 
+	// barycentric coordinates (u, v). The distance its.t has to be set already.
+	void computeSurfaceInteraction(const std::size_t index, const float u, const float v, const specter::Ray& ray, specter::Intersection& its) const {
+		const specter::vec2f uv0 = uvs[faces[index * 3 + 0].t];
+		const specter::vec2f uv1 = uvs[faces[index * 3 + 1].t];
+		const specter::vec2f uv2 = uvs[faces[index * 3 + 2].t];
+
+		const float w = 1.f - u - v;
+		const specter::vec2f uv = w * uv0 + u * uv1 + v * uv2;
+		its.mat_ptr = GetMaterial(GetMeshIndexFromFace(index));
+		its.n = normals[faces[index * 3].n];
+		its.u = uv[0];
+		its.v = uv[1];
+		its.f = index;
+		its.p = ray.o + its.t * ray.d;
 	}
 
 protected:
@@ -228,6 +269,8 @@ protected:
 	std::vector<std::shared_ptr<specter::IMaterial>> materials;
 
 	specter::AxisAlignedBoundingBox bbox;
+
+	TriangleTest triangleTest = TriangleTest::MoellerTrumbore;
 };
 
 }
\ No newline at end of file
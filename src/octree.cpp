@@ -1,10 +1,16 @@
 #include "octree.hpp"
 
-#include <numeric>	// For std::iota
+#include <cstdio>	// For std::remove and std::rename
+#include <fstream>
+#include <numeric>	// For std::iota and std::accumulate
 
-#define nMaxRayAABBIntersections (4)
 #define nSubRegions (8)
 
+// Nodes referencing at least this many triangles build their children in parallel.
+#define nParallelBuildThreshold (1 << 14)
+// Nodes referencing at least this many triangles classify their triangles in parallel.
+#define nParallelClassifyThreshold (1 << 15)
+
 namespace helper {
 
 specter::vec2f normalizeTiling(const specter::vec2f& uv) {
@@ -89,149 +95,561 @@ static void constructSubRegion(const AxisAlignedBoundingBox& superRegion, sAABB*
 	minorRegion->maxz[i] = subregion.max.z;
 }
 
-// Constructs the k-th subregion of the i-th "superRegion" and stores the result in
-// the appropriate "minorRegion"
-static void constructSubRegion(const sAABB* superRegion, int i, sAABB* minorRegion, int k) {
+// Returns the i-th bounding box stored in "region"
+static AxisAlignedBoundingBox extractRegion(const sAABB& region, int i) {
+	return AxisAlignedBoundingBox(	vec3f(region.minx[i], region.miny[i], region.minz[i]),
+									vec3f(region.maxx[i], region.maxy[i], region.maxz[i]));
+}
 
-	auto bmin = vec3f(superRegion->minx[i], superRegion->miny[i], superRegion->minz[i]);
-	auto bmax = vec3f(superRegion->maxx[i], superRegion->maxy[i], superRegion->maxz[i]);
+// Stores "box" as the i-th bounding box of "region"
+static void storeRegion(const AxisAlignedBoundingBox& box, sAABB& region, int i) {
+	region.minx[i] = box.min.x;
+	region.miny[i] = box.min.y;
+	region.minz[i] = box.min.z;
 
-	vec3f hd = (bmax - bmin) / 2;	// Partitioning point
-	AxisAlignedBoundingBox subregion;
-	switch (k) {
-	case 0:
-		subregion.min = bmin;
-		subregion.max = bmin + hd;
-		break;
-	case 1:
-		subregion.min = vec3f(bmin.x + hd.x, bmin.y, bmin.z);
-		subregion.max = vec3f(bmax.x, bmin.y + hd.y, bmin.z + hd.z);
-		break;
-	case 2:
-		subregion.min = vec3f(bmin.x, bmin.y + hd.y, bmin.z);
-		subregion.max = vec3f(bmin.x + hd.x, bmax.y, bmin.z + hd.z);
-		break;
-	case 3:
-		subregion.min = vec3f(bmin.x + hd.x, bmin.y + hd.y, bmin.z);
-		subregion.max = vec3f(bmax.x, bmax.y, bmin.z + hd.z);
-		break;
-	case 4:
-		subregion.min = vec3f(bmin.x, bmin.y, bmin.z + hd.z);
-		subregion.max = vec3f(bmin.x + hd.x, bmin.y + hd.y, bmax.z);
-		break;
-	case 5:
-		subregion.min = vec3f(bmin.x + hd.x, bmin.y, bmin.z + hd.z);
-		subregion.max = vec3f(bmax.x, bmin.y + hd.y, bmax.z);
-		break;
-	case 6:
-		subregion.min = vec3f(bmin.x, bmin.y + hd.y, bmin.z + hd.z);
-		subregion.max = vec3f(bmin.x + hd.x, bmax.y, bmax.z);
-		break;
-	case 7:
-		subregion.min = vec3f(bmin.x + hd.x, bmin.y + hd.y, bmin.z + hd.z);
-		subregion.max = vec3f(bmax.x, bmax.y, bmax.z);
-		break;
-	default:
-		throw std::runtime_error("Subregion index outside range [0, 7]!");
-		break;
+	region.maxx[i] = box.max.x;
+	region.maxy[i] = box.max.y;
+	region.maxz[i] = box.max.z;
+}
+
+Octree::Octree()
+	: nBlockLeaves(0)
+	, maxDepth(0)
+	, leafThreshold(0)
+	, loose(false)
+{}
+
+Octree::~Octree() {}
+
+void Octree::build(std::shared_ptr<Model>& model, const OctreeParameters& parameters) {
+	AxisAlignedBoundingBox modelbox = model->computeBoundingBox();
+	const uint32_t nTriangles = model->GetTriangleCount();
+
+	// The first group only contains the root node. The remaining slots stay empty.
+	BuildFragment fragment;
+	fragment.nodes.resize(nSubRegions);
+	fragment.boxes.resize(1);
+	storeRegion(modelbox, fragment.boxes[0], 0);
+	loose = parameters.loose;
+	if (loose) {
+		fragment.interiorTriangles.resize(1);
 	}
 
-	minorRegion->minx[k] = subregion.min.x;
-	minorRegion->miny[k] = subregion.min.y;
-	minorRegion->minz[k] = subregion.min.z;
+	tbb::enumerable_thread_specific<ScratchArena> arenas;
+	const BuildContext context{ model->GetVertices(), model->GetFaces(), &arenas };
 
-	minorRegion->maxx[k] = subregion.max.x;
-	minorRegion->maxy[k] = subregion.max.y;
-	minorRegion->maxz[k] = subregion.max.z;
-}
+	// The triangle indices list is initialized with [0, 1, ..., nTriangles - 1];
+	// This corresponds to the position of faces in the faces array of the model.
+	uint32_t* initialIndexList = arenas.local().allocate<uint32_t>(nTriangles);
+	std::iota(initialIndexList, initialIndexList + nTriangles, 0);
 
-void Octree::Node::CreateValidNode(const sAABB* superRegion, int superRegionIdx, const std::size_t TriangleSize) {
-	nTriangles = TriangleSize;
-	subboxes = new sAABB;
-	for (int k = 0; k < nSubRegions; ++k) {
-		constructSubRegion(superRegion, superRegionIdx, subboxes, k);
+	// Each leaf holds at least one triangle reference.
+	fragment.triIndices.reserve(nTriangles);
+
+	maxDepth = parameters.maxDepth < 0 ? log8(nTriangles) : parameters.maxDepth;
+	leafThreshold = parameters.leafThreshold;
+	buildRec(fragment, context, 0, modelbox, initialIndexList, nTriangles, 0);
+
+	if (fragment.subtrees.empty()) {
+		storage.nodes = std::move(fragment.nodes);
+		storage.boxes = std::move(fragment.boxes);
+		storage.triIndices = std::move(fragment.triIndices);
+		storage.interiorTriangles = std::move(fragment.interiorTriangles);
+	} else {
+		linearize(fragment);
+	}
+
+	storage.triangleBlocks.clear();
+	nBlockLeaves = 0;
+	if (parameters.triangleBlockBudget > 0) {
+		buildTriangleBlocks(model.get(), parameters.triangleBlockBudget);
 	}
+
+	mappedFile.reset();
+	bindStorage();
+}
+
+void Octree::bindStorage() {
+	nodes = storage.nodes;
+	boxes = storage.boxes;
+	triIndices = storage.triIndices;
+	interiorTriangles = storage.interiorTriangles;
+	triangleBlocks = storage.triangleBlocks;
 }
 
-Octree::Octree() {
-	root = nullptr;
+// Header of the cache file. It is followed by the arrays of the octree, which are aligned to cache lines.
+// The version has to be incremented whenever the layout of the file or of the stored structures changes.
+#define cacheFileVersion (2)
+#define cacheFileAlignment (64)
+
+struct OctreeCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t structureSizes;	// Size of the node, box and triangle block structures, one byte each.
+	uint64_t key;
+	uint64_t maxDepth;
+	uint64_t nBlockLeaves;
+	uint32_t leafThreshold;
+	uint32_t loose;
+	// Position in bytes and number of elements of the nodes, boxes, triangle indices,
+	// interior triangles and triangle blocks.
+	uint64_t offsets[5];
+	uint64_t counts[5];
+};
+
+static const char cacheFileMagic[8] = { 'S', 'P', 'C', 'T', 'R', 'O', 'C', 'T' };
+
+template<typename N, typename B, typename T>
+static constexpr uint32_t cacheStructureSizes() {
+	return sizeof(N) | (sizeof(B) << 8) | (sizeof(T) << 16);
 }
 
-Octree::~Octree() {
-	freeOctreeRec(root);
+void Octree::save(const std::string& filename, const uint64_t key) const {
+	OctreeCacheHeader header = {};
+	std::copy(std::begin(cacheFileMagic), std::end(cacheFileMagic), header.magic);
+	header.version = cacheFileVersion;
+	header.structureSizes = cacheStructureSizes<Node, sAABB, sTriangle>();
+	header.key = key;
+	header.maxDepth = maxDepth;
+	header.nBlockLeaves = nBlockLeaves;
+	header.leafThreshold = leafThreshold;
+	header.loose = loose;
+
+	const std::pair<const void*, std::size_t> arrays[5] = {
+		{ nodes.data(), nodes.size() * sizeof(Node) },
+		{ boxes.data(), boxes.size() * sizeof(sAABB) },
+		{ triIndices.data(), triIndices.size() * sizeof(uint32_t) },
+		{ interiorTriangles.data(), interiorTriangles.size() * sizeof(Node) },
+		{ triangleBlocks.data(), triangleBlocks.size() * sizeof(sTriangle) }
+	};
+	const std::size_t counts[5] = { nodes.size(), boxes.size(), triIndices.size(), interiorTriangles.size(), triangleBlocks.size() };
+
+	uint64_t position = sizeof(OctreeCacheHeader);
+	for (int i = 0; i < 5; ++i) {
+		position = (position + cacheFileAlignment - 1) & ~uint64_t(cacheFileAlignment - 1);
+		header.offsets[i] = position;
+		header.counts[i] = counts[i];
+		position += arrays[i].second;
+	}
+
+	// The file is written under a temporary name first, such that an interrupted
+	// write never leaves a truncated cache file behind.
+	const std::string tmpFilename = filename + ".tmp";
+	std::ofstream file(tmpFilename, std::ios::binary | std::ios::trunc);
+	if (file.fail()) {
+		throw std::runtime_error("Could not open cache file: " + tmpFilename);
+	}
+
+	const char padding[cacheFileAlignment] = {};
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	position = sizeof(OctreeCacheHeader);
+	for (int i = 0; i < 5; ++i) {
+		file.write(padding, header.offsets[i] - position);
+		file.write(static_cast<const char*>(arrays[i].first), arrays[i].second);
+		position = header.offsets[i] + arrays[i].second;
+	}
+	file.close();
+
+	if (file.fail()) {
+		std::remove(tmpFilename.c_str());
+		throw std::runtime_error("Could not write cache file: " + tmpFilename);
+	}
+
+	std::remove(filename.c_str());
+	if (std::rename(tmpFilename.c_str(), filename.c_str()) != 0) {
+		std::remove(tmpFilename.c_str());
+		throw std::runtime_error("Could not write cache file: " + filename);
+	}
 }
 
-void Octree::build(std::shared_ptr<Model>& model) {
-	root = new Node;
+bool Octree::load(const std::string& filename, const uint64_t key) {
+	if (std::ifstream(filename, std::ios::binary).fail()) {
+		return false;
+	}
 
-	AxisAlignedBoundingBox modelbox = model->computeBoundingBox();
-	
-	root->nTriangles = model->GetTriangleCount();
-	root->subboxes = new sAABB;
-	for (int i = 0; i < nSubRegions; ++i) {
-		constructSubRegion(modelbox, root->subboxes, i);
+	// A cache file, that can't be mapped, is treated like an outdated one.
+	std::shared_ptr<MappedFile> file;
+	try {
+		file = std::make_shared<MappedFile>(filename);
+	} catch (const std::runtime_error&) {
+		return false;
 	}
 
-	// The triangle indices list is initialized with [0, 1, ..., nTriangles - 1];
-	// This corresponds to the position of faces in the faces array of the model.
-	std::vector<uint32_t> initialIndexList(root->nTriangles);
-	std::iota(initialIndexList.begin(), initialIndexList.end(), 0);
+	if (file->size() < sizeof(OctreeCacheHeader)) {
+		return false;
+	}
 
-	maxDepth = log8(root->nTriangles);
-	buildRec(root, model->GetVertices(), model->GetFaces(), initialIndexList.data(), 0);
+	OctreeCacheHeader header;
+	std::memcpy(&header, file->data(), sizeof(header));
+	if (	!std::equal(std::begin(cacheFileMagic), std::end(cacheFileMagic), header.magic)
+		||	header.version != cacheFileVersion
+		||	header.structureSizes != cacheStructureSizes<Node, sAABB, sTriangle>()
+		||	header.key != key
+		||	header.counts[0] < nSubRegions)
+	{
+		return false;
+	}
+
+	const std::size_t elementSizes[5] = { sizeof(Node), sizeof(sAABB), sizeof(uint32_t), sizeof(Node), sizeof(sTriangle) };
+	for (int i = 0; i < 5; ++i) {
+		if (	header.offsets[i] % cacheFileAlignment != 0
+			||	header.offsets[i] > file->size()
+			||	header.counts[i] > (file->size() - header.offsets[i]) / elementSizes[i])
+		{
+			return false;
+		}
+	}
+
+	auto view = [&](const int i) {
+		return file->data() + header.offsets[i];
+	};
+
+	storage = Storage();
+	nodes = ArrayView<Node>(reinterpret_cast<const Node*>(view(0)), header.counts[0]);
+	boxes = ArrayView<sAABB>(reinterpret_cast<const sAABB*>(view(1)), header.counts[1]);
+	triIndices = ArrayView<uint32_t>(reinterpret_cast<const uint32_t*>(view(2)), header.counts[2]);
+	interiorTriangles = ArrayView<Node>(reinterpret_cast<const Node*>(view(3)), header.counts[3]);
+	triangleBlocks = ArrayView<sTriangle>(reinterpret_cast<const sTriangle*>(view(4)), header.counts[4]);
+	maxDepth = header.maxDepth;
+	nBlockLeaves = header.nBlockLeaves;
+	leafThreshold = header.leafThreshold;
+	loose = header.loose != 0;
+	mappedFile = std::move(file);
+	return true;
 }
 
-void Octree::buildRec(Node* node, const vec3f* vertices, const FaceElement* faces, const uint32_t* trianglePositions, int depth) {
-	if (node->nTriangles == 0) {
+void Octree::buildRec(	BuildFragment& fragment, const BuildContext& context, const uint32_t nodeIdx, const AxisAlignedBoundingBox& region,
+						const uint32_t* trianglePositions, const uint32_t nTriangles, int depth) const
+{
+	// Sub regions that are empty are invalidated. They are neither internal nor leaf nodes.
+	if (nTriangles == 0) {
+		fragment.nodes[nodeIdx].offset = 0;
+		fragment.nodes[nodeIdx].nTriangles = 0;
 		return;
 	}
 
 	// This is the termination condition for the recursive building function.
-	// The node->tri_indices array is now no longer nullptr. This fact, is used
-	// to identify that a node is a leaf node.
-	if (node->nTriangles <= 10 || depth > maxDepth) {
-		node->tri_indices = new uint32_t[node->nTriangles];
-		std::memcpy(node->tri_indices, trianglePositions, sizeof(uint32_t) * node->nTriangles);
+	// The triangle indices are appended to the shared index pool and the node 
+	// stores its position inside of the pool.
+	if (nTriangles <= leafThreshold || static_cast<std::size_t>(depth) > maxDepth) {
+		fragment.nodes[nodeIdx].offset = fragment.triIndices.size();
+		fragment.nodes[nodeIdx].nTriangles = nTriangles;
+		fragment.triIndices.insert(fragment.triIndices.end(), trianglePositions, trianglePositions + nTriangles);
 		return;
 	}
 
-	// Determine the number of triangles that are within a subregion and 
-	// store the result inside of the array. We compute the minimal bounding box 
-	// of the triangle and test for overlap with the bounding box of 
-	// the subregion to determine whether it belongs to the subregion or not.
+	sAABB subboxes;
+	for (int k = 0; k < nSubRegions; ++k) {
+		constructSubRegion(region, &subboxes, k);
+	}
+
+	// The triangle lists of the children are stored in the scratch arena of this thread.
+	// They are released once the subtree is built, so that the memory is reused by the 
+	// next node on this level.
+	ScratchArena& arena = context.arenas->local();
+	const ScratchArena::Marker marker = arena.GetMarker();
+
+	// Determine the subregions a triangle is part of and store the result as
+	// a bitmask. We compute the minimal bounding box of the triangle and test 
+	// for overlap with the bounding box of the subregion to determine whether 
+	// it belongs to the subregion or not. Simultaneously, the number of 
+	// triangles per subregion is counted.
 	// Note, triangles that span multiple subregions belong to all of those
-	// subregions.
-	std::vector<std::vector<uint32_t>> subRegionTriangleCounts(nSubRegions);
-	for (int i = 0; i < node->nTriangles; i++) {
-		uint32_t i0 = faces[trianglePositions[i] * 3 + 0].p;
-		uint32_t i1 = faces[trianglePositions[i] * 3 + 1].p;
-		uint32_t i2 = faces[trianglePositions[i] * 3 + 2].p;
-		vec3f v0 = vertices[i0], v1 = vertices[i1], v2 = vertices[i2];
-		const vec3f tmin = minComponents(v0, v1, v2);
-		const vec3f tmax = maxComponents(v0, v1, v2);
-
-		const AxisAlignedBoundingBox triangleAABB(tmin, tmax);
+	// subregions. In a loose octree, a triangle belongs to the single subregion
+	// containing its centroid instead, provided that it is not larger than the 
+	// subregion. The bounds of the subregion are enlarged to the bounds of its
+	// triangles, which extend at most half the size of the subregion beyond it. 
+	// Larger triangles are stored in the node itself.
+	struct SubRegionClassification {
+		std::array<uint32_t, nSubRegions> counts = {};
+		// Bounds of the triangles of each subregion. Only maintained by the loose octree.
+		vec3f boundsMin[nSubRegions], boundsMax[nSubRegions];
+
+		SubRegionClassification() {
+			std::fill(std::begin(boundsMin), std::end(boundsMin), vec3f(std::numeric_limits<float>::max()));
+			std::fill(std::begin(boundsMax), std::end(boundsMax), vec3f(std::numeric_limits<float>::lowest()));
+		}
+	};
+
+	const vec3f center = region.center();
+	const vec3f subRegionSize = (region.max - region.min) * 0.5f;
+	uint8_t* subRegionMasks = arena.allocate<uint8_t>(nTriangles);
+	auto classifyTriangles = [&](const uint32_t begin, const uint32_t end, SubRegionClassification& classification) {
+		for (uint32_t i = begin; i < end; ++i) {
+			uint32_t i0 = context.faces[trianglePositions[i] * 3 + 0].p;
+			uint32_t i1 = context.faces[trianglePositions[i] * 3 + 1].p;
+			uint32_t i2 = context.faces[trianglePositions[i] * 3 + 2].p;
+			vec3f v0 = context.vertices[i0], v1 = context.vertices[i1], v2 = context.vertices[i2];
+			const vec3f tmin = minComponents(v0, v1, v2);
+			const vec3f tmax = maxComponents(v0, v1, v2);
+
+			if (loose) {
+				const vec3f extent = tmax - tmin;
+				if (extent.x > subRegionSize.x || extent.y > subRegionSize.y || extent.z > subRegionSize.z) {
+					subRegionMasks[i] = 0;
+					continue;
+				}
+				// The subregion index encodes the half of each axis, see constructSubRegion()
+				const vec3f centroid = (tmin + tmax) * 0.5f;
+				const int k = (centroid.x >= center.x ? 1 : 0) | (centroid.y >= center.y ? 2 : 0) | (centroid.z >= center.z ? 4 : 0);
+				classification.boundsMin[k] = minComponent(classification.boundsMin[k], tmin);
+				classification.boundsMax[k] = maxComponent(classification.boundsMax[k], tmax);
+				classification.counts[k]++;
+				subRegionMasks[i] = 1 << k;
+				continue;
+			}
+
+			const AxisAlignedBoundingBox triangleAABB(tmin, tmax);
+			uint8_t mask = 0;
+			for (int k = 0; k < nSubRegions; ++k) {
+				if (subboxes.overlapsEdgeInclusive(triangleAABB, k)) {
+					mask |= 1 << k;
+					classification.counts[k]++;
+				}
+			}
+			subRegionMasks[i] = mask;
+		}
+	};
+
+	SubRegionClassification classification;
+	if (nTriangles >= nParallelClassifyThreshold) {
+		classification = tbb::parallel_reduce(tbb::blocked_range<uint32_t>(0, nTriangles), SubRegionClassification(),
+			[&](const tbb::blocked_range<uint32_t>& r, SubRegionClassification c) {
+				classifyTriangles(r.begin(), r.end(), c);
+				return c;
+			},
+			[](SubRegionClassification c0, const SubRegionClassification& c1) {
+				for (int k = 0; k < nSubRegions; ++k) {
+					c0.counts[k] += c1.counts[k];
+					c0.boundsMin[k] = minComponent(c0.boundsMin[k], c1.boundsMin[k]);
+					c0.boundsMax[k] = maxComponent(c0.boundsMax[k], c1.boundsMax[k]);
+				}
+				return c0;
+			});
+	} else {
+		classifyTriangles(0, nTriangles, classification);
+	}
+	const auto& subRegionCounts = classification.counts;
+
+	// Triangles that do not fit into any subregion of a loose octree stay in this node.
+	// If no triangle fits, the node becomes a leaf.
+	uint32_t nNodeTriangles = 0;
+	if (loose) {
+		nNodeTriangles = nTriangles - std::accumulate(subRegionCounts.begin(), subRegionCounts.end(), 0u);
+		if (nNodeTriangles == nTriangles) {
+			arena.release(marker);
+			fragment.nodes[nodeIdx].offset = fragment.triIndices.size();
+			fragment.nodes[nodeIdx].nTriangles = nTriangles;
+			fragment.triIndices.insert(fragment.triIndices.end(), trianglePositions, trianglePositions + nTriangles);
+			return;
+		}
+	}
+
+	// The children of a loose octree keep subdividing their regular subregion, 
+	// whereas the enlarged bounds are used for ray traversal.
+	sAABB childBoxes = subboxes;
+	if (loose) {
 		for (int k = 0; k < nSubRegions; ++k) {
-			if (node->subboxes->overlapsEdgeInclusive(triangleAABB, k)) {
-				subRegionTriangleCounts[k].push_back(trianglePositions[i]);
+			if (subRegionCounts[k] > 0) {
+				storeRegion(AxisAlignedBoundingBox(classification.boundsMin[k], classification.boundsMax[k]), childBoxes, k);
 			}
 		}
 	}
 
-	node->m_children = new Node[nSubRegions];
-	for (int i = 0; i < nSubRegions; ++i) {
-		if (subRegionTriangleCounts[i].size() != 0) {
-			node->m_children[i].CreateValidNode(node->subboxes, i, subRegionTriangleCounts[i].size());
-			buildRec(&node->m_children[i], vertices, faces, subRegionTriangleCounts[i].data(), depth + 1);
-		} else {
-			// Sub regions that are empty are invalidated. They are neither internal nor leaf nodes.
-			node->m_children[i].CreateInvalidNode();
+	// Scatter the triangles into a single array, in which the triangles of a 
+	// subregion are stored consecutively.
+	uint32_t subRegionOffsets[nSubRegions + 1];
+	subRegionOffsets[0] = 0;
+	for (int k = 0; k < nSubRegions; ++k) {
+		subRegionOffsets[k + 1] = subRegionOffsets[k] + subRegionCounts[k];
+	}
+
+	uint32_t* subRegionTriangles = arena.allocate<uint32_t>(subRegionOffsets[nSubRegions]);
+	uint32_t scatterPositions[nSubRegions];
+	std::copy(subRegionOffsets, subRegionOffsets + nSubRegions, scatterPositions);
+	Node nodeTriangles;
+	nodeTriangles.offset = fragment.triIndices.size();
+	nodeTriangles.nTriangles = nNodeTriangles;
+	for (uint32_t i = 0; i < nTriangles; ++i) {
+		if (loose && subRegionMasks[i] == 0) {
+			fragment.triIndices.push_back(trianglePositions[i]);
+			continue;
+		}
+		for (int k = 0; k < nSubRegions; ++k) {
+			if (subRegionMasks[i] & (1 << k)) {
+				subRegionTriangles[scatterPositions[k]++] = trianglePositions[i];
+			}
+		}
+	}
+
+	// Allocate the group of children. Note, that this may reallocate the node array,
+	// which is why nodes are only ever referred to by index during construction.
+	const uint32_t group = fragment.boxes.size();
+	fragment.boxes.push_back(childBoxes);
+	fragment.nodes.resize(fragment.nodes.size() + nSubRegions);
+	if (loose) {
+		fragment.interiorTriangles.push_back(nodeTriangles);
+	}
+
+	fragment.nodes[nodeIdx].offset = group;
+	fragment.nodes[nodeIdx].nTriangles = Node::InteriorTag;
+
+	if (nTriangles < nParallelBuildThreshold) {
+		for (int i = 0; i < nSubRegions; ++i) {
+			buildRec(fragment, context, group * nSubRegions + i, extractRegion(subboxes, i),
+				subRegionTriangles + subRegionOffsets[i], subRegionCounts[i], depth + 1);
+		}
+	} else {
+		// Large subtrees are built concurrently, each one into its own fragment. 
+		// The fragments are linked to this fragment and copied to their final 
+		// location once the construction is finished.
+		std::unique_ptr<BuildFragment> subtrees[nSubRegions];
+		tbb::parallel_for(0, nSubRegions, [&](const int i) {
+			subtrees[i] = std::make_unique<BuildFragment>();
+			subtrees[i]->nodes.resize(nSubRegions);
+			subtrees[i]->boxes.resize(1);
+			subtrees[i]->interiorTriangles.resize(loose ? 1 : 0);
+			storeRegion(extractRegion(childBoxes, i), subtrees[i]->boxes[0], 0);
+			buildRec(*subtrees[i], context, 0, extractRegion(subboxes, i),
+				subRegionTriangles + subRegionOffsets[i], subRegionCounts[i], depth + 1);
+		});
+
+		for (int i = 0; i < nSubRegions; ++i) {
+			fragment.subtrees.emplace_back(group * nSubRegions + i, std::move(subtrees[i]));
+		}
+	}
+
+	arena.release(marker);
+}
+
+void Octree::linearize(const BuildFragment& root) {
+	// Describes where the groups and triangle indices of a fragment are copied to.
+	// The first group of a linked fragment only holds its root, which takes the place of
+	// the node it is linked to. Therefore, only the root fragment copies its first group.
+	struct Placement {
+		const BuildFragment* fragment;
+		uint32_t groupOffset;
+		uint32_t triangleOffset;
+		uint32_t firstGroup;
+	};
+
+	auto relocate = [](Node node, const Placement& placement) {
+		if (node.IsInterior()) {
+			node.offset += placement.groupOffset;
+		} else if (node.IsLeaf()) {
+			node.offset += placement.triangleOffset;
+		}
+		return node;
+	};
+
+	std::vector<Placement> placements;
+	std::vector<std::pair<uint32_t, std::size_t>> links;	// [Final node index, placement of the linked fragment]
+	uint32_t nGroups = root.boxes.size();
+	uint32_t nTriIndices = root.triIndices.size();
+	placements.push_back({ &root, 0, 0, 0 });
+
+	for (std::size_t p = 0; p < placements.size(); ++p) {
+		const Placement parent = placements[p];
+		for (const auto& [nodeIdx, subtree] : parent.fragment->subtrees) {
+			const uint32_t finalNodeIdx = (nodeIdx / nSubRegions + parent.groupOffset) * nSubRegions + nodeIdx % nSubRegions;
+			links.emplace_back(finalNodeIdx, placements.size());
+			placements.push_back({ subtree.get(), nGroups - 1, nTriIndices, 1 });
+			nGroups += subtree->boxes.size() - 1;
+			nTriIndices += subtree->triIndices.size();
+		}
+	}
+
+	storage.nodes.resize(static_cast<std::size_t>(nGroups) * nSubRegions);
+	storage.boxes.resize(nGroups);
+	storage.triIndices.resize(nTriIndices);
+	storage.interiorTriangles.resize(loose ? nGroups : 0);
+
+	tbb::parallel_for(std::size_t(0), placements.size(), [&](const std::size_t p) {
+		const Placement& placement = placements[p];
+		const BuildFragment& fragment = *placement.fragment;
+		for (uint32_t g = placement.firstGroup; g < fragment.boxes.size(); ++g) {
+			storage.boxes[g + placement.groupOffset] = fragment.boxes[g];
+			if (loose) {
+				storage.interiorTriangles[g + placement.groupOffset] = relocate(fragment.interiorTriangles[g], placement);
+			}
+			for (int k = 0; k < nSubRegions; ++k) {
+				storage.nodes[(g + placement.groupOffset) * nSubRegions + k] = relocate(fragment.nodes[g * nSubRegions + k], placement);
+			}
+		}
+		std::copy(fragment.triIndices.begin(), fragment.triIndices.end(), storage.triIndices.begin() + placement.triangleOffset);
+	});
+
+	for (const auto& [nodeIdx, p] : links) {
+		storage.nodes[nodeIdx] = relocate(placements[p].fragment->nodes[0], placements[p]);
+	}
+}
+
+void Octree::buildTriangleBlocks(const Model* model, const std::size_t budget) {
+	// The triangle lists of interior nodes of a loose octree are treated like leaves.
+	std::vector<Node*> leaves;
+	for (Node& node : storage.nodes) {
+		if (node.IsLeaf()) {
+			leaves.push_back(&node);
+		}
+	}
+	for (Node& node : storage.interiorTriangles) {
+		if (node.IsLeaf()) {
+			leaves.push_back(&node);
+		}
+	}
+
+	// Large leaves profit the most from the streaming layout, hence they are converted first.
+	std::stable_sort(leaves.begin(), leaves.end(), [](const Node* a, const Node* b) {
+		return a->nTriangles > b->nTriangles;
+	});
+
+	const std::size_t nMaxBlocks = budget / sizeof(sTriangle);
+	std::vector<std::pair<Node*, uint32_t>> blockLeaves;	// [Leaf, first block]
+	uint32_t nBlocks = 0;
+	for (Node* leaf : leaves) {
+		const uint32_t nLeafBlocks = (leaf->nTriangles + 7) / 8;
+		if (nBlocks + nLeafBlocks <= nMaxBlocks) {
+			blockLeaves.emplace_back(leaf, nBlocks);
+			nBlocks += nLeafBlocks;
+		}
+	}
+
+	storage.triangleBlocks.resize(nBlocks);
+	tbb::parallel_for(std::size_t(0), blockLeaves.size(), [&](const std::size_t i) {
+		const Node& node = *blockLeaves[i].first;
+		const uint32_t* tri_indices = storage.triIndices.data() + node.offset;
+		for (uint32_t k = 0; k < node.nTriangles; ++k) {
+			const vec3f p0 = model->GetVertex(model->GetFace(tri_indices[k] * 3 + 0).p);
+			const vec3f p1 = model->GetVertex(model->GetFace(tri_indices[k] * 3 + 1).p);
+			const vec3f p2 = model->GetVertex(model->GetFace(tri_indices[k] * 3 + 2).p);
+			storage.triangleBlocks[blockLeaves[i].second + k / 8].store(k % 8, tri_indices[k], p0, p1, p2);
+		}
+	});
+
+	for (const auto& [leaf, firstBlock] : blockLeaves) {
+		leaf->offset = firstBlock;
+		leaf->nTriangles |= Node::BlockTag;
+	}
+	nBlockLeaves = blockLeaves.size();
+
+	// Compact the index pool, such that it only holds the indices of the remaining leaves.
+	std::vector<uint32_t> remainingIndices;
+	for (Node* node : leaves) {
+		if (!node->HasTriangleBlocks()) {
+			const uint32_t offset = remainingIndices.size();
+			remainingIndices.insert(remainingIndices.end(), storage.triIndices.begin() + node->offset, storage.triIndices.begin() + node->offset + node->nTriangles);
+			node->offset = offset;
 		}
 	}
+	storage.triIndices = std::move(remainingIndices);
+	storage.triIndices.shrink_to_fit();
 }
 
 bool Octree::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
-	traverseRec(model, root, ray, intersection);
+	// The interval of the local ray is shrunk, whenever a closer intersection is found.
+	Ray r(ray);
+	r.tmax = std::min(ray.tmax, intersection.t);
+	traverseRec(model, 0, r, intersection);
 	return intersection.t != std::numeric_limits<float>::max();
 }
 
@@ -273,53 +691,59 @@ static void sortIDP_swap(IndexDistancePair* ptr, const uint32_t num)
 	}
 }
 
-void Octree::computeTriangleIntersections(const Model* model, Node* node, const Ray& ray, Intersection& its) const {
-	float u, v, t = std::numeric_limits<float>::max();
-	float best_u = t, best_v = t;
-	int best_i = -1;
-	for (int i = 0; i < node->nTriangles; ++i) {
-		if (model->rayIntersection(ray, node->tri_indices[i], u, v, t)) {
-			if (its.t > t && t > 0.f) {
-				its.t = t;
-				best_u = u;
-				best_v = v;
-				best_i = i;
-			}
+void Octree::computeTriangleIntersections(const Model* model, const Node& node, Ray& ray, Intersection& its) const {
+	float u, v, t;
+	uint32_t best_index = sTriangle::InvalidIndex;
+	if (node.HasTriangleBlocks()) {
+		// The triangles are read sequentially from the blocks of the leaf and tested as many at a time as the
+		// SIMD level has lanes. Padding lanes of the last block are degenerate and never hit.
+		const sTriangle* blocks = triangleBlocks.data() + node.offset;
+		const uint32_t nBlocks = (node.GetTriangleCount() + 7) / 8;
+		const int lane = GetSimdKernels().intersectBlocks(model->GetTriangleTest(), ray, blocks, nBlocks, u, v, t);
+		if (lane >= 0) {
+			ray.tmax = t;
+			its.t = t;
+			best_index = blocks[lane / 8].indices[lane % 8];
+		}
+	} else {
+		// Only intersections closer than the current closest intersection are reported
+		const uint32_t* tri_indices = triIndices.data() + node.offset;
+		const int i = model->rayIntersectionClosest(ray, tri_indices, node.GetTriangleCount(), u, v, t);
+		if (i >= 0) {
+			ray.tmax = t;
+			its.t = t;
+			best_index = tri_indices[i];
 		}
 	}
-	if (best_i != -1) {
-		vec2f uv0 = model->GetUV(model->GetFace(node->tri_indices[best_i] * 3).t);
-		vec2f uv1 = model->GetUV(model->GetFace(node->tri_indices[best_i] * 3 + 1).t);
-		vec2f uv2 = model->GetUV(model->GetFace(node->tri_indices[best_i] * 3 + 2).t);
-
-		const float w = 1.f - best_u - best_v;
-		const vec2f uv = w * uv0 + best_u * uv1 + best_v * uv2;
-		auto meshIndex = model->GetMeshIndexFromFace(node->tri_indices[best_i]);
-		its.mat_ptr = model->GetMaterial(meshIndex);
-		its.n = model->GetNormal(model->GetFace(node->tri_indices[best_i] * 3).n);
-		its.u = uv[0];
-		its.v = uv[1];
-		its.f = node->tri_indices[best_i];
-		its.p = ray.o + its.t * ray.d;
-		vec3f np = normalize(its.p);
+	if (best_index != sTriangle::InvalidIndex) {
+		model->computeSurfaceInteraction(best_index, u, v, ray, its);
 	}
 }
 
-void Octree::traverseRec(const Model* model, Node* node, const Ray& ray, Intersection& intersection, bool multipleBoxesHit) const {
-	if (node->m_children == nullptr) {
+void Octree::traverseRec(const Model* model, const uint32_t nodeIdx, Ray& ray, Intersection& intersection) const {
+	const Node& node = nodes[nodeIdx];
+	if (!node.IsInterior()) {
 		computeTriangleIntersections(model, node, ray, intersection);
 		return;
 	}
 	
+	// Triangles of a loose octree, which are too large for any of the children, are stored in the node itself.
+	if (loose) {
+		computeTriangleIntersections(model, interiorTriangles[node.offset], ray, intersection);
+	}
+
+	const sAABB& subboxes = boxes[node.offset];
+	const uint32_t firstChild = node.offset * nSubRegions;
+
 	IndexDistancePair distanceToBoxes[nSubRegions];
 	alignas(32) float nearT[nSubRegions];
 	alignas(32) float farT[nSubRegions];
 	for (int i = 0; i < nSubRegions; ++i) {
-		nearT[i] = std::numeric_limits<float>::min();
-		farT[i] = std::numeric_limits<float>::max();
+		nearT[i] = ray.tmin;
+		farT[i] = ray.tmax;
 	}
 
-	node->subboxes->rayIntersect(ray, nearT, farT);
+	subboxes.rayIntersect(ray, nearT, farT);
 
 	for (int i = 0; i < nSubRegions; ++i) {
 		if (nearT[i] <= farT[i]) {
@@ -332,144 +756,176 @@ void Octree::traverseRec(const Model* model, Node* node, const Ray& ray, Interse
 	// to perform a sorted descend.
 	std::sort(std::begin(distanceToBoxes), std::end(distanceToBoxes));
 
-	for (int i = 0; i < nMaxRayAABBIntersections; ++i) {
-		if (distanceToBoxes[i].isValid()) {
-			// In case a ray intersects two bounding boxes at the same point, the ray will 
-			// only exit one of the boxes. We can find that out by repeating the 
-			// intersection test on either of the boxes and reading the far value.
-			// If the far value is not FLOAT_MAX, then that means the ray has entered
-			// and exited the bounding box. The other bounding box doesn't have to be considered
-			// at that point.
-			if (distanceToBoxes[i].distance == distanceToBoxes[i + 1].distance) {
-				float near, far;
-				node->subboxes->rayIntersect(ray, near, far, i);
-				int j = i;
-				if (far == std::numeric_limits<float>::max()) {
-					++j;
-				}
+	for (int i = 0; i < nSubRegions && distanceToBoxes[i].isValid(); ++i) {
+		// Sub-regions are visited front to back. Once the ray enters a sub-region behind
+		// the closest intersection found so far, none of the remaining sub-regions can 
+		// contain a closer intersection.
+		if (distanceToBoxes[i].distance > ray.tmax) {
+			break;
+		}
 
-				if (node->m_children[distanceToBoxes[j].index].IsInterior()) {
-					traverseRec(model, &node->m_children[distanceToBoxes[j].index], ray, intersection);
-				} else {
-					computeTriangleIntersections(model, &node->m_children[distanceToBoxes[j].index], ray, intersection);
-				}
-				// We can skip the bounding box the ray is not entering by incrementing the 
-				// loop counter.
-				++i;
-			} else {
-				if (node->m_children[distanceToBoxes[i].index].IsInterior()) {
-					traverseRec(model, &node->m_children[distanceToBoxes[i].index], ray, intersection);
-				} else {
-					computeTriangleIntersections(model, &node->m_children[distanceToBoxes[i].index], ray, intersection);
-				}
-			}
+		const uint32_t childIdx = firstChild + distanceToBoxes[i].index;
+		if (nodes[childIdx].IsInterior()) {
+			traverseRec(model, childIdx, ray, intersection);
 		} else {
-			// We can stop now, since subsequent distances will be MAX_FLOAT as well.
-			break;
+			computeTriangleIntersections(model, nodes[childIdx], ray, intersection);
 		}
 	}
 }
 
 bool Octree::traverseAny(const Model* model, const Ray& ray) const {
-	bool intersectionFound = false;
-	traverseAnyRec(model, root, ray, intersectionFound);
-	return intersectionFound;
+	return traverseAnyRec(model, 0, ray);
 }
 
-void Octree::traverseAnyRec(const Model* model, Node* node, const Ray& ray, bool& intersectionFound) const {
-	if (node == nullptr) {
-		return;
+bool Octree::intersectsAnyTriangle(const Model* model, const Node& node, const Ray& ray) const {
+	if (node.HasTriangleBlocks()) {
+		const sTriangle* blocks = triangleBlocks.data() + node.offset;
+		const uint32_t nBlocks = (node.GetTriangleCount() + 7) / 8;
+		return GetSimdKernels().intersectBlocksAny(model->GetTriangleTest(), ray, blocks, nBlocks);
 	}
 
-	// Any triangle found, therefore further processing can stop.
-	if (intersectionFound) {
-		return;
+	// Intersections outside of the ray interval are not reported. In particular,
+	// rays with origins inside the space represented by the octree can collide
+	// with objects that are in opposite direction of the ray direction vector.
+	// We don't want to consider this case at all.
+	return model->rayIntersectionAny(ray, triIndices.data() + node.offset, node.GetTriangleCount());
+}
+
+bool Octree::traverseAnyRec(const Model* model, const uint32_t nodeIdx, const Ray& ray) const {
+	const Node& node = nodes[nodeIdx];
+	if (!node.IsInterior()) {
+		return node.IsLeaf() && intersectsAnyTriangle(model, node, ray);
 	}
 
-	if (node->tri_indices != nullptr) {
-		for (int i = 0; i < node->nTriangles; ++i) {
-			float uu, vv, tt;
-			if (model->rayIntersection(ray, node->tri_indices[i], uu, vv, tt)) {
-				// Rays with origins inside the space represented by the octree can 
-				// have intersections with geometry, where the ray parameter is negative.
-				// This occurs, when the ray is colliding with objects that are in opposite 
-				// direction of the ray direction vector. 
-				// We don't want to consider this case at all.
-				if (tt > 0.f) {
-					intersectionFound = true;
-				}
-			}
+	if (loose && intersectsAnyTriangle(model, interiorTriangles[node.offset], ray)) {
+		return true;
+	}
+
+	const uint32_t firstChild = node.offset * nSubRegions;
+
+	alignas(32) float nearT[nSubRegions];
+	alignas(32) float farT[nSubRegions];
+	for (int i = 0; i < nSubRegions; ++i) {
+		nearT[i] = ray.tmin;
+		farT[i] = ray.tmax;
+	}
+
+	boxes[node.offset].rayIntersect(ray, nearT, farT);
+
+	// Gather the non-empty sub-regions hit by the ray. They are visited front to back,
+	// because occluders close to the ray origin are more likely to be hit.
+	IndexDistancePair hitBoxes[nSubRegions];
+	uint32_t nHitBoxes = 0;
+	for (int i = 0; i < nSubRegions; ++i) {
+		if (nearT[i] <= farT[i] && nodes[firstChild + i].IsValid()) {
+			hitBoxes[nHitBoxes].index = i;
+			hitBoxes[nHitBoxes].distance = nearT[i];
+			++nHitBoxes;
 		}
 	}
 
-	else {
-		if (node->m_children == nullptr) {
-			return;
+	sortIDP_swap(hitBoxes, nHitBoxes);
+
+	for (uint32_t i = 0; i < nHitBoxes; ++i) {
+		const uint32_t childIdx = firstChild + hitBoxes[i].index;
+		const bool occluded = nodes[childIdx].IsInterior()
+			? traverseAnyRec(model, childIdx, ray)
+			: intersectsAnyTriangle(model, nodes[childIdx], ray);
+
+		// Any triangle found, therefore further processing can stop.
+		if (occluded) {
+			return true;
 		}
+	}
 
-		for (int i = 0; i < nSubRegions; ++i) {
-			if (!node->m_children[i].IsLeaf()) {
-				float near, far;
-				if (node->subboxes->rayIntersect(ray, near, far, i)) {
-					traverseAnyRec(model, &node->m_children[i], ray, intersectionFound);
-				}
+	return false;
+}
+
+std::size_t Octree::GetReferenceCount() const {
+	std::size_t nReferences = 0;
+	for (const Node& node : nodes) {
+		if (node.IsLeaf()) {
+			nReferences += node.GetTriangleCount();
+		}
+	}
+	for (const Node& node : interiorTriangles) {
+		nReferences += node.GetTriangleCount();
+	}
+	return nReferences;
+}
+
+float Octree::ComputeExpectedRayCost() const {
+	// The probability that a ray hitting the root also hits a node is the ratio of their surface areas.
+	const float rootArea = extractRegion(boxes[0], 0).surfaceArea();
+	double cost = 0.0;
+	for (uint32_t g = 0; g < boxes.size(); ++g) {
+		for (int k = 0; k < nSubRegions; ++k) {
+			const Node& node = nodes[g * nSubRegions + k];
+			if (node.IsInterior()) {
+				const uint32_t nNodeTriangles = loose ? interiorTriangles[node.offset].GetTriangleCount() : 0;
+				cost += extractRegion(boxes[g], k).surfaceArea() * (costTraversal + costIntersection * nNodeTriangles);
+			} else if (node.IsLeaf()) {
+				cost += extractRegion(boxes[g], k).surfaceArea() * costIntersection * node.GetTriangleCount();
 			}
 		}
 	}
+	return rootArea > 0.f ? cost / rootArea : 0.f;
 }
 
-bool Octree::traverseAnyTmax(const Model* model, const Ray& ray, const float t_max) const {
-	bool intersectionFound = false;
-	traverseAnyTmaxRec(model, root, ray, t_max, intersectionFound);
-	return intersectionFound;
+std::size_t Octree::GetTriangleBlockMemory() const {
+	return triangleBlocks.size() * sizeof(sTriangle);
 }
 
-void Octree::traverseAnyTmaxRec(const Model* model, Node* node, const Ray& ray, const float t_max, bool& intersectionFound) const {
-	if (node == nullptr) {
-		return;
-	}
+std::size_t Octree::GetTriangleBlockLeafCount() const {
+	return nBlockLeaves;
+}
 
-	// Any triangle found, therefore further processing can stop.
-	if (intersectionFound) {
-		return;
-	}
+std::size_t Octree::GetLeafCount() const {
+	auto isLeaf = [](const Node& node) { return node.IsLeaf(); };
+	return std::count_if(nodes.begin(), nodes.end(), isLeaf) + std::count_if(interiorTriangles.begin(), interiorTriangles.end(), isLeaf);
+}
 
-	if (node->tri_indices != nullptr) {
-		for (int i = 0; i < node->nTriangles; ++i) {
-			float uu, vv, tt;
-			if (model->rayIntersection(ray, node->tri_indices[i], uu, vv, tt)) {
-				// Rays with origins inside the space represented by the octree can 
-				// have intersections with geometry, where the ray parameter is negative.
-				// This occurs, when the ray is colliding with objects that are in opposite 
-				// direction of the ray direction vector. 
-				// We don't want to consider this case at all.
-				if (tt > 0.f && tt < t_max) {
-					intersectionFound = true;
-				}
+std::size_t Octree::GetNodeCount() const {
+	return std::count_if(nodes.begin(), nodes.end(), [](const Node& node) { return node.IsValid(); });
+}
+
+std::size_t Octree::GetUniqueTriangleCount() const {
+	// The triangles of the leaves with triangle blocks have been removed from the index pool
+	std::vector<uint32_t> triangles(triIndices.begin(), triIndices.end());
+	for (const sTriangle& block : triangleBlocks) {
+		for (int i = 0; i < 8; ++i) {
+			if (block.indices[i] != sTriangle::InvalidIndex) {
+				triangles.push_back(block.indices[i]);
 			}
 		}
 	}
+	return countUniqueTriangles(triangles);
+}
 
-	else {
-		if (node->m_children == nullptr) {
-			return;
+LeafSizeHistogram Octree::GetLeafSizeHistogram() const {
+	LeafSizeHistogram histogram;
+	for (const Node& node : nodes) {
+		if (node.IsLeaf()) {
+			++histogram[node.GetTriangleCount()];
 		}
-
-		for (int i = 0; i < nSubRegions; ++i) {
-			if (!node->m_children[i].IsLeaf()) {
-				float near, far;
-				if (node->subboxes->rayIntersect(ray, near, far, i)) {
-					traverseAnyTmaxRec(model, &node->m_children[i], ray, t_max, intersectionFound);
-				}
-			}
+	}
+	for (const Node& node : interiorTriangles) {
+		if (node.IsLeaf()) {
+			++histogram[node.GetTriangleCount()];
 		}
 	}
+	return histogram;
+}
+
+std::size_t Octree::GetMemoryUsage() const {
+	return nodes.size() * sizeof(Node) + boxes.size() * sizeof(sAABB) + triIndices.size() * sizeof(uint32_t)
+		+ interiorTriangles.size() * sizeof(Node) + triangleBlocks.size() * sizeof(sTriangle);
 }
 
 void Octree::printNodesPerLayer() const {
 	unsigned maxDepth = GetMaxDepth();
 	std::unique_ptr<unsigned[]> breadths = std::make_unique<unsigned[]>(maxDepth + 1);
-	MaxBreadthTraversal(root, 0, breadths.get());
+	MaxBreadthTraversal(0, 0, breadths.get());
 	std::cout << "Output format: [Layer index, Nodes per layer]\n";
 	for (int i = 0; i < maxDepth; ++i) {
 		std::cout << "Layer " << i << ": " << breadths[i] << '\n';
@@ -479,7 +935,7 @@ void Octree::printNodesPerLayer() const {
 std::pair<Octree::layerIndex, int> Octree::GetMaxBreadth() const {
 	unsigned maxDepth = GetMaxDepth();
 	std::unique_ptr<unsigned[]> breadths = std::make_unique<unsigned[]>(maxDepth + 1);
-	MaxBreadthTraversal(root, 0, breadths.get());
+	MaxBreadthTraversal(0, 0, breadths.get());
 	unsigned widestLayer = 0;
 	unsigned maxBreadth = 0;
 	for (int i = 0; i < maxDepth; ++i) {
@@ -491,47 +947,37 @@ std::pair<Octree::layerIndex, int> Octree::GetMaxBreadth() const {
 	return { widestLayer, maxBreadth };
 }
 
-void Octree::MaxBreadthTraversal(Node* node, unsigned layer, unsigned* breadth) const {
+void Octree::MaxBreadthTraversal(const uint32_t nodeIdx, unsigned layer, unsigned* breadth) const {
 	breadth[layer]++;
+	const Node& node = nodes[nodeIdx];
+	if (!node.IsInterior()) {
+		return;
+	}
+	const uint32_t firstChild = node.offset * nSubRegions;
 	for (int i = 0; i < nSubRegions; ++i) {
-		if (node->m_children == nullptr) break;
-		if (!node->m_children[i].IsLeaf()) {
-			MaxBreadthTraversal(&node->m_children[i], layer + 1, breadth);
+		if (!nodes[firstChild + i].IsLeaf()) {
+			MaxBreadthTraversal(firstChild + i, layer + 1, breadth);
 		}
 	}
 }
 
 unsigned Octree::GetMaxDepth() const {
-	return MaxDepthTraversal(root, 0);
+	return MaxDepthTraversal(0, 0);
 }
 
-unsigned Octree::MaxDepthTraversal(Node* node, unsigned maxDepth) const {
+unsigned Octree::MaxDepthTraversal(const uint32_t nodeIdx, unsigned maxDepth) const {
 	unsigned localMaxDepth = maxDepth;
+	const Node& node = nodes[nodeIdx];
+	if (!node.IsInterior()) {
+		return localMaxDepth;
+	}
+	const uint32_t firstChild = node.offset * nSubRegions;
 	for (int i = 0; i < nSubRegions; ++i) {
-		if (node->m_children == nullptr) {
-			break;
-		}
-		if (!node->m_children[i].IsLeaf()) {
-			localMaxDepth = std::max(localMaxDepth, MaxDepthTraversal(&node->m_children[i], maxDepth + 1));
+		if (!nodes[firstChild + i].IsLeaf()) {
+			localMaxDepth = std::max(localMaxDepth, MaxDepthTraversal(firstChild + i, maxDepth + 1));
 		}
 	}
 	return localMaxDepth;
 }
 
-void Octree::freeOctreeRec(Node* node) {
-	if (node->IsLeaf()) {
-		delete[] node->tri_indices;
-	} else {
-		// Interior node
-		// Traverse down until we meet a leaf node
-		delete[] node->subboxes;
-			for (int i = 0; i < nSubRegions; ++i) {
-				if (node->m_children[i].IsValid()) {
-					freeOctreeRec(&node->m_children[i]);
-				}
-			}
-		delete[] node->m_children;
-	}
-}
-
 }
\ No newline at end of file
@@ -1,112 +1,211 @@
 #pragma once
 #include "aabb.hpp"
+#include "accel_parameters.hpp"
+#include "accel_stats.hpp"
+#include "array_view.hpp"
 #include "common_math.hpp"
+#include "mapped_file.hpp"
 #include "model.hpp"
+#include "scratch_arena.hpp"
+#include "triangle.hpp"
 #include "vec3.hpp"
 
 #include <tbb/blocked_range.h>
+#include <tbb/cache_aligned_allocator.h>
+#include <tbb/enumerable_thread_specific.h>
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
 
+#include <string>
 #include <vector>
 
 namespace specter {
 
 struct Octree {
-	
+
 	using layerIndex = int;
-	
-	// RAII -> set root to nullptr
+
 	Octree();
-	// RAII -> delete octree
 	~Octree();
 
-	void build(std::shared_ptr<Model>& model);
+	// The arrays of the octree refer to its own storage, hence it can't be copied.
+	Octree(const Octree&) = delete;
+	Octree& operator=(const Octree&) = delete;
+
+	void build(std::shared_ptr<Model>& model, const OctreeParameters& parameters = OctreeParameters());
+
+	// Writes the octree to a binary cache file. The key identifies the geometry and 
+	// the parameters, which the octree was built for.
+	void save(const std::string& filename, const uint64_t key) const;
 
-	// traverse the octree. Returns true if the ray intersects geometry in the mesh. 
+	// Memory maps an octree, which has been written by save(). Returns false if the file doesn't exist,
+	// has an outdated format or was written for a different key. The octree is unchanged in that case.
+	bool load(const std::string& filename, const uint64_t key);
+
+	// traverse the octree. Returns true if the ray intersects geometry in the mesh.
 	// Additionally, it is guaranteed that the intersection point is the closest intersection point to the ray origin
 	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const;
-	
-	// Traverse the octree. Returns true if the ray intersects any geometry in the mesh.
-	bool traverseAny(const Model* model, const Ray& ray) const;
 
-	// Traverse the octree. Returns true if ray intersects geometry for t < t_max.
-	// Returns false otherwise.
-	bool traverseAnyTmax(const Model* mesh, const Ray& ray, const float t_max) const;
+	// Traverse the octree. Returns true if the ray intersects any geometry in the mesh
+	// within the ray interval.
+	bool traverseAny(const Model* model, const Ray& ray) const;
 
 	std::pair<layerIndex, int> GetMaxBreadth() const;
 	unsigned GetMaxDepth() const;
 
 	void printNodesPerLayer() const;
 
+	// Returns the number of triangle references stored in the leaves. Triangles spanning
+	// multiple leaves are referenced multiple times, unless the octree is loose.
+	std::size_t GetReferenceCount() const;
+	// Returns the expected cost of tracing a ray according to the surface area heuristic
+	float ComputeExpectedRayCost() const;
+
+	// Returns the number of bytes occupied by the precomputed triangle blocks
+	std::size_t GetTriangleBlockMemory() const;
+	// Returns the number of leaves that store precomputed triangle blocks
+	std::size_t GetTriangleBlockLeafCount() const;
+	// Returns the number of leaves, including the triangle lists of the interior nodes of a loose octree.
+	std::size_t GetLeafCount() const;
+	// Returns the number of nodes, which aren't empty
+	std::size_t GetNodeCount() const;
+	// Returns the number of distinct triangles referenced by the leaves and the triangle blocks
+	std::size_t GetUniqueTriangleCount() const;
+	// Returns the histogram of the leaves, see GetLeafCount()
+	LeafSizeHistogram GetLeafSizeHistogram() const;
+	// Returns the number of bytes occupied by the nodes, the boxes, the triangle indices and the triangle blocks
+	std::size_t GetMemoryUsage() const;
+
 private:
 
-	// Represents a single node in the octree data structure
-	// If the node is a leaf node, indices pointer should not be nullptr
+	// Represents a single node in the linearized octree.
+	// Nodes are stored in groups of eight siblings in one contiguous array, such that
+	// a group occupies exactly one cache line. The bounding boxes of the nodes of a group
+	// are stored in a single sAABB, which lives at the same index in the boxes array.
+	// The first group only holds the root node in its first slot.
 	struct Node {
-		
-		void CreateValidNode(const sAABB* superRegion, int superRegionIdx, const std::size_t TriangleSize);
 
-		void CreateInvalidNode() {
-			this->nTriangles = 0;
-		}
+		// Marks a node as interior node in the nTriangles field.
+		static constexpr uint32_t InteriorTag = std::numeric_limits<uint32_t>::max();
+		// Marks a leaf node, whose triangles are stored as precomputed triangle blocks.
+		static constexpr uint32_t BlockTag = 1u << 31;
 
 		bool IsValid() const {
 			return nTriangles != 0;
 		}
-		
+
 		bool IsInterior() const {
-			return subboxes != nullptr && m_children != nullptr;
+			return nTriangles == InteriorTag;
 		}
-		
-		bool IsLeaf() const { 
-			return tri_indices != nullptr;
+
+		bool IsLeaf() const {
+			return IsValid() && !IsInterior();
+		}
+
+		bool HasTriangleBlocks() const {
+			return IsLeaf() && (nTriangles & BlockTag);
 		}
 
-		bool HasChildren() const {
-			return m_children != nullptr;
+		uint32_t GetTriangleCount() const {
+			return nTriangles & ~BlockTag;
 		}
-		
-		sAABB* subboxes = nullptr;
-		// Pointer to the children nodes. This is nullptr for leaf nodes.
-		Node* m_children = nullptr;
-		// Pointer to the indices. This is nullptr for interior nodes
-		uint32_t* tri_indices = nullptr;
-		// Specifies the number of indices in the indices array, if it exists, otherwise specifies number of triangle indices
-		// used during octree constructuin
+
+		// For interior nodes, this is the index of the group containing the eight children.
+		// For leaf nodes, this is the position of the first triangle index in the index pool,
+		// or the index of the first triangle block if the leaf is tagged with BlockTag.
+		uint32_t offset = 0;
+		// Specifies the number of triangles of a leaf node.
+		// Interior nodes are tagged with InteriorTag, empty nodes have no triangles.
 		uint32_t nTriangles = 0;
 	};
 
+	static_assert(sizeof(Node) * 8 == 64, "A group of sibling nodes has to fit into a single cache line");
+
+	template<typename T>
+	using AlignedVector = std::vector<T, tbb::cache_aligned_allocator<T>>;
+
+	// Storage of a (sub-)octree during construction. Subtrees that are built in parallel
+	// are written to their own fragment, which is linked to the parent fragment. 
+	// The layout is the same as that of the final octree, i.e. the root of the fragment
+	// is stored in the first slot of the first group.
+	struct BuildFragment {
+		AlignedVector<Node> nodes;
+		AlignedVector<sAABB> boxes;
+		std::vector<uint32_t> triIndices;
+		AlignedVector<Node> interiorTriangles;
+		// Fragments of the subtrees, whose roots belong to the node indices of this fragment.
+		std::vector<std::pair<uint32_t, std::unique_ptr<BuildFragment>>> subtrees;
+	};
+
+	// State shared by all nodes during the construction of the octree
+	struct BuildContext {
+		const vec3f* vertices;
+		const FaceElement* faces;
+		// Scratch memory for the triangle lists of the nodes. Every thread owns one arena.
+		tbb::enumerable_thread_specific<ScratchArena>* arenas;
+	};
+
 private:
-	
-	void MaxBreadthTraversal(Node* node, unsigned layer, unsigned* breadth) const;
-	unsigned MaxDepthTraversal(Node* node, unsigned maxDepth) const;
+
+	void MaxBreadthTraversal(const uint32_t nodeIdx, unsigned layer, unsigned* breadth) const;
+	unsigned MaxDepthTraversal(const uint32_t nodeIdx, unsigned maxDepth) const;
 
 private:
 
 	// Build the octree recursively. This is initially called by the public function build()
-	void buildRec(Node* node, const vec3f* vertices, const FaceElement* faces, const uint32_t* trianglePositions, int depth = 0);
+	void buildRec(	BuildFragment& fragment, const BuildContext& context, const uint32_t nodeIdx, const AxisAlignedBoundingBox& region,
+					const uint32_t* trianglePositions, const uint32_t nTriangles, int depth = 0) const;
+
+	// Copies the fragment and all of its linked subtrees into the node, box and triangle index arrays.
+	void linearize(const BuildFragment& root);
+
+	// Converts the largest leaves to precomputed triangle blocks, as long as the memory budget allows it.
+	// The triangle indices of the converted leaves are removed from the index pool.
+	void buildTriangleBlocks(const Model* model, const std::size_t budget);
 
 	// Traverse the octree recursively. This is initially called by the public function traverse()
-	void traverseRec(const Model* model, Node* node, const Ray& ray, Intersection& intersection, bool multipleBoxesHit = false) const;
-	
-	void traverseEdge(const Model* model, Node* node, const Ray& ray, Intersection& its);
+	// The ray interval is shrunk to the closest intersection found so far.
+	void traverseRec(const Model* model, const uint32_t nodeIdx, Ray& ray, Intersection& intersection) const;
 
-	void computeTriangleIntersections(const Model* model, Node* node, const Ray& ray, Intersection& its) const;
+	void computeTriangleIntersections(const Model* model, const Node& node, Ray& ray, Intersection& its) const;
 
 	// Traverse the octree recursively. This is initially called by the public function traverseAny()
-	void traverseAnyRec(const Model* model, Node* node, const Ray& ray, bool& intersectionFound) const;
+	// Returns as soon as any intersection within the ray interval is found.
+	bool traverseAnyRec(const Model* model, const uint32_t nodeIdx, const Ray& ray) const;
+
+	// Returns true if the ray intersects any triangle of the leaf node.
+	bool intersectsAnyTriangle(const Model* model, const Node& node, const Ray& ray) const;
+
+private:
 
-	// Traverse the octree recursively. This is initially called by the public function traverseAnyTmax()
-	void traverseAnyTmaxRec(const Model* model, Node* node, const Ray& ray, const float t_max, bool& intersectionFound) const;
+	// Arrays of an octree, which has been built in memory. An octree loaded from a cache file
+	// refers to the memory mapped file instead.
+	struct Storage {
+		AlignedVector<Node> nodes;
+		AlignedVector<sAABB> boxes;
+		std::vector<uint32_t> triIndices;
+		AlignedVector<Node> interiorTriangles;
+		AlignedVector<sTriangle> triangleBlocks;
+	};
 
-	// Free the octree recursively. This is called by the destructor.
-	void freeOctreeRec(Node* node);
+	// Points the arrays used for traversal to the storage.
+	void bindStorage();
 
 private:
 
-	Node* root;	// Represents the root of the octree
+	Storage storage;
+	std::shared_ptr<MappedFile> mappedFile;
+
+	ArrayView<Node> nodes;		// Sibling groups of the octree. The root is stored at index 0.
+	ArrayView<sAABB> boxes;		// Bounding boxes of the sibling groups.
+	ArrayView<uint32_t> triIndices;	// Shared pool of the triangle indices referenced by leaf nodes.
+	ArrayView<Node> interiorTriangles;	// Triangles stored in the interior nodes of a loose octree. Indexed by the group of the children of the node.
+	ArrayView<sTriangle> triangleBlocks;	// Precomputed triangles of the leaves tagged with BlockTag, eight per block.
+	std::size_t nBlockLeaves;	// Number of leaves that store triangle blocks.
 	std::size_t maxDepth;	// Specifies the maximum depth the octree can have. This parameter is used to avoid infinite depth octrees in pathological cases.
+	uint32_t leafThreshold;	// Nodes referencing at most this many triangles become leaves.
+	bool loose;	// Every triangle is stored in exactly one node, see OctreeParameters::loose.
 
 };
 
-}
\ No newline at end of file
+}
@@ -1,23 +1,62 @@
 #include "ray.hpp"
 
+#include <cmath>
+
 namespace specter {
 
+// Computes the permutation and shear of the watertight ray/triangle test from the direction of the ray
+static void computeShear(Ray& ray) {
+	const vec3f absd(std::abs(ray.d.x), std::abs(ray.d.y), std::abs(ray.d.z));
+	ray.kz = absd.x > absd.y ? (absd.x > absd.z ? 0 : 2) : (absd.y > absd.z ? 1 : 2);
+	ray.kx = (ray.kz + 1) % 3;
+	ray.ky = (ray.kx + 1) % 3;
+	// Swapping x and y keeps the winding of the triangles, if the direction points along the negative z axis
+	if (ray.d[ray.kz] < 0.f) {
+		std::swap(ray.kx, ray.ky);
+	}
+	ray.shear = vec3f(ray.d[ray.kx] / ray.d[ray.kz], ray.d[ray.ky] / ray.d[ray.kz], 1.f / ray.d[ray.kz]);
+}
+
 Ray::Ray(const vec3f& origin, const vec3f& direction)
 	: o(origin)
 	, d(direction)
 	, invd(inverse(direction))
-{}
+{
+	computeShear(*this);
+}
+
+Ray::Ray(const vec3f& origin, const vec3f& direction, const float tmin, const float tmax)
+	: o(origin)
+	, d(direction)
+	, invd(inverse(direction))
+	, tmin(tmin)
+	, tmax(tmax)
+{
+	computeShear(*this);
+}
 
 Ray::Ray(const Ray& other)
 	: o(other.o)
 	, d(other.d)
 	, invd(other.invd)
+	, kx(other.kx)
+	, ky(other.ky)
+	, kz(other.kz)
+	, shear(other.shear)
+	, tmin(other.tmin)
+	, tmax(other.tmax)
 {}
 
 Ray& Ray::operator=(const Ray& other) {
 	o = other.o;
 	d = other.d;
 	invd = other.invd;
+	kx = other.kx;
+	ky = other.ky;
+	kz = other.kz;
+	shear = other.shear;
+	tmin = other.tmin;
+	tmax = other.tmax;
 	return *this;
 }
 
@@ -26,7 +65,7 @@ vec3f Ray::operator()(const float t) {
 }
 
 std::ostream& operator<<(std::ostream& os, const Ray& ray) {
-	return os << "origin: " << ray.o << ", direction: " << ray.d;
+	return os << "origin: " << ray.o << ", direction: " << ray.d << ", interval: (" << ray.tmin << ", " << ray.tmax << ")";
 }
 
 }
\ No newline at end of file
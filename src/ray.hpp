@@ -1,6 +1,8 @@
 #pragma once
 #include "vec3.hpp"
 
+#include <limits>
+
 namespace specter {
 
 // Represents a ray in world space
@@ -11,6 +13,8 @@ struct Ray {
 	// Constructs a ray with origin \origin and direction \direction. Must make sure that the 
 	// direction vector is normalized
 	Ray(const vec3f& origin, const vec3f& direction);
+	// Constructs a ray that only considers intersections in the open interval (tmin, tmax)
+	Ray(const vec3f& origin, const vec3f& direction, const float tmin, const float tmax);
 	// Copy construct ray
 	Ray(const Ray& other);
 	// Copy assign ray
@@ -23,6 +27,16 @@ struct Ray {
 	// the ray travels in. The direction vector has to be normalized
 	vec3f o, d;
 	vec3f invd;	// Inverse direction is used for some intersection algorithms for performance
+	
+	// The watertight ray/triangle test permutes the axes, such that the largest component of the direction becomes z,
+	// and shears the space, such that the direction becomes the positive z axis. Both only depend on the direction.
+	int kx, ky, kz;	// Permutation of the axes
+	vec3f shear;	// Shear of the x and y axes in x and y, the scale of the z axis in z
+	
+	// Interval of valid ray parameters. Intersections with t <= tmin or t >= tmax are ignored.
+	// Traversal routines shrink tmax to the closest intersection found so far.
+	float tmin = 0.f;
+	float tmax = std::numeric_limits<float>::max();
 };
 
 // Print out the parameters of the ray
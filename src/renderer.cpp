@@ -42,10 +42,11 @@ void RTX_Renderer::run() {
 	glBindTextureUnit(0, image);
 
 	auto* octree = scene->accel.GetOctree();
-
-	std::cout << "Octree statistics\n";
-	std::cout << "Max depth: " << octree->GetMaxDepth() << '\n';
-	octree->printNodesPerLayer();
+	if (octree != nullptr) {
+		std::cout << "Octree statistics\n";
+		std::cout << "Max depth: " << octree->GetMaxDepth() << '\n';
+		octree->printNodesPerLayer();
+	}
 
 	//
 	//
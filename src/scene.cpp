@@ -3,6 +3,8 @@
 #include "material_lambertian.hpp"
 #include "scene.hpp"
 
+#include <map>
+
 namespace specter {
 
 Scene::Scene(SceneDescriptor& sceneDescriptor) {
@@ -11,13 +13,60 @@ Scene::Scene(SceneDescriptor& sceneDescriptor) {
 	camera.setResolution(sceneDescriptor.screenResolution);
 	camera.initializeVariables(sceneDescriptor.cameraPosition, sceneDescriptor.cameraTarget, sceneDescriptor.cameraFov, sceneDescriptor.samplesPerPixel);
 
-	//  Initialize model
-	model = std::make_shared<Model>();
-	model->parse(sceneDescriptor.meshPath.c_str());
+	//  Initialize model. Meshes, which are instanced several times, are only loaded once.
+	if (sceneDescriptor.instances.empty()) {
+		model = std::make_shared<Model>();
+		model->parse(sceneDescriptor.meshPath.c_str());
+		model->setTriangleTest(sceneDescriptor.triangleTest);
+		accel.addModel(model);
+	} else {
+		std::map<std::string, std::shared_ptr<Model>> meshes;
+		for (const auto& instance : sceneDescriptor.instances) {
+			std::shared_ptr<Model>& mesh = meshes[instance.meshPath];
+			if (!mesh) {
+				mesh = std::make_shared<Model>();
+				mesh->parse(instance.meshPath.c_str());
+				mesh->setTriangleTest(sceneDescriptor.triangleTest);
+			}
+			accel.addInstance(mesh, instance.transform);
+		}
+		model = meshes[sceneDescriptor.instances.front().meshPath];
+	}
+
+	// Select the SIMD kernels of the box and triangle tests before any ray is traced
+	const SimdLevel simdLevel = setSimdLevel(sceneDescriptor.simdLevel);
+	std::cout << "Using the " << simdLevelName(simdLevel) << " kernels.\n";
+
+	// Initialize acceleration structure. It is loaded from the cache file next to the mesh, 
+	// if it has been built for the same geometry and parameters before. Instanced scenes aren't cached.
+	accel.setStructure(sceneDescriptor.accelStructure);
+	accel.setBVHParameters(sceneDescriptor.bvhParameters);
+	accel.setKdTreeParameters(sceneDescriptor.kdTreeParameters);
+	const std::string cachePath = sceneDescriptor.meshPath + ".accel";
+	const bool autoTune = sceneDescriptor.autoTuneAccel;
+	if (!sceneDescriptor.cacheAccel || !accel.loadCache(cachePath, sceneDescriptor.octreeParameters, autoTune)) {
+		if (autoTune) {
+			accel.autoTune(generateSampleRays(), sceneDescriptor.octreeParameters);
+		} else {
+			accel.build(sceneDescriptor.octreeParameters);
+		}
 
-	// Initialize acceleration structure
-	accel.addModel(model);
-	accel.build();
+		if (sceneDescriptor.cacheAccel) {
+			try {
+				accel.saveCache(cachePath, sceneDescriptor.octreeParameters, autoTune);
+			} catch (const std::runtime_error& e) {
+				std::cout << e.what() << '\n';
+			}
+		}
+	}
+
+	if (!sceneDescriptor.accelStatsReport.empty()) {
+		try {
+			accel.saveStatsReport(sceneDescriptor.accelStatsReport);
+		} catch (const std::runtime_error& e) {
+			std::cout << e.what() << '\n';
+		}
+	}
 
 	// Set rendering information
 	dynamicFrame = sceneDescriptor.dynamicFrame;
@@ -27,4 +76,14 @@ Scene::Scene(SceneDescriptor& sceneDescriptor) {
 
 Scene::~Scene() {}
 
+std::vector<Ray> Scene::generateSampleRays(const unsigned stride) {
+	std::vector<Ray> rays;
+	for (unsigned y = 0; y < camera.resy(); y += stride) {
+		for (unsigned x = 0; x < camera.resx(); x += stride) {
+			rays.push_back(camera.getRay(vec2f(x, y)));
+		}
+	}
+	return rays;
+}
+
 }
\ No newline at end of file
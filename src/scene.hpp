@@ -15,6 +15,9 @@ struct Scene {
 
 	~Scene();
 
+	// Returns the primary rays of every "stride"-th pixel in both screen dimensions.
+	std::vector<Ray> generateSampleRays(const unsigned stride = 8);
+
 	std::shared_ptr<Model> model;
 
 	Accel accel;
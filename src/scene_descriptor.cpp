@@ -1,4 +1,5 @@
 #include "scene_descriptor.hpp"
+#include "simd_kernels.hpp"
 
 namespace specter {
 
@@ -71,6 +72,129 @@ SceneDescriptor::SceneDescriptor(const char* filename) : filename(filename) {
 		meshPath = jsonParser["path"].get<std::string>();
 	}
 
+	//
+	// Instances field
+	if (jsonParser.contains("instances")) {
+		for (const auto& instanceParser : jsonParser["instances"]) {
+			InstanceDescription instance;
+			instance.meshPath = instanceParser["path"].get<std::string>();
+			if (instanceParser.contains("transform")) {
+				instanceParser["transform"].get_to(instance.transform.data);
+			}
+			instances.push_back(instance);
+		}
+	}
+
+	//
+	// Accelerating structure field
+	if (jsonParser.contains("accel")) {
+		auto accelParser = jsonParser.find("accel");
+
+		if (accelParser->contains("structure")) {
+			const auto structure = jsonParser["accel"]["structure"].get<std::string>();
+			if (structure == "octree") {
+				accelStructure = AccelStructure::Octree;
+			} else if (structure == "lbvh") {
+				accelStructure = AccelStructure::LBVH;
+			} else if (structure == "bvh") {
+				accelStructure = AccelStructure::BVH;
+			} else if (structure == "kdtree") {
+				accelStructure = AccelStructure::KdTree;
+			} else {
+				throw std::runtime_error("Unknown accelerating structure: " + structure);
+			}
+		}
+
+		if (accelParser->contains("triangleTest")) {
+			const auto test = jsonParser["accel"]["triangleTest"].get<std::string>();
+			if (test == "moellerTrumbore") {
+				triangleTest = TriangleTest::MoellerTrumbore;
+			} else if (test == "watertight") {
+				triangleTest = TriangleTest::Watertight;
+			} else {
+				throw std::runtime_error("Unknown triangle test: " + test);
+			}
+		}
+
+		if (accelParser->contains("simd")) {
+			const auto level = jsonParser["accel"]["simd"].get<std::string>();
+			if (level == "sse4.2") {
+				simdLevel = SimdLevel::SSE42;
+			} else if (level == "avx2") {
+				simdLevel = SimdLevel::AVX2;
+			} else if (level == "avx512") {
+				simdLevel = SimdLevel::AVX512;
+			} else {
+				throw std::runtime_error("Unknown SIMD level: " + level);
+			}
+		}
+
+		if (accelParser->contains("leafThreshold")) {
+			octreeParameters.leafThreshold = jsonParser["accel"]["leafThreshold"].get<uint32_t>();
+		}
+
+		if (accelParser->contains("maxDepth")) {
+			octreeParameters.maxDepth = jsonParser["accel"]["maxDepth"].get<int>();
+		}
+
+		// The budget is specified in megabytes
+		if (accelParser->contains("triangleBlocks")) {
+			octreeParameters.triangleBlockBudget = jsonParser["accel"]["triangleBlocks"].get<std::size_t>() << 20;
+		}
+
+		if (accelParser->contains("loose")) {
+			octreeParameters.loose = jsonParser["accel"]["loose"].get<bool>();
+		}
+
+		if (accelParser->contains("maxLeafSize")) {
+			bvhParameters.maxLeafSize = jsonParser["accel"]["maxLeafSize"].get<uint32_t>();
+		}
+
+		if (accelParser->contains("treeletRounds")) {
+			bvhParameters.treeletRounds = jsonParser["accel"]["treeletRounds"].get<int>();
+		}
+
+		if (accelParser->contains("wide")) {
+			bvhParameters.wide = jsonParser["accel"]["wide"].get<bool>();
+		}
+
+		if (accelParser->contains("compressed")) {
+			bvhParameters.compressed = jsonParser["accel"]["compressed"].get<bool>();
+		}
+
+		if (accelParser->contains("spatialSplits")) {
+			bvhParameters.spatialSplits = jsonParser["accel"]["spatialSplits"].get<bool>();
+		}
+
+		if (accelParser->contains("duplicationBudget")) {
+			bvhParameters.duplicationBudget = jsonParser["accel"]["duplicationBudget"].get<float>();
+		}
+
+		if (accelParser->contains("refitThreshold")) {
+			bvhParameters.refitThreshold = jsonParser["accel"]["refitThreshold"].get<float>();
+		}
+
+		if (accelParser->contains("kdMaxDepth")) {
+			kdTreeParameters.maxDepth = jsonParser["accel"]["kdMaxDepth"].get<int>();
+		}
+
+		if (accelParser->contains("emptySpaceBonus")) {
+			kdTreeParameters.emptySpaceBonus = jsonParser["accel"]["emptySpaceBonus"].get<float>();
+		}
+
+		if (accelParser->contains("autoTune")) {
+			autoTuneAccel = jsonParser["accel"]["autoTune"].get<bool>();
+		}
+
+		if (accelParser->contains("cache")) {
+			cacheAccel = jsonParser["accel"]["cache"].get<bool>();
+		}
+
+		if (accelParser->contains("statsReport")) {
+			accelStatsReport = jsonParser["accel"]["statsReport"].get<std::string>();
+		}
+	}
+
 	//
 	// Misc. field
 	if (jsonParser.contains("dynamicFrame")) {
@@ -80,6 +204,25 @@ SceneDescriptor::SceneDescriptor(const char* filename) : filename(filename) {
 	}
 }
 
+// Returns the name of the structure in the scene description
+static const char* accelStructureName(const AccelStructure structure) {
+	switch (structure) {
+	case AccelStructure::LBVH:
+		return "lbvh";
+	case AccelStructure::BVH:
+		return "bvh";
+	case AccelStructure::KdTree:
+		return "kdtree";
+	default:
+		return "octree";
+	}
+}
+
+// Returns the name of the test in the scene description
+static const char* triangleTestName(const TriangleTest test) {
+	return test == TriangleTest::Watertight ? "watertight" : "moellerTrumbore";
+}
+
 std::ostream& operator<<(std::ostream& os, const SceneDescriptor& scene) {
 	os << "Printing file descriptor: " << scene.filename << '\n';
 	os << "cameraPosition: " << scene.cameraPosition << '\n';
@@ -87,7 +230,29 @@ std::ostream& operator<<(std::ostream& os, const SceneDescriptor& scene) {
 	os << "cameraFov: " << scene.cameraFov << '\n';
 	os << "samplesPerPixel: " << scene.samplesPerPixel << '\n';
 	os << "screenResolution: " << scene.screenResolution << '\n';
-	os << "meshPath: " << scene.meshPath << "\n\n";
+	os << "meshPath: " << scene.meshPath << '\n';
+	for (const auto& instance : scene.instances) {
+		os << "instance: " << instance.meshPath << '\n' << instance.transform;
+	}
+	os << "accelStructure: " << accelStructureName(scene.accelStructure) << '\n';
+	os << "triangleTest: " << triangleTestName(scene.triangleTest) << '\n';
+	os << "simdLevel: " << simdLevelName(scene.simdLevel) << '\n';
+	os << "leafThreshold: " << scene.octreeParameters.leafThreshold << '\n';
+	os << "maxDepth: " << scene.octreeParameters.maxDepth << '\n';
+	os << "loose: " << scene.octreeParameters.loose << '\n';
+	os << "triangleBlockBudget: " << scene.octreeParameters.triangleBlockBudget << '\n';
+	os << "maxLeafSize: " << scene.bvhParameters.maxLeafSize << '\n';
+	os << "treeletRounds: " << scene.bvhParameters.treeletRounds << '\n';
+	os << "wide: " << scene.bvhParameters.wide << '\n';
+	os << "compressed: " << scene.bvhParameters.compressed << '\n';
+	os << "spatialSplits: " << scene.bvhParameters.spatialSplits << '\n';
+	os << "duplicationBudget: " << scene.bvhParameters.duplicationBudget << '\n';
+	os << "refitThreshold: " << scene.bvhParameters.refitThreshold << '\n';
+	os << "kdMaxDepth: " << scene.kdTreeParameters.maxDepth << '\n';
+	os << "emptySpaceBonus: " << scene.kdTreeParameters.emptySpaceBonus << '\n';
+	os << "autoTuneAccel: " << scene.autoTuneAccel << '\n';
+	os << "cacheAccel: " << scene.cacheAccel << '\n';
+	os << "accelStatsReport: " << scene.accelStatsReport << "\n\n";
 	return os;
 }
 
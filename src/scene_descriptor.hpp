@@ -1,6 +1,8 @@
 #pragma once
+#include "accel_parameters.hpp"
 #include "common.hpp"
 #include "common_math.hpp"
+#include "mat4.hpp"
 #include "vec2.hpp"
 #include "vec3.hpp"
 
@@ -8,6 +10,7 @@
 
 #include <fstream>
 #include <ostream>
+#include <vector>
 
 namespace specter {
 
@@ -36,8 +39,31 @@ struct SceneDescriptor {
 	// Mesh location
 	std::string meshPath;
 
+	// Placement of a mesh in the scene. "transform" maps object space to world space,
+	// it is given in row-major order with the translation in the last column.
+	struct InstanceDescription {
+		std::string meshPath;
+		mat4f transform = mat4f(1.f);
+	};
+
+	// Instances of meshes, which may repeat the same mesh. If there are any, "meshPath" is ignored.
+	std::vector<InstanceDescription> instances;
+
 	// Rendering
 	bool dynamicFrame;
+
+	// Accelerating structure
+	AccelStructure accelStructure = AccelStructure::Octree;
+	TriangleTest triangleTest = TriangleTest::MoellerTrumbore;
+	// Highest SIMD level the kernels may use. The level of the CPU is used, if it is lower.
+	SimdLevel simdLevel = SimdLevel::AVX512;
+	OctreeParameters octreeParameters;
+	BVHParameters bvhParameters;
+	KdTreeParameters kdTreeParameters;
+	bool autoTuneAccel = false;
+	bool cacheAccel = true;
+	// Path of the json file, which receives the statistics of the structure. Empty if no report is written.
+	std::string accelStatsReport;
 };
 
 std::ostream& operator<<(std::ostream& os, const SceneDescriptor& scene);
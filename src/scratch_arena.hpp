@@ -0,0 +1,96 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace specter {
+
+// Stack-like bump allocator for temporary data of recursive algorithms, e.g. the
+// construction of accelerating structures. Memory is released in LIFO order by
+// rewinding to a marker. Released memory is kept, such that the next allocations
+// reuse it. Memory is requested in blocks of growing size, therefore the number of
+// heap allocations is logarithmic in the peak memory usage.
+//
+// The arena is not thread safe. Use one arena per thread instead.
+class ScratchArena {
+
+public:
+
+	// Position of the arena, which can be rewinded to via release()
+	struct Marker {
+		std::size_t block;
+		std::size_t offset;
+	};
+
+	explicit ScratchArena(const std::size_t initialBlockSize = 1 << 20)
+		: initialBlockSize(initialBlockSize)
+		, currentBlock(0)
+		, currentOffset(0)
+	{}
+
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+	// Returns uninitialized memory for "count" objects of type T.
+	// T has to be trivially destructible, since no destructors are run.
+	template<typename T>
+	T* allocate(const std::size_t count) {
+		static_assert(std::is_trivially_destructible_v<T>, "Arena memory is released without running destructors");
+		return static_cast<T*>(allocateBytes(count * sizeof(T), alignof(T)));
+	}
+
+	Marker GetMarker() const {
+		return { currentBlock, currentOffset };
+	}
+
+	// Releases all memory that has been allocated after "marker" was taken.
+	void release(const Marker& marker) {
+		currentBlock = marker.block;
+		currentOffset = marker.offset;
+	}
+
+	// Returns the number of bytes reserved by the arena
+	std::size_t GetCapacity() const {
+		std::size_t capacity = 0;
+		for (const auto& block : blocks) {
+			capacity += block.size;
+		}
+		return capacity;
+	}
+
+private:
+
+	void* allocateBytes(const std::size_t nBytes, const std::size_t alignment) {
+		while (currentBlock < blocks.size()) {
+			Block& block = blocks[currentBlock];
+			const std::size_t alignedOffset = (currentOffset + alignment - 1) & ~(alignment - 1);
+			if (alignedOffset + nBytes <= block.size) {
+				currentOffset = alignedOffset + nBytes;
+				return block.data.get() + alignedOffset;
+			}
+			// The remainder of the block is skipped. It is reused after the next release.
+			++currentBlock;
+			currentOffset = 0;
+		}
+
+		const std::size_t blockSize = std::max(nBytes + alignment, blocks.empty() ? initialBlockSize : blocks.back().size * 2);
+		blocks.push_back({ std::make_unique<unsigned char[]>(blockSize), blockSize });
+		currentBlock = blocks.size() - 1;
+		currentOffset = 0;
+		return allocateBytes(nBytes, alignment);
+	}
+
+	struct Block {
+		std::unique_ptr<unsigned char[]> data;
+		std::size_t size;
+	};
+
+	std::vector<Block> blocks;
+	std::size_t initialBlockSize;
+	std::size_t currentBlock;
+	std::size_t currentOffset;
+};
+
+}
@@ -0,0 +1,100 @@
+#include "simd_kernels.hpp"
+
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+
+namespace specter {
+
+// Feature bits of CPUID leaf 1 (ecx) and leaf 7 (ebx)
+#define CPUID_OSXSAVE_BIT (1u << 27)
+#define CPUID_AVX_BIT (1u << 28)
+#define CPUID_AVX2_BIT (1u << 5)
+#define CPUID_AVX512F_BIT (1u << 16)
+
+// Register state enabled by the operating system in XCR0. AVX needs the XMM and YMM state,
+// AVX-512 additionally the opmask registers and the upper halves and upper 16 of the ZMM registers.
+#define XCR0_AVX_STATE 0x06u
+#define XCR0_AVX512_STATE 0xE6u
+
+static void cpuid(const uint32_t leaf, uint32_t regs[4]) {
+#ifdef _MSC_VER
+	int info[4];
+	__cpuidex(info, static_cast<int>(leaf), 0);
+	for (int i = 0; i < 4; ++i) {
+		regs[i] = static_cast<uint32_t>(info[i]);
+	}
+#else
+	__cpuid_count(leaf, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// XGETBV is issued directly, _xgetbv() would need -mxsave on GCC and Clang
+static uint64_t xgetbv() {
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	uint32_t eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+}
+
+SimdLevel detectSimdLevel() {
+	uint32_t regs[4];
+	cpuid(0, regs);
+	const uint32_t maxLeaf = regs[0];
+
+	cpuid(1, regs);
+	const uint32_t features1 = regs[2];
+	if ((features1 & CPUID_OSXSAVE_BIT) == 0 || (features1 & CPUID_AVX_BIT) == 0 || maxLeaf < 7) {
+		return SimdLevel::SSE42;
+	}
+
+	const uint64_t xcr0 = xgetbv();
+	cpuid(7, regs);
+	const uint32_t features7 = regs[1];
+	if ((xcr0 & XCR0_AVX_STATE) != XCR0_AVX_STATE || (features7 & CPUID_AVX2_BIT) == 0) {
+		return SimdLevel::SSE42;
+	}
+	if ((xcr0 & XCR0_AVX512_STATE) != XCR0_AVX512_STATE || (features7 & CPUID_AVX512F_BIT) == 0) {
+		return SimdLevel::AVX2;
+	}
+	return SimdLevel::AVX512;
+}
+
+static const SimdKernels* kernelsOf(const SimdLevel level) {
+	switch (level) {
+	case SimdLevel::AVX512:
+		return &avx512Kernels;
+	case SimdLevel::AVX2:
+		return &avx2Kernels;
+	default:
+		return &sse42Kernels;
+	}
+}
+
+const SimdKernels* selectedSimdKernels = kernelsOf(detectSimdLevel());
+
+SimdLevel setSimdLevel(const SimdLevel maxLevel) {
+	const SimdLevel level = std::min(maxLevel, detectSimdLevel());
+	selectedSimdKernels = kernelsOf(level);
+	return level;
+}
+
+const char* simdLevelName(const SimdLevel level) {
+	switch (level) {
+	case SimdLevel::AVX512:
+		return "avx512";
+	case SimdLevel::AVX2:
+		return "avx2";
+	default:
+		return "sse4.2";
+	}
+}
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "accel_parameters.hpp"
+#include "ray.hpp"
+#include "vec3.hpp"
+
+#include <cstdint>
+
+namespace specter {
+
+struct FaceElement;
+struct sAABB;
+struct sTriangle;
+
+// Entry points of the SIMD kernels. A table is compiled for every SIMD level, in a translation unit, whose
+// instructions are restricted to that level (simd_kernels_sse42.cpp, simd_kernels_avx2.cpp, simd_kernels_avx512.cpp).
+// The triangle kernels loop over all triangles of a leaf, such that the indirect call is paid once per leaf.
+struct SimdKernels {
+	SimdLevel level;
+
+	// Performs ray-aabb intersection against the 8 boxes, see sAABB::rayIntersect()
+	void (*intersectBoxes)(const sAABB& boxes, const Ray& ray, float* nearT, float* farT);
+
+	// Intersects the ray with the triangles indices[0, count) of the mesh. Returns the position in "indices" of the
+	// closest intersection within the ray interval, or -1 if there is none. u, v and t are only written on a hit.
+	int (*intersectTriangles)(	const TriangleTest test, const Ray& ray, const FaceElement* faces, const vec3f* vertices,
+								const uint32_t* indices, const uint32_t count, float& u, float& v, float& t);
+
+	// Returns true if the ray intersects any of the triangles indices[0, count) within the ray interval
+	bool (*intersectTrianglesAny)(	const TriangleTest test, const Ray& ray, const FaceElement* faces, const vec3f* vertices,
+									const uint32_t* indices, const uint32_t count);
+
+	// Intersects the ray with the triangle blocks[0, count). Returns the lane 8 * block + i of the closest
+	// intersection within the ray interval, or -1 if there is none. u, v and t are only written on a hit.
+	int (*intersectBlocks)(const TriangleTest test, const Ray& ray, const sTriangle* blocks, const uint32_t count, float& u, float& v, float& t);
+
+	// Returns true if the ray intersects any of the triangle blocks[0, count) within the ray interval
+	bool (*intersectBlocksAny)(const TriangleTest test, const Ray& ray, const sTriangle* blocks, const uint32_t count);
+
+	// Dequantizes the 8 boxes with the 8-bit coordinates qmin and qmax to origin + q * scale, see CompressedBVH::Node
+	void (*dequantizeBoxes)(const uint8_t qmin[3][8], const uint8_t qmax[3][8], const vec3f& origin, const vec3f& scale, sAABB& boxes);
+};
+
+extern const SimdKernels sse42Kernels;
+extern const SimdKernels avx2Kernels;
+extern const SimdKernels avx512Kernels;
+
+// Kernels of the selected level. Initialized with the highest level supported by the CPU before main() runs.
+extern const SimdKernels* selectedSimdKernels;
+
+inline const SimdKernels& GetSimdKernels() {
+	return *selectedSimdKernels;
+}
+
+// Queries the features of the CPU with CPUID and the register state saved by the operating system with XGETBV.
+// Returns the highest level, whose instructions can be executed.
+SimdLevel detectSimdLevel();
+
+// Selects the highest level supported by the CPU, which doesn't exceed "maxLevel", and returns it.
+// Must not be called while rays are traced.
+SimdLevel setSimdLevel(const SimdLevel maxLevel);
+
+// Returns the name of the level, as it is used in the scene description
+const char* simdLevelName(const SimdLevel level);
+
+}
@@ -0,0 +1,100 @@
+#include "aabb.hpp"
+#include "model.hpp"
+#include "simd_kernels.hpp"
+#include "triangle.hpp"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+// The kernels of this translation unit are restricted to AVX2 and don't contract multiplies and adds into
+// fused multiply-adds, see simd_kernels_impl.hpp. MSVC compiles the intrinsics without /arch flags.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2"))), apply_to = function)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+
+namespace specter {
+namespace simd {
+
+struct AVX2 {
+	static constexpr SimdLevel level = SimdLevel::AVX2;
+	static constexpr int width = 8;
+	using Float = __m256;
+	using Mask = __m256;
+
+	static Float set1(const float f) { return _mm256_set1_ps(f); }
+	static Float zero() { return _mm256_setzero_ps(); }
+	static Float load(const float* p) { return _mm256_load_ps(p); }
+	static void store(float* p, const Float a) { _mm256_store_ps(p, a); }
+	static Float add(const Float a, const Float b) { return _mm256_add_ps(a, b); }
+	static Float sub(const Float a, const Float b) { return _mm256_sub_ps(a, b); }
+	static Float mul(const Float a, const Float b) { return _mm256_mul_ps(a, b); }
+	static Float div(const Float a, const Float b) { return _mm256_div_ps(a, b); }
+	static Float min(const Float a, const Float b) { return _mm256_min_ps(a, b); }
+	static Float max(const Float a, const Float b) { return _mm256_max_ps(a, b); }
+	static Float abs(const Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.f), a); }
+
+	static Mask lt(const Float a, const Float b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static Mask le(const Float a, const Float b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static Mask gt(const Float a, const Float b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static Mask ge(const Float a, const Float b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	static Mask neq(const Float a, const Float b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_OQ); }
+	static Mask maskAnd(const Mask a, const Mask b) { return _mm256_and_ps(a, b); }
+	static Mask maskOr(const Mask a, const Mask b) { return _mm256_or_ps(a, b); }
+	static Mask maskAndNot(const Mask a, const Mask b) { return _mm256_andnot_ps(a, b); }
+	static uint32_t bits(const Mask a) { return static_cast<uint32_t>(_mm256_movemask_ps(a)); }
+
+	static Float convertBytes(const uint8_t* q) {
+		return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q))));
+	}
+
+	// Gathers up to eight triangles into the lanes of a packet.
+	// The gathers are masked, such that the lanes after "count" are zero and no memory is read for them.
+	static void gatherTriangles(const FaceElement* faces, const vec3f* vertices, const uint32_t* indices, const uint32_t count, Float packet[3][3]) {
+		static_assert(sizeof(FaceElement) == 3 * sizeof(int), "Face elements are gathered as three integers");
+		static_assert(sizeof(vec3f) == 3 * sizeof(float), "Vertices are gathered as three floats");
+
+		const __m256i lanes = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(count)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+		const __m256i triangles = _mm256_maskload_epi32(reinterpret_cast<const int*>(indices), lanes);
+		// A triangle consists of three face elements of three integers each, the position index comes first.
+		const __m256i faceOffsets = _mm256_add_epi32(_mm256_slli_epi32(triangles, 3), triangles);
+		const int* faceData = reinterpret_cast<const int*>(faces);
+		const float* vertexData = reinterpret_cast<const float*>(vertices);
+
+		for (int k = 0; k < 3; ++k) {
+			const __m256i vertexIdx = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), faceData + 3 * k, faceOffsets, lanes, 4);
+			const __m256i vertexOffsets = _mm256_add_epi32(_mm256_slli_epi32(vertexIdx, 1), vertexIdx);
+			for (int axis = 0; axis < 3; ++axis) {
+				packet[k][axis] = _mm256_mask_i32gather_ps(_mm256_setzero_ps(), vertexData + axis, vertexOffsets, _mm256_castsi256_ps(lanes), 4);
+			}
+		}
+	}
+
+	static Float loadBlockLanes(const sTriangle& block, const uint32_t lane, const int k, const int axis) {
+		return _mm256_load_ps(block.vertices[k][axis] + lane);
+	}
+};
+
+}
+}
+
+#include "simd_kernels_impl.hpp"
+
+namespace specter {
+
+const SimdKernels avx2Kernels = simd::makeKernels<simd::AVX2>();
+
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
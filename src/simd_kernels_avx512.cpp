@@ -0,0 +1,148 @@
+#include "aabb.hpp"
+#include "model.hpp"
+#include "simd_kernels.hpp"
+#include "triangle.hpp"
+
+#include <algorithm>
+
+#include <immintrin.h>
+
+// The kernels of this translation unit are restricted to AVX-512F and don't contract multiplies and adds into
+// fused multiply-adds, see simd_kernels_impl.hpp. MSVC compiles the intrinsics without /arch flags.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))), apply_to = function)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+
+namespace specter {
+namespace simd {
+
+// Only AVX-512F instructions are used, which every CPU supporting AVX-512 has
+struct AVX512 {
+	static constexpr SimdLevel level = SimdLevel::AVX512;
+	static constexpr int width = 16;
+	using Float = __m512;
+	using Mask = __mmask16;
+
+	static Float set1(const float f) { return _mm512_set1_ps(f); }
+	static Float zero() { return _mm512_setzero_ps(); }
+	static Float load(const float* p) { return _mm512_load_ps(p); }
+	static void store(float* p, const Float a) { _mm512_store_ps(p, a); }
+	static Float add(const Float a, const Float b) { return _mm512_add_ps(a, b); }
+	static Float sub(const Float a, const Float b) { return _mm512_sub_ps(a, b); }
+	static Float mul(const Float a, const Float b) { return _mm512_mul_ps(a, b); }
+	static Float div(const Float a, const Float b) { return _mm512_div_ps(a, b); }
+	static Float min(const Float a, const Float b) { return _mm512_min_ps(a, b); }
+	static Float max(const Float a, const Float b) { return _mm512_max_ps(a, b); }
+	static Float abs(const Float a) { return _mm512_abs_ps(a); }
+
+	static Mask lt(const Float a, const Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	static Mask le(const Float a, const Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	static Mask gt(const Float a, const Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+	static Mask ge(const Float a, const Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+	static Mask neq(const Float a, const Float b) { return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_OQ); }
+	static Mask maskAnd(const Mask a, const Mask b) { return _mm512_kand(a, b); }
+	static Mask maskOr(const Mask a, const Mask b) { return _mm512_kor(a, b); }
+	static Mask maskAndNot(const Mask a, const Mask b) { return _mm512_kandn(a, b); }
+	static uint32_t bits(const Mask a) { return static_cast<uint32_t>(a); }
+
+	// Gathers up to sixteen triangles into the lanes of a packet, see AVX2::gatherTriangles().
+	// The gathers are masked, such that the lanes after "count" are zero and no memory is read for them.
+	static void gatherTriangles(const FaceElement* faces, const vec3f* vertices, const uint32_t* indices, const uint32_t count, Float packet[3][3]) {
+		static_assert(sizeof(FaceElement) == 3 * sizeof(int), "Face elements are gathered as three integers");
+		static_assert(sizeof(vec3f) == 3 * sizeof(float), "Vertices are gathered as three floats");
+
+		const __mmask16 lanes = static_cast<__mmask16>(count >= 16 ? 0xFFFF : (1u << count) - 1);
+		const __m512i triangles = _mm512_maskz_loadu_epi32(lanes, indices);
+		const __m512i faceOffsets = _mm512_add_epi32(_mm512_maskz_slli_epi32(lanes, triangles, 3), triangles);
+		const int* faceData = reinterpret_cast<const int*>(faces);
+		const float* vertexData = reinterpret_cast<const float*>(vertices);
+
+		for (int k = 0; k < 3; ++k) {
+			const __m512i vertexIdx = _mm512_mask_i32gather_epi32(_mm512_setzero_si512(), lanes, faceOffsets, faceData + 3 * k, 4);
+			const __m512i vertexOffsets = _mm512_add_epi32(_mm512_maskz_slli_epi32(lanes, vertexIdx, 1), vertexIdx);
+			for (int axis = 0; axis < 3; ++axis) {
+				packet[k][axis] = _mm512_mask_i32gather_ps(_mm512_setzero_ps(), lanes, vertexOffsets, vertexData + axis, 4);
+			}
+		}
+	}
+};
+
+}
+}
+
+#include "simd_kernels_impl.hpp"
+
+namespace specter {
+namespace simd {
+
+// The nodes have eight children, hence the boxes are tested with eight lanes, like in the AVX2 kernel.
+template<>
+void intersectBoxes<AVX512>(const sAABB& boxes, const Ray& r, float* nearT, float* farT) {
+	const float* mins[3] = { boxes.minx, boxes.miny, boxes.minz };
+	const float* maxs[3] = { boxes.maxx, boxes.maxy, boxes.maxz };
+	const __m256 origin[3] = { _mm256_set1_ps(r.o.x), _mm256_set1_ps(r.o.y), _mm256_set1_ps(r.o.z) };
+	const __m256 invd[3] = { _mm256_set1_ps(r.invd.x), _mm256_set1_ps(r.invd.y), _mm256_set1_ps(r.invd.z) };
+	const __m256 farScale = _mm256_set1_ps(robustFarScale);
+
+	__m256 nearV = _mm256_load_ps(nearT);
+	__m256 farV = _mm256_load_ps(farT);
+	for (int axis = 0; axis < 3; ++axis) {
+		const __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(mins[axis]), origin[axis]), invd[axis]);
+		const __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(maxs[axis]), origin[axis]), invd[axis]);
+		nearV = _mm256_max_ps(_mm256_min_ps(t0, t1), nearV);
+		farV = _mm256_min_ps(_mm256_mul_ps(_mm256_max_ps(t0, t1), farScale), farV);
+	}
+	_mm256_store_ps(nearT, nearV);
+	_mm256_store_ps(farT, farV);
+}
+
+// The boxes of the eight children are dequantized with eight lanes, like in the AVX2 kernel
+template<>
+void dequantizeBoxes<AVX512>(const uint8_t qmin[3][8], const uint8_t qmax[3][8], const vec3f& origin, const vec3f& scale, sAABB& boxes) {
+	float* mins[3] = { boxes.minx, boxes.miny, boxes.minz };
+	float* maxs[3] = { boxes.maxx, boxes.maxy, boxes.maxz };
+	for (int axis = 0; axis < 3; ++axis) {
+		const __m256 o = _mm256_set1_ps(origin[axis]);
+		const __m256 s = _mm256_set1_ps(scale[axis]);
+		const __m256 qminV = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(qmin[axis]))));
+		const __m256 qmaxV = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(qmax[axis]))));
+		_mm256_store_ps(mins[axis], _mm256_add_ps(o, _mm256_mul_ps(qminV, s)));
+		_mm256_store_ps(maxs[axis], _mm256_add_ps(o, _mm256_mul_ps(qmaxV, s)));
+	}
+}
+
+// Two blocks are loaded at once. If the last block has no successor, the upper lanes are zero.
+template<>
+TrianglePacket<AVX512> loadBlocks<AVX512>(const sTriangle* blocks, const uint32_t count, const uint32_t first) {
+	const uint32_t b = first / 8;
+	TrianglePacket<AVX512> packet;
+	for (int k = 0; k < 3; ++k) {
+		for (int axis = 0; axis < 3; ++axis) {
+			const __m512d lower = _mm512_castps_pd(_mm512_maskz_loadu_ps(0x00FF, blocks[b].vertices[k][axis]));
+			const __m512d lanes = b + 1 < count
+				? _mm512_mask_insertf64x4(lower, 0xFF, lower, _mm256_castps_pd(_mm256_load_ps(blocks[b + 1].vertices[k][axis])), 1)
+				: lower;
+			packet.vertices[k][axis] = _mm512_castpd_ps(lanes);
+		}
+	}
+	return packet;
+}
+
+}
+
+const SimdKernels avx512Kernels = simd::makeKernels<simd::AVX512>();
+
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,295 @@
+#pragma once
+// The kernels of simd_kernels.hpp, written once for the vector instructions "S" of a SIMD level.
+// This file is included by the simd_kernels_*.cpp translation units after they restricted the instruction set,
+// such that the kernels are compiled for that set only. S provides:
+//	- width, the number of lanes, and the types Float and Mask of a vector and a comparison result
+//	- arithmetic, min/max and comparisons of vectors, bits() converting a mask into an integer of width bits
+//	- convertBytes(), converting width 8-bit integers to floats
+//	- gatherTriangles(), loading triangles of the mesh into the lanes, and loadBlockLanes(), loading lanes of an sTriangle block.
+//	  Levels with more lanes than a block specialize loadBlocks() instead.
+// The results of lanes, which don't hold a triangle, are discarded with laneBits().
+// The includes of this file have to be included before the instruction set is restricted.
+// The translation units also disable the contraction of multiplies and adds into fused multiply-adds, which AVX-512
+// implies. It would round the edge functions of the watertight test differently than the scalar test and make them
+// inexact, such that rays could slip through the edge shared by two triangles.
+
+#include "aabb.hpp"
+#include "model.hpp"
+#include "simd_kernels.hpp"
+#include "triangle.hpp"
+
+#include <algorithm>
+
+namespace specter {
+namespace simd {
+
+// S::width triangles, one triangle per lane. vertices[k][axis] holds the "axis" coordinates of the k-th vertices.
+template<typename S>
+struct TrianglePacket {
+	typename S::Float vertices[3][3];
+};
+
+// Performs ray-aabb intersection against 8 AABBs, S::width at a time. Levels with more lanes specialize it.
+// nearT and farT have to be initialized by the caller, usually with the ray interval.
+// A box is hit if nearT[i] <= farT[i] after the call.
+template<typename S>
+void intersectBoxes(const sAABB& boxes, const Ray& r, float* nearT, float* farT) {
+	static_assert(S::width <= 8, "The boxes are tested in groups of at most eight lanes");
+	using Float = typename S::Float;
+	const float* mins[3] = { boxes.minx, boxes.miny, boxes.minz };
+	const float* maxs[3] = { boxes.maxx, boxes.maxy, boxes.maxz };
+	const Float origin[3] = { S::set1(r.o.x), S::set1(r.o.y), S::set1(r.o.z) };
+	const Float invd[3] = { S::set1(r.invd.x), S::set1(r.invd.y), S::set1(r.invd.z) };
+	const Float farScale = S::set1(robustFarScale);
+
+	for (int first = 0; first < 8; first += S::width) {
+		Float nearV = S::load(nearT + first);
+		Float farV = S::load(farT + first);
+		for (int axis = 0; axis < 3; ++axis) {
+			const Float t0 = S::mul(S::sub(S::load(mins[axis] + first), origin[axis]), invd[axis]);
+			const Float t1 = S::mul(S::sub(S::load(maxs[axis] + first), origin[axis]), invd[axis]);
+			nearV = S::max(S::min(t0, t1), nearV);
+			farV = S::min(S::mul(S::max(t0, t1), farScale), farV);
+		}
+		S::store(nearT + first, nearV);
+		S::store(farT + first, farV);
+	}
+}
+
+// Performs the moeller&trumbore test of the ray against all lanes of the packet at once, see rayIntersectMoellerTrumbore().
+// Returns the mask of the lanes, which are intersected within the interval (ray.tmin, tmax). The barycentric
+// coordinates and distances of all lanes are written to u, v and t, but they are only meaningful for the lanes of the mask.
+template<typename S>
+typename S::Mask intersectPacketMoellerTrumbore(const Ray& ray, const TrianglePacket<S>& packet, const float tmax,
+												typename S::Float& u, typename S::Float& v, typename S::Float& t) {
+	using Float = typename S::Float;
+	const Float* v0 = packet.vertices[0];
+	const Float* v1 = packet.vertices[1];
+	const Float* v2 = packet.vertices[2];
+	const Float dx = S::set1(ray.d.x);
+	const Float dy = S::set1(ray.d.y);
+	const Float dz = S::set1(ray.d.z);
+	Float e0[3], e1[3];
+	for (int k = 0; k < 3; ++k) {
+		e0[k] = S::sub(v1[k], v0[k]);
+		e1[k] = S::sub(v2[k], v0[k]);
+	}
+
+	// q = cross(d, e1), a = dot(e0, q)
+	const Float qx = S::sub(S::mul(dy, e1[2]), S::mul(dz, e1[1]));
+	const Float qy = S::sub(S::mul(dz, e1[0]), S::mul(dx, e1[2]));
+	const Float qz = S::sub(S::mul(dx, e1[1]), S::mul(dy, e1[0]));
+	const Float a = S::add(S::add(S::mul(e0[0], qx), S::mul(e0[1], qy)), S::mul(e0[2], qz));
+
+	// Rays parallel to the triangle and degenerate triangles are rejected
+	auto mask = S::ge(S::abs(a), S::set1(1e-7f));
+
+	const Float f = S::div(S::set1(1.f), a);
+	const Float sx = S::sub(S::set1(ray.o.x), v0[0]);
+	const Float sy = S::sub(S::set1(ray.o.y), v0[1]);
+	const Float sz = S::sub(S::set1(ray.o.z), v0[2]);
+	u = S::mul(f, S::add(S::add(S::mul(sx, qx), S::mul(sy, qy)), S::mul(sz, qz)));
+	mask = S::maskAnd(mask, S::ge(u, S::zero()));
+
+	// r = cross(s, e0)
+	const Float rx = S::sub(S::mul(sy, e0[2]), S::mul(sz, e0[1]));
+	const Float ry = S::sub(S::mul(sz, e0[0]), S::mul(sx, e0[2]));
+	const Float rz = S::sub(S::mul(sx, e0[1]), S::mul(sy, e0[0]));
+	v = S::mul(f, S::add(S::add(S::mul(dx, rx), S::mul(dy, ry)), S::mul(dz, rz)));
+	mask = S::maskAnd(mask, S::ge(v, S::zero()));
+	mask = S::maskAnd(mask, S::le(S::add(u, v), S::set1(1.f)));
+
+	t = S::mul(f, S::add(S::add(S::mul(e1[0], rx), S::mul(e1[1], ry)), S::mul(e1[2], rz)));
+	mask = S::maskAnd(mask, S::gt(t, S::set1(ray.tmin)));
+	return S::maskAnd(mask, S::lt(t, S::set1(tmax)));
+}
+
+// Performs the watertight test of the ray against all lanes of the packet at once, see rayIntersectWatertight().
+// The results are the same as those of intersectPacketMoellerTrumbore(). Degenerate triangles are rejected, because
+// their edge functions are all zero.
+template<typename S>
+typename S::Mask intersectPacketWatertight(	const Ray& ray, const TrianglePacket<S>& packet, const float tmax,
+											typename S::Float& u, typename S::Float& v, typename S::Float& t) {
+	using Float = typename S::Float;
+	const Float origin[3] = { S::set1(ray.o.x), S::set1(ray.o.y), S::set1(ray.o.z) };
+	const Float shearX = S::set1(ray.shear.x);
+	const Float shearY = S::set1(ray.shear.y);
+
+	// Translates the vertices to the ray origin and shears them. z is kept unscaled for the distance.
+	auto transform = [&](const Float* vertex, Float& x, Float& y, Float& z) {
+		z = S::sub(vertex[ray.kz], origin[ray.kz]);
+		x = S::sub(S::sub(vertex[ray.kx], origin[ray.kx]), S::mul(shearX, z));
+		y = S::sub(S::sub(vertex[ray.ky], origin[ray.ky]), S::mul(shearY, z));
+	};
+	Float ax, ay, az, bx, by, bz, cx, cy, cz;
+	transform(packet.vertices[0], ax, ay, az);
+	transform(packet.vertices[1], bx, by, bz);
+	transform(packet.vertices[2], cx, cy, cz);
+
+	// Scaled barycentric coordinates of v0, v1 and v2
+	const Float w0 = S::sub(S::mul(cx, by), S::mul(cy, bx));
+	const Float w1 = S::sub(S::mul(ax, cy), S::mul(ay, cx));
+	const Float w2 = S::sub(S::mul(bx, ay), S::mul(by, ax));
+
+	// The ray misses, if the edge functions have different signs
+	const Float zero = S::zero();
+	const auto anyNegative = S::maskOr(S::maskOr(S::lt(w0, zero), S::lt(w1, zero)), S::lt(w2, zero));
+	const auto anyPositive = S::maskOr(S::maskOr(S::gt(w0, zero), S::gt(w1, zero)), S::gt(w2, zero));
+	const Float det = S::add(S::add(w0, w1), w2);
+	auto mask = S::maskAndNot(S::maskAnd(anyNegative, anyPositive), S::neq(det, zero));
+
+	const Float scaledT = S::mul(S::set1(ray.shear.z), S::add(S::add(S::mul(w0, az), S::mul(w1, bz)), S::mul(w2, cz)));
+	const Float invDet = S::div(S::set1(1.f), det);
+	t = S::mul(scaledT, invDet);
+	u = S::mul(w1, invDet);
+	v = S::mul(w2, invDet);
+	mask = S::maskAnd(mask, S::gt(t, S::set1(ray.tmin)));
+	return S::maskAnd(mask, S::lt(t, S::set1(tmax)));
+}
+
+// Returns the bits of the lanes, which are intersected within the interval (ray.tmin, tmax)
+template<typename S>
+uint32_t intersectPacket(	const TriangleTest test, const Ray& ray, const TrianglePacket<S>& packet, const float tmax,
+							typename S::Float& u, typename S::Float& v, typename S::Float& t) {
+	return S::bits(test == TriangleTest::Watertight
+		? intersectPacketWatertight<S>(ray, packet, tmax, u, v, t)
+		: intersectPacketMoellerTrumbore<S>(ray, packet, tmax, u, v, t));
+}
+
+// Returns the bits of the first "count" lanes of a packet
+template<typename S>
+uint32_t laneBits(const uint32_t count) {
+	static_assert(S::width < 32, "The lanes of a packet are returned as bits of an integer");
+	return (1u << count) - 1;
+}
+
+// Returns the lane with the smallest distance among the lanes of the mask, which must not be empty.
+// Its barycentric coordinates and distance are written to u, v and t.
+template<typename S>
+int closestLane(const uint32_t mask, const typename S::Float& U, const typename S::Float& V, const typename S::Float& T, float& u, float& v, float& t) {
+	alignas(64) float lanes[3][S::width];
+	S::store(lanes[0], U);
+	S::store(lanes[1], V);
+	S::store(lanes[2], T);
+	int closest = -1;
+	for (int i = 0; i < S::width; ++i) {
+		if ((mask >> i & 1) && (closest < 0 || lanes[2][i] < lanes[2][closest])) {
+			closest = i;
+		}
+	}
+	u = lanes[0][closest];
+	v = lanes[1][closest];
+	t = lanes[2][closest];
+	return closest;
+}
+
+template<typename S>
+int intersectTriangles(	const TriangleTest test, const Ray& ray, const FaceElement* faces, const vec3f* vertices,
+						const uint32_t* indices, const uint32_t count, float& u, float& v, float& t) {
+	int closest = -1;
+	float tmax = ray.tmax;
+	for (uint32_t first = 0; first < count; first += S::width) {
+		const uint32_t lanes = std::min<uint32_t>(count - first, S::width);
+		TrianglePacket<S> packet;
+		S::gatherTriangles(faces, vertices, indices + first, lanes, packet.vertices);
+		typename S::Float U, V, T;
+		const uint32_t mask = intersectPacket<S>(test, ray, packet, tmax, U, V, T) & laneBits<S>(lanes);
+		if (mask != 0) {
+			closest = static_cast<int>(first) + closestLane<S>(mask, U, V, T, u, v, t);
+			tmax = t;
+		}
+	}
+	return closest;
+}
+
+template<typename S>
+bool intersectTrianglesAny(	const TriangleTest test, const Ray& ray, const FaceElement* faces, const vec3f* vertices,
+							const uint32_t* indices, const uint32_t count) {
+	for (uint32_t first = 0; first < count; first += S::width) {
+		const uint32_t lanes = std::min<uint32_t>(count - first, S::width);
+		TrianglePacket<S> packet;
+		S::gatherTriangles(faces, vertices, indices + first, lanes, packet.vertices);
+		typename S::Float U, V, T;
+		if ((intersectPacket<S>(test, ray, packet, ray.tmax, U, V, T) & laneBits<S>(lanes)) != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Loads the lanes [first, first + S::width) of the blocks, where lane 8 * b + i is the i-th lane of block b.
+// The lanes lie in a single block, hence the number of blocks is only needed by the specializations.
+template<typename S>
+TrianglePacket<S> loadBlocks(const sTriangle* blocks, const uint32_t /*count*/, const uint32_t first) {
+	static_assert(S::width <= 8, "The lanes of a packet have to lie in a single block");
+	TrianglePacket<S> packet;
+	for (int k = 0; k < 3; ++k) {
+		for (int axis = 0; axis < 3; ++axis) {
+			packet.vertices[k][axis] = S::loadBlockLanes(blocks[first / 8], first % 8, k, axis);
+		}
+	}
+	return packet;
+}
+
+template<typename S>
+int intersectBlocks(const TriangleTest test, const Ray& ray, const sTriangle* blocks, const uint32_t count, float& u, float& v, float& t) {
+	int closest = -1;
+	float tmax = ray.tmax;
+	for (uint32_t first = 0; first < 8 * count; first += S::width) {
+		typename S::Float U, V, T;
+		const uint32_t lanes = std::min<uint32_t>(8 * count - first, S::width);
+		const uint32_t mask = intersectPacket<S>(test, ray, loadBlocks<S>(blocks, count, first), tmax, U, V, T) & laneBits<S>(lanes);
+		if (mask != 0) {
+			closest = static_cast<int>(first) + closestLane<S>(mask, U, V, T, u, v, t);
+			tmax = t;
+		}
+	}
+	return closest;
+}
+
+template<typename S>
+bool intersectBlocksAny(const TriangleTest test, const Ray& ray, const sTriangle* blocks, const uint32_t count) {
+	for (uint32_t first = 0; first < 8 * count; first += S::width) {
+		typename S::Float U, V, T;
+		const uint32_t lanes = std::min<uint32_t>(8 * count - first, S::width);
+		if ((intersectPacket<S>(test, ray, loadBlocks<S>(blocks, count, first), ray.tmax, U, V, T) & laneBits<S>(lanes)) != 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// Dequantizes the boxes S::width at a time. Levels with more lanes specialize it.
+// The products of the 8-bit coordinates and the powers of two of the compressed nodes are exact,
+// hence the coordinates only round once.
+template<typename S>
+void dequantizeBoxes(const uint8_t qmin[3][8], const uint8_t qmax[3][8], const vec3f& origin, const vec3f& scale, sAABB& boxes) {
+	static_assert(S::width <= 8, "The boxes are dequantized in groups of at most eight lanes");
+	float* mins[3] = { boxes.minx, boxes.miny, boxes.minz };
+	float* maxs[3] = { boxes.maxx, boxes.maxy, boxes.maxz };
+	for (int axis = 0; axis < 3; ++axis) {
+		const typename S::Float o = S::set1(origin[axis]);
+		const typename S::Float s = S::set1(scale[axis]);
+		for (int first = 0; first < 8; first += S::width) {
+			S::store(mins[axis] + first, S::add(o, S::mul(S::convertBytes(qmin[axis] + first), s)));
+			S::store(maxs[axis] + first, S::add(o, S::mul(S::convertBytes(qmax[axis] + first), s)));
+		}
+	}
+}
+
+// Table of the kernels compiled for S
+template<typename S>
+constexpr SimdKernels makeKernels() {
+	return SimdKernels{
+		S::level,
+		&intersectBoxes<S>,
+		&intersectTriangles<S>,
+		&intersectTrianglesAny<S>,
+		&intersectBlocks<S>,
+		&intersectBlocksAny<S>,
+		&dequantizeBoxes<S>
+	};
+}
+
+}
+}
@@ -0,0 +1,101 @@
+#include "aabb.hpp"
+#include "model.hpp"
+#include "simd_kernels.hpp"
+#include "triangle.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <immintrin.h>
+
+// The kernels of this translation unit are restricted to SSE4.2 and don't contract multiplies and adds into
+// fused multiply-adds, see simd_kernels_impl.hpp. MSVC compiles the intrinsics without /arch flags.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("sse4.2"))), apply_to = function)
+#pragma clang fp contract(off)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+#pragma GCC optimize("fp-contract=off")
+#elif defined(_MSC_VER)
+#pragma fp_contract(off)
+#endif
+
+namespace specter {
+namespace simd {
+
+struct SSE42 {
+	static constexpr SimdLevel level = SimdLevel::SSE42;
+	static constexpr int width = 4;
+	using Float = __m128;
+	using Mask = __m128;
+
+	static Float set1(const float f) { return _mm_set1_ps(f); }
+	static Float zero() { return _mm_setzero_ps(); }
+	static Float load(const float* p) { return _mm_load_ps(p); }
+	static void store(float* p, const Float a) { _mm_store_ps(p, a); }
+	static Float add(const Float a, const Float b) { return _mm_add_ps(a, b); }
+	static Float sub(const Float a, const Float b) { return _mm_sub_ps(a, b); }
+	static Float mul(const Float a, const Float b) { return _mm_mul_ps(a, b); }
+	static Float div(const Float a, const Float b) { return _mm_div_ps(a, b); }
+	static Float min(const Float a, const Float b) { return _mm_min_ps(a, b); }
+	static Float max(const Float a, const Float b) { return _mm_max_ps(a, b); }
+	static Float abs(const Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.f), a); }
+
+	// Ordered comparisons, which are false if either operand is NaN
+	static Mask lt(const Float a, const Float b) { return _mm_cmplt_ps(a, b); }
+	static Mask le(const Float a, const Float b) { return _mm_cmple_ps(a, b); }
+	static Mask gt(const Float a, const Float b) { return _mm_cmpgt_ps(a, b); }
+	static Mask ge(const Float a, const Float b) { return _mm_cmpge_ps(a, b); }
+	static Mask neq(const Float a, const Float b) { return _mm_and_ps(_mm_cmpneq_ps(a, b), _mm_cmpord_ps(a, b)); }
+	static Mask maskAnd(const Mask a, const Mask b) { return _mm_and_ps(a, b); }
+	static Mask maskOr(const Mask a, const Mask b) { return _mm_or_ps(a, b); }
+	static Mask maskAndNot(const Mask a, const Mask b) { return _mm_andnot_ps(a, b); }
+	static uint32_t bits(const Mask a) { return static_cast<uint32_t>(_mm_movemask_ps(a)); }
+
+	static Float convertBytes(const uint8_t* q) {
+		int packed;
+		std::memcpy(&packed, q, sizeof(packed));
+		return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+	}
+
+	// There are no gathers, the lanes are filled one triangle at a time. The lanes after "count" are zero.
+	static void gatherTriangles(const FaceElement* faces, const vec3f* vertices, const uint32_t* indices, const uint32_t count, Float packet[3][3]) {
+		alignas(16) float lanes[3][3][4] = {};
+		for (uint32_t i = 0; i < count; ++i) {
+			for (int k = 0; k < 3; ++k) {
+				const vec3f& p = vertices[faces[indices[i] * 3 + k].p];
+				lanes[k][0][i] = p.x;
+				lanes[k][1][i] = p.y;
+				lanes[k][2][i] = p.z;
+			}
+		}
+		for (int k = 0; k < 3; ++k) {
+			for (int axis = 0; axis < 3; ++axis) {
+				packet[k][axis] = _mm_load_ps(lanes[k][axis]);
+			}
+		}
+	}
+
+	// A block is loaded in two halves
+	static Float loadBlockLanes(const sTriangle& block, const uint32_t lane, const int k, const int axis) {
+		return _mm_load_ps(block.vertices[k][axis] + lane);
+	}
+};
+
+}
+}
+
+#include "simd_kernels_impl.hpp"
+
+namespace specter {
+
+const SimdKernels sse42Kernels = simd::makeKernels<simd::SSE42>();
+
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
@@ -0,0 +1,197 @@
+#include "top_level_bvh.hpp"
+
+#include <algorithm>
+
+// The top level is a BVH, which is at most 60 levels deep. The stack holds at most one node per level.
+#define nTraversalStackSize (64)
+
+namespace specter {
+
+// Returns true if the ray hits the bounding box of the node within the ray interval.
+// nearT is the distance at which the ray enters the box.
+static inline bool intersectBounds(const BVH::Node& node, const Ray& ray, float& nearT) {
+	const vec3f t0 = (node.bmin - ray.o) * ray.invd;
+	const vec3f t1 = (node.bmax - ray.o) * ray.invd;
+	nearT = std::max(maxComponent(minv(t0, t1)), ray.tmin);
+	const float farT = std::min(minComponent(maxv(t0, t1)) * robustFarScale, ray.tmax);
+	return nearT <= farT;
+}
+
+// Returns the ray in the object space of the instance. The direction isn't normalized,
+// such that the ray parameters of both spaces refer to the same points.
+static inline Ray toObjectSpace(const Instance& instance, const Ray& ray) {
+	return Ray(transformPoint(instance.worldToObject, ray.o), transformVector(instance.worldToObject, ray.d), ray.tmin, ray.tmax);
+}
+
+// Returns the bounds of the vertices of the model
+static AxisAlignedBoundingBox computeModelBounds(const Model& model) {
+	const uint32_t nVertices = static_cast<uint32_t>(model.GetVertexCount());
+	vec3f bmin(std::numeric_limits<float>::max());
+	vec3f bmax(std::numeric_limits<float>::lowest());
+	for (uint32_t i = 0; i < nVertices; ++i) {
+		bmin = minComponent(bmin, model.GetVertex(i));
+		bmax = maxComponent(bmax, model.GetVertex(i));
+	}
+	return AxisAlignedBoundingBox(bmin, bmax);
+}
+
+uint32_t TopLevelBVH::addObject(std::shared_ptr<Model>& model) {
+	objects.push_back(model);
+	objectBounds.push_back(computeModelBounds(*model));
+	structures.emplace_back();
+	return static_cast<uint32_t>(objects.size() - 1);
+}
+
+void TopLevelBVH::updateObjectBounds(const uint32_t object) {
+	objectBounds[object] = computeModelBounds(*objects[object]);
+	for (Instance& instance : instances) {
+		if (instance.object == object) {
+			updateBounds(instance);
+		}
+	}
+}
+
+uint32_t TopLevelBVH::addInstance(const uint32_t object, const mat4f& transform) {
+	Instance instance;
+	instance.object = object;
+	instances.push_back(instance);
+	setTransform(static_cast<uint32_t>(instances.size() - 1), transform);
+	return static_cast<uint32_t>(instances.size() - 1);
+}
+
+void TopLevelBVH::setTransform(const uint32_t instance, const mat4f& transform) {
+	instances[instance].objectToWorld = transform;
+	instances[instance].worldToObject = inverse(transform);
+	updateBounds(instances[instance]);
+}
+
+void TopLevelBVH::setObjectStructure(const uint32_t object, std::unique_ptr<IAccelStructure> structure) {
+	structures[object] = std::move(structure);
+}
+
+void TopLevelBVH::updateBounds(Instance& instance) const {
+	// The bounds of the transformed corners contain the transformed model
+	const AxisAlignedBoundingBox& bounds = objectBounds[instance.object];
+	vec3f bmin(std::numeric_limits<float>::max());
+	vec3f bmax(std::numeric_limits<float>::lowest());
+	for (int corner = 0; corner < 8; ++corner) {
+		const vec3f p(	(corner & 1) ? bounds.max.x : bounds.min.x,
+						(corner & 2) ? bounds.max.y : bounds.min.y,
+						(corner & 4) ? bounds.max.z : bounds.min.z);
+		const vec3f q = transformPoint(instance.objectToWorld, p);
+		bmin = minComponent(bmin, q);
+		bmax = maxComponent(bmax, q);
+	}
+	instance.bounds = AxisAlignedBoundingBox(bmin, bmax);
+}
+
+void TopLevelBVH::buildTopLevel() {
+	std::vector<AxisAlignedBoundingBox> instanceBounds(instances.size());
+	for (std::size_t i = 0; i < instances.size(); ++i) {
+		instanceBounds[i] = instances[i].bounds;
+	}
+	topLevel.build(instanceBounds);
+}
+
+bool TopLevelBVH::traverse(const Ray& ray, Intersection& intersection) const {
+	// The interval of the local ray is shrunk, whenever a closer intersection is found.
+	Ray r(ray);
+	r.tmax = std::min(ray.tmax, intersection.t);
+
+	struct StackEntry {
+		uint32_t nodeIdx;
+		float nearT;
+	};
+	StackEntry stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	const auto& nodes = topLevel.GetNodes();
+	const auto& instanceIndices = topLevel.GetTriangleIndices();
+	float nearT;
+	if (intersectBounds(nodes[0], r, nearT)) {
+		stack[stackSize++] = { 0, nearT };
+	}
+
+	uint32_t hitInstance = std::numeric_limits<uint32_t>::max();
+	while (stackSize > 0) {
+		const StackEntry entry = stack[--stackSize];
+		// The bounding box lies behind the closest intersection found so far
+		if (entry.nearT > r.tmax) {
+			continue;
+		}
+
+		const BVH::Node& node = nodes[entry.nodeIdx];
+		if (node.IsLeaf()) {
+			for (uint32_t i = node.offset; i < node.offset + node.nTriangles; ++i) {
+				// The bottom level keeps the intersection, unless it finds a closer one
+				const Instance& instance = instances[instanceIndices[i]];
+				const float closestT = intersection.t;
+				structures[instance.object]->traverse(objects[instance.object].get(), toObjectSpace(instance, r), intersection);
+				if (intersection.t < closestT) {
+					r.tmax = intersection.t;
+					hitInstance = instanceIndices[i];
+				}
+			}
+			continue;
+		}
+
+		StackEntry hits[2];
+		int nHits = 0;
+		for (uint32_t c = node.offset; c < node.offset + 2; ++c) {
+			if (intersectBounds(nodes[c], r, nearT)) {
+				hits[nHits++] = { c, nearT };
+			}
+		}
+
+		// The closer child is pushed last, such that it is visited first
+		if (nHits == 2 && hits[0].nearT < hits[1].nearT) {
+			std::swap(hits[0], hits[1]);
+		}
+		for (int k = 0; k < nHits; ++k) {
+			stack[stackSize++] = hits[k];
+		}
+	}
+
+	if (hitInstance != std::numeric_limits<uint32_t>::max()) {
+		// Normals are transformed by the inverse transpose of the transform
+		const Instance& instance = instances[hitInstance];
+		intersection.p = ray.o + intersection.t * ray.d;
+		intersection.n = normalize(transformVector(transpose(instance.worldToObject), intersection.n));
+		return true;
+	}
+	return intersection.isValid();
+}
+
+bool TopLevelBVH::traverseAny(const Ray& ray) const {
+	uint32_t stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	const auto& nodes = topLevel.GetNodes();
+	const auto& instanceIndices = topLevel.GetTriangleIndices();
+	float nearT;
+	if (intersectBounds(nodes[0], ray, nearT)) {
+		stack[stackSize++] = 0;
+	}
+
+	while (stackSize > 0) {
+		const BVH::Node& node = nodes[stack[--stackSize]];
+		if (node.IsLeaf()) {
+			for (uint32_t i = node.offset; i < node.offset + node.nTriangles; ++i) {
+				const Instance& instance = instances[instanceIndices[i]];
+				if (structures[instance.object]->traverseAny(objects[instance.object].get(), toObjectSpace(instance, ray))) {
+					return true;
+				}
+			}
+			continue;
+		}
+
+		for (uint32_t c = node.offset; c < node.offset + 2; ++c) {
+			if (intersectBounds(nodes[c], ray, nearT)) {
+				stack[stackSize++] = c;
+			}
+		}
+	}
+	return false;
+}
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include "aabb.hpp"
+#include "accel_structure.hpp"
+#include "bvh.hpp"
+#include "mat4.hpp"
+#include "model.hpp"
+
+#include <memory>
+#include <vector>
+
+namespace specter {
+
+// Placement of a model in the scene
+struct Instance {
+	uint32_t object;	// Index of the model, whose bottom-level structure is shared by all of its instances
+	mat4f objectToWorld;
+	mat4f worldToObject;
+	AxisAlignedBoundingBox bounds;	// Bounds of the transformed model in world space
+};
+
+// Two-level acceleration structure. The bottom level holds one structure per model in object space,
+// which is shared by all instances of the model. The top level is a BVH over the bounds of the instances
+// in world space. Rays are transformed into the object space of every instance, whose bounds they hit.
+// Changing a transform only rebuilds the top level.
+class TopLevelBVH {
+
+public:
+
+	// Adds a model, which is referenced by instances. Returns the index of the object.
+	uint32_t addObject(std::shared_ptr<Model>& model);
+
+	// Places the object in the scene. "transform" maps object space to world space, its translation
+	// is stored in the last column. Returns the index of the instance.
+	uint32_t addInstance(const uint32_t object, const mat4f& transform);
+
+	// Moves the instance. The top level has to be rebuilt afterwards, see buildTopLevel().
+	void setTransform(const uint32_t instance, const mat4f& transform);
+
+	// Recomputes the bounds of the object and of its instances after the vertices of its model have moved.
+	// The top level has to be rebuilt afterwards, see buildTopLevel().
+	void updateObjectBounds(const uint32_t object);
+
+	// Sets the bottom-level structure of the object, which has to be built for its model already.
+	void setObjectStructure(const uint32_t object, std::unique_ptr<IAccelStructure> structure);
+
+	// Builds the hierarchy over the instances
+	void buildTopLevel();
+
+	// Traverse the hierarchy. Returns true if the ray intersects geometry of any instance.
+	// Additionally, it is guaranteed that the intersection point is the closest intersection point to the ray origin.
+	// The position and the normal of the intersection are in world space.
+	bool traverse(const Ray& ray, Intersection& intersection) const;
+
+	// Traverse the hierarchy. Returns true if the ray intersects any geometry within the ray interval.
+	bool traverseAny(const Ray& ray) const;
+
+	std::shared_ptr<Model>& GetObject(const uint32_t object) {
+		return objects[object];
+	}
+
+	IAccelStructure& GetObjectStructure(const uint32_t object) {
+		return *structures[object];
+	}
+
+	const IAccelStructure& GetObjectStructure(const uint32_t object) const {
+		return *structures[object];
+	}
+
+	// Returns true if the bottom-level structure of the object has been set
+	bool hasObjectStructure(const uint32_t object) const {
+		return structures[object] != nullptr;
+	}
+
+	std::size_t GetObjectCount() const {
+		return objects.size();
+	}
+
+	std::size_t GetInstanceCount() const {
+		return instances.size();
+	}
+
+	bool isEmpty() const {
+		return instances.empty();
+	}
+
+private:
+
+	// Transforms the bounds of the object into world space
+	void updateBounds(Instance& instance) const;
+
+private:
+
+	std::vector<std::shared_ptr<Model>> objects;
+	std::vector<AxisAlignedBoundingBox> objectBounds;	// Bounds of every model in object space
+	std::vector<std::unique_ptr<IAccelStructure>> structures;	// Bottom-level structure of every object
+	std::vector<Instance> instances;
+	BVH topLevel;	// The leaves reference the indices of the instances
+};
+
+}
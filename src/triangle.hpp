@@ -1,8 +1,12 @@
 #pragma once
+#include "accel_parameters.hpp"
 #include "intersection.hpp"
 #include "ray.hpp"
 #include "vec3.hpp"
 
+#include <cstdint>
+#include <limits>
+
 namespace specter {
 
 class Triangle {
@@ -16,9 +20,122 @@ public:
 		, v2(pV2)
 	{}
 
-	bool intersect(const Ray& r_in, Intersection& hit_record);
+	// Returns true if the ray intersects the triangle within the ray interval
+	bool intersect(const Ray& r_in, Intersection& hit_record, const TriangleTest test = TriangleTest::MoellerTrumbore);
 
 	vec3f v0, v1, v2;
 };
 
+// Implements the mller&trumbore algorithm.
+// For implementation reference: Real-time rendering 4th ed, 22.8 Ray/Triangle Intersection
+// Returns true only if the intersection lies within the ray interval (tmin, tmax).
+inline bool rayIntersectMoellerTrumbore(const Ray& ray, const vec3f& v0, const vec3f& v1, const vec3f& v2, float& u, float& v, float& t) {
+	const float epsilon = 1e-7;
+	const vec3f e0 = v1 - v0;
+	const vec3f e1 = v2 - v0;
+
+	const vec3f q = cross(ray.d, e1);
+	const float a = dot(e0, q);
+
+	if (a > -epsilon && a < epsilon) {
+		return false;
+	}
+
+	const float f = 1.f / a;
+	const vec3f s = ray.o - v0;
+	u = f * dot(s, q);
+
+	if (u < 0.f) return false;
+
+	const vec3f r = cross(s, e0);
+	v = f * dot(ray.d, r);
+
+	if (v < 0.f || u + v > 1.f) return false;
+
+	t = f * dot(e1, r);
+	return t > ray.tmin && t < ray.tmax;
+}
+
+// Implements the watertight test. The vertices are translated to the ray origin and sheared with the
+// transformation precomputed by the ray, such that the ray becomes the positive z axis. The 2D edge functions
+// of an edge shared by two triangles are then exactly opposite, as long as the compiler doesn't contract them
+// into fused multiply-adds. The SIMD kernels disable the contraction in their translation units, and the rest of
+// specter is compiled for SSE4.2, which has no fused multiply-adds. Builds enabling them everywhere, e.g. with
+// -march=native, lose the guarantee for this scalar test, unless they pass -ffp-contract=off to GCC and Clang.
+// Edge functions of zero count as inside, hence a ray through a shared edge hits both triangles.
+// Reference: Woop, Benthin and Wald, Watertight Ray/Triangle Intersection
+// Returns true only if the intersection lies within the ray interval (tmin, tmax).
+inline bool rayIntersectWatertight(const Ray& ray, const vec3f& v0, const vec3f& v1, const vec3f& v2, float& u, float& v, float& t) {
+	const vec3f a = v0 - ray.o;
+	const vec3f b = v1 - ray.o;
+	const vec3f c = v2 - ray.o;
+
+	const float ax = a[ray.kx] - ray.shear.x * a[ray.kz];
+	const float ay = a[ray.ky] - ray.shear.y * a[ray.kz];
+	const float bx = b[ray.kx] - ray.shear.x * b[ray.kz];
+	const float by = b[ray.ky] - ray.shear.y * b[ray.kz];
+	const float cx = c[ray.kx] - ray.shear.x * c[ray.kz];
+	const float cy = c[ray.ky] - ray.shear.y * c[ray.kz];
+
+	// Scaled barycentric coordinates of v0, v1 and v2
+	const float w0 = cx * by - cy * bx;
+	const float w1 = ax * cy - ay * cx;
+	const float w2 = bx * ay - by * ax;
+
+	if ((w0 < 0.f || w1 < 0.f || w2 < 0.f) && (w0 > 0.f || w1 > 0.f || w2 > 0.f)) {
+		return false;
+	}
+
+	// The ray lies in the plane of the triangle
+	const float det = w0 + w1 + w2;
+	if (det == 0.f) {
+		return false;
+	}
+
+	const float scaledT = ray.shear.z * (w0 * a[ray.kz] + w1 * b[ray.kz] + w2 * c[ray.kz]);
+	const float invDet = 1.f / det;
+	t = scaledT * invDet;
+	u = w1 * invDet;
+	v = w2 * invDet;
+	return t > ray.tmin && t < ray.tmax;
+}
+
+inline bool rayIntersectTriangle(const TriangleTest test, const Ray& ray, const vec3f& v0, const vec3f& v1, const vec3f& v2, float& u, float& v, float& t) {
+	return test == TriangleTest::Watertight
+		? rayIntersectWatertight(ray, v0, v1, v2, u, v, t)
+		: rayIntersectMoellerTrumbore(ray, v0, v1, v2, u, v, t);
+}
+
+// SoA implementation of eight triangles, used as precomputed leaf data in accelerating structures.
+// The vertices are stored as they are, since the edges of the mller&trumbore test are cheap to compute,
+// and the watertight test needs the exact vertices. Unused lanes hold degenerate triangles, which are never intersected.
+struct sTriangle {
+
+	static constexpr uint32_t InvalidIndex = std::numeric_limits<uint32_t>::max();
+
+	sTriangle() {
+		for (int i = 0; i < 8; ++i) {
+			store(i, InvalidIndex, vec3f(0.f), vec3f(0.f), vec3f(0.f));
+		}
+	}
+
+	// Stores the triangle with index "index" and vertices p0, p1 and p2 in the i-th lane
+	void store(const int i, const uint32_t index, const vec3f& p0, const vec3f& p1, const vec3f& p2) {
+		indices[i] = index;
+		const vec3f* p[3] = { &p0, &p1, &p2 };
+		for (int k = 0; k < 3; ++k) {
+			for (int axis = 0; axis < 3; ++axis) {
+				vertices[k][axis][i] = (*p[k])[axis];
+			}
+		}
+	}
+
+	// The blocks are intersected by the SIMD kernels, see SimdKernels::intersectBlocks().
+	// vertices[k][axis] holds the "axis" coordinates of the k-th vertices of the eight lanes.
+	struct alignas(32) {
+		float vertices[3][3][8];
+		uint32_t indices[8];
+	};
+};
+
 }
@@ -0,0 +1,350 @@
+#include "wide_bvh.hpp"
+
+#include <algorithm>
+
+#define nWidth (8)
+
+// Hierarchies deeper than this can't be traversed. Binary hierarchies are at most as deep as this.
+#define nMaxTraversalDepth (128)
+// Every visited node replaces itself on the stack by at most eight children.
+#define nTraversalStackSize ((nWidth - 1) * nMaxTraversalDepth + 1)
+
+namespace specter {
+
+// Reference to a node of a binary hierarchy, which is being collapsed
+struct BinaryNodeRef {
+	uint32_t index;
+	bool leaf;
+};
+
+// Provides access to the nodes of a binary BVH for the collapse
+struct BVHSource {
+
+	BinaryNodeRef GetRoot() const {
+		return { 0, bvh.GetNodes()[0].IsLeaf() };
+	}
+
+	AxisAlignedBoundingBox GetBounds(const BinaryNodeRef& ref) const {
+		return bvh.GetNodes()[ref.index].GetBounds();
+	}
+
+	void GetChildren(const BinaryNodeRef& ref, BinaryNodeRef* children) const {
+		const auto& nodes = bvh.GetNodes();
+		const uint32_t left = nodes[ref.index].offset;
+		children[0] = { left, nodes[left].IsLeaf() };
+		children[1] = { left + 1, nodes[left + 1].IsLeaf() };
+	}
+
+	void appendTriangles(const BinaryNodeRef& ref, std::vector<uint32_t>& triIndices) const {
+		const BVH::Node& node = bvh.GetNodes()[ref.index];
+		const uint32_t* first = bvh.GetTriangleIndices().data() + node.offset;
+		triIndices.insert(triIndices.end(), first, first + node.nTriangles);
+	}
+
+	const BVH& bvh;
+};
+
+// Provides access to the nodes of a LBVH for the collapse. The leaves of a LBVH are its triangles.
+struct LBVHSource {
+
+	BinaryNodeRef GetRoot() const {
+		return { 0, false };
+	}
+
+	AxisAlignedBoundingBox GetBounds(const BinaryNodeRef& ref) const {
+		if (!ref.leaf) {
+			return lbvh.GetBoundingVolumes()[ref.index];
+		}
+		const vec3f v0 = model.GetVertex(model.GetFace(ref.index * 3 + 0).p);
+		const vec3f v1 = model.GetVertex(model.GetFace(ref.index * 3 + 1).p);
+		const vec3f v2 = model.GetVertex(model.GetFace(ref.index * 3 + 2).p);
+		return AxisAlignedBoundingBox(minComponent(minComponent(v0, v1), v2), maxComponent(maxComponent(v0, v1), v2));
+	}
+
+	void GetChildren(const BinaryNodeRef& ref, BinaryNodeRef* children) const {
+		const InternalNode& node = lbvh.GetInternalNodes()[ref.index];
+		children[0] = { static_cast<uint32_t>(node.leftIdx), (node.childLeaf & 1) != 0 };
+		children[1] = { static_cast<uint32_t>(node.rightIdx), (node.childLeaf & 2) != 0 };
+	}
+
+	void appendTriangles(const BinaryNodeRef& ref, std::vector<uint32_t>& triIndices) const {
+		triIndices.push_back(ref.index);
+	}
+
+	const CPU_LBVH& lbvh;
+	const Model& model;
+};
+
+// Stores "box" as the i-th bounding box of "boxes"
+static void storeBox(const AxisAlignedBoundingBox& box, sAABB& boxes, const int i) {
+	boxes.minx[i] = box.min.x;
+	boxes.miny[i] = box.min.y;
+	boxes.minz[i] = box.min.z;
+
+	boxes.maxx[i] = box.max.x;
+	boxes.maxy[i] = box.max.y;
+	boxes.maxz[i] = box.max.z;
+}
+
+static AxisAlignedBoundingBox extractBox(const sAABB& boxes, const int i) {
+	return AxisAlignedBoundingBox(	vec3f(boxes.minx[i], boxes.miny[i], boxes.minz[i]),
+									vec3f(boxes.maxx[i], boxes.maxy[i], boxes.maxz[i]));
+}
+
+void WideBVH::build(const BVH& bvh) {
+	collapse(BVHSource{ bvh });
+}
+
+void WideBVH::build(const CPU_LBVH& lbvh, const Model& model) {
+	collapse(LBVHSource{ lbvh, model });
+}
+
+template<typename BinarySource>
+void WideBVH::collapse(const BinarySource& source) {
+	struct PendingNode {
+		uint32_t nodeIdx;
+		BinaryNodeRef ref;
+		unsigned depth;
+	};
+
+	nodes.clear();
+	triIndices.clear();
+	nodes.emplace_back();
+	bounds = source.GetBounds(source.GetRoot());
+	maxDepth = 0;
+
+	std::vector<PendingNode> pending;
+	pending.push_back({ 0, source.GetRoot(), 1 });
+	while (!pending.empty()) {
+		const PendingNode current = pending.back();
+		pending.pop_back();
+		maxDepth = std::max(maxDepth, current.depth);
+		if (maxDepth > nMaxTraversalDepth) {
+			throw std::runtime_error("The binary hierarchy is too deep to be collapsed");
+		}
+
+		// The node adopts the children of the binary node. Interior children are replaced by
+		// their own children, largest surface area first, until all slots are occupied.
+		BinaryNodeRef slots[nWidth];
+		AxisAlignedBoundingBox slotBounds[nWidth];
+		int nSlots = 0;
+		if (current.ref.leaf) {
+			// Only the root of a hierarchy of a single leaf
+			slots[nSlots++] = current.ref;
+		} else {
+			source.GetChildren(current.ref, slots);
+			nSlots = 2;
+		}
+		for (int k = 0; k < nSlots; ++k) {
+			slotBounds[k] = source.GetBounds(slots[k]);
+		}
+
+		while (nSlots < nWidth) {
+			int largest = -1;
+			float largestArea = -1.f;
+			for (int k = 0; k < nSlots; ++k) {
+				if (!slots[k].leaf && slotBounds[k].surfaceArea() > largestArea) {
+					largest = k;
+					largestArea = slotBounds[k].surfaceArea();
+				}
+			}
+			if (largest == -1) {
+				break;
+			}
+
+			BinaryNodeRef children[2];
+			source.GetChildren(slots[largest], children);
+			slots[largest] = children[0];
+			slots[nSlots] = children[1];
+			slotBounds[largest] = source.GetBounds(children[0]);
+			slotBounds[nSlots] = source.GetBounds(children[1]);
+			++nSlots;
+		}
+
+		for (int k = 0; k < nSlots; ++k) {
+			// The node is accessed by index, because the array grows
+			storeBox(slotBounds[k], nodes[current.nodeIdx].boxes, k);
+			Child& child = nodes[current.nodeIdx].children[k];
+			if (slots[k].leaf) {
+				child.offset = static_cast<uint32_t>(triIndices.size());
+				source.appendTriangles(slots[k], triIndices);
+				child.nTriangles = static_cast<uint32_t>(triIndices.size()) - child.offset;
+			} else {
+				const uint32_t childIdx = static_cast<uint32_t>(nodes.size());
+				nodes.emplace_back();
+				nodes[current.nodeIdx].children[k] = { childIdx, Child::InteriorTag };
+				pending.push_back({ childIdx, slots[k], current.depth + 1 });
+			}
+		}
+		for (int k = nSlots; k < nWidth; ++k) {
+			storeBox(AxisAlignedBoundingBox(), nodes[current.nodeIdx].boxes, k);
+		}
+	}
+
+	nodes.shrink_to_fit();
+	triIndices.shrink_to_fit();
+}
+
+bool WideBVH::traverse(const Model* model, const Ray& ray, Intersection& intersection) const {
+	// The interval of the local ray is shrunk, whenever a closer intersection is found.
+	Ray r(ray);
+	r.tmax = std::min(ray.tmax, intersection.t);
+
+	// Nodes, whose bounding box is hit by the ray, are pushed onto the stack
+	// together with the distance at which the ray enters the bounding box.
+	struct StackEntry {
+		uint32_t nodeIdx;
+		float nearT;
+	};
+	StackEntry stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	float rootNearT, rootFarT;
+	if (bounds.rayIntersectv2(r, rootNearT, rootFarT)) {
+		stack[stackSize++] = { 0, rootNearT };
+	}
+
+	alignas(32) float nearT[nWidth];
+	alignas(32) float farT[nWidth];
+	float u, v, t;
+	float best_u = 0.f, best_v = 0.f;
+	uint32_t best_i = std::numeric_limits<uint32_t>::max();
+	while (stackSize > 0) {
+		const StackEntry entry = stack[--stackSize];
+		// The bounding box lies behind the closest intersection found so far
+		if (entry.nearT > r.tmax) {
+			continue;
+		}
+
+		const Node& node = nodes[entry.nodeIdx];
+		for (int k = 0; k < nWidth; ++k) {
+			nearT[k] = r.tmin;
+			farT[k] = r.tmax;
+		}
+		node.boxes.rayIntersect(r, nearT, farT);
+
+		// Leaves are intersected directly. Interior children are sorted by distance afterwards,
+		// such that they are culled by intersections found in the leaves.
+		StackEntry hits[nWidth];
+		int nHits = 0;
+		for (int k = 0; k < nWidth; ++k) {
+			const Child& child = node.children[k];
+			if (!child.IsValid() || !(nearT[k] <= farT[k])) {
+				continue;
+			}
+
+			if (child.IsInterior()) {
+				hits[nHits++] = { child.offset, nearT[k] };
+				continue;
+			}
+
+			const int hitIdx = model->rayIntersectionClosest(r, triIndices.data() + child.offset, child.nTriangles, u, v, t);
+			if (hitIdx >= 0) {
+				r.tmax = t;
+				intersection.t = t;
+				best_u = u;
+				best_v = v;
+				best_i = triIndices[child.offset + hitIdx];
+			}
+		}
+
+		// Sort the hits by decreasing distance, such that the closest child is visited first.
+		for (int i = 1; i < nHits; ++i) {
+			const StackEntry hit = hits[i];
+			int j = i - 1;
+			for (; j >= 0 && hits[j].nearT < hit.nearT; --j) {
+				hits[j + 1] = hits[j];
+			}
+			hits[j + 1] = hit;
+		}
+		for (int k = 0; k < nHits; ++k) {
+			if (hits[k].nearT <= r.tmax) {
+				stack[stackSize++] = hits[k];
+			}
+		}
+	}
+
+	if (best_i != std::numeric_limits<uint32_t>::max()) {
+		model->computeSurfaceInteraction(best_i, best_u, best_v, r, intersection);
+		return true;
+	}
+	return intersection.isValid();
+}
+
+bool WideBVH::traverseAny(const Model* model, const Ray& ray) const {
+	uint32_t stack[nTraversalStackSize];
+	int stackSize = 0;
+
+	float rootNearT, rootFarT;
+	if (bounds.rayIntersectv2(ray, rootNearT, rootFarT)) {
+		stack[stackSize++] = 0;
+	}
+
+	alignas(32) float nearT[nWidth];
+	alignas(32) float farT[nWidth];
+	while (stackSize > 0) {
+		const Node& node = nodes[stack[--stackSize]];
+		for (int k = 0; k < nWidth; ++k) {
+			nearT[k] = ray.tmin;
+			farT[k] = ray.tmax;
+		}
+		node.boxes.rayIntersect(ray, nearT, farT);
+
+		for (int k = 0; k < nWidth; ++k) {
+			const Child& child = node.children[k];
+			if (!child.IsValid() || !(nearT[k] <= farT[k])) {
+				continue;
+			}
+
+			if (child.IsInterior()) {
+				stack[stackSize++] = child.offset;
+				continue;
+			}
+
+			// Any triangle found, therefore further processing can stop.
+			if (model->rayIntersectionAny(ray, triIndices.data() + child.offset, child.nTriangles)) {
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+std::size_t WideBVH::GetLeafCount() const {
+	std::size_t nLeaves = 0;
+	for (const Node& node : nodes) {
+		nLeaves += std::count_if(node.children, node.children + nWidth, [](const Child& child) { return child.IsLeaf(); });
+	}
+	return nLeaves;
+}
+
+LeafSizeHistogram WideBVH::GetLeafSizeHistogram() const {
+	LeafSizeHistogram histogram;
+	for (const Node& node : nodes) {
+		for (int k = 0; k < nWidth; ++k) {
+			if (node.children[k].IsLeaf()) {
+				++histogram[node.children[k].nTriangles];
+			}
+		}
+	}
+	return histogram;
+}
+
+float WideBVH::ComputeExpectedRayCost() const {
+	// The probability that a ray hitting the root also hits a node is the ratio of their surface areas.
+	const float rootArea = bounds.surfaceArea();
+	double cost = rootArea * costTraversal;
+	for (const Node& node : nodes) {
+		for (int k = 0; k < nWidth; ++k) {
+			const Child& child = node.children[k];
+			if (child.IsInterior()) {
+				cost += extractBox(node.boxes, k).surfaceArea() * costTraversal;
+			} else if (child.IsLeaf()) {
+				cost += extractBox(node.boxes, k).surfaceArea() * costIntersection * child.nTriangles;
+			}
+		}
+	}
+	return rootArea > 0.f ? cost / rootArea : 0.f;
+}
+
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include "aabb.hpp"
+#include "accel_stats.hpp"
+#include "bvh.hpp"
+#include "dev/cpu_lbvh.hpp"
+#include "model.hpp"
+
+#include <tbb/cache_aligned_allocator.h>
+
+#include <vector>
+
+namespace specter {
+
+// Bounding volume hierarchy with eight children per node, which is collapsed from a binary hierarchy.
+// The boxes of the children of a node are stored in a single sAABB, such that a ray is tested
+// against all of them in one pass of the SIMD kernel. Compared to the binary hierarchy, the wide
+// hierarchy has about a third of the nodes and of the depth.
+// Reference: Ylitie et al., Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs
+struct WideBVH {
+
+	// Represents a child slot of a node. The layout is the same as that of the octree nodes.
+	struct Child {
+
+		// Marks a child as interior node in the nTriangles field.
+		static constexpr uint32_t InteriorTag = std::numeric_limits<uint32_t>::max();
+
+		bool IsValid() const {
+			return nTriangles != 0;
+		}
+
+		bool IsInterior() const {
+			return nTriangles == InteriorTag;
+		}
+
+		bool IsLeaf() const {
+			return IsValid() && !IsInterior();
+		}
+
+		// For interior children, this is the index of the node. For leaf children,
+		// this is the position of the first triangle index in the index pool.
+		uint32_t offset = 0;
+		// Specifies the number of triangles of a leaf child.
+		// Interior children are tagged with InteriorTag, unused slots have no triangles.
+		uint32_t nTriangles = 0;
+	};
+
+	struct Node {
+		sAABB boxes;	// Bounding boxes of the children
+		Child children[8];
+	};
+
+	static_assert(sizeof(Node) == 256, "A node has to occupy exactly four cache lines");
+
+	// Collapses the binary hierarchy. The triangle indices of the leaves are copied,
+	// hence "bvh" may be released afterwards.
+	void build(const BVH& bvh);
+
+	// Collapses the LBVH. The bounds of the triangles, which the LBVH doesn't keep, are taken from the model.
+	void build(const CPU_LBVH& lbvh, const Model& model);
+
+	// Traverse the hierarchy. Returns true if the ray intersects geometry in the mesh.
+	// Additionally, it is guaranteed that the intersection point is the closest intersection point to the ray origin
+	bool traverse(const Model* model, const Ray& ray, Intersection& intersection) const;
+
+	// Traverse the hierarchy. Returns true if the ray intersects any geometry in the mesh
+	// within the ray interval.
+	bool traverseAny(const Model* model, const Ray& ray) const;
+
+	// Returns the nodes of the hierarchy. The root is stored at index 0.
+	const std::vector<Node, tbb::cache_aligned_allocator<Node>>& GetNodes() const {
+		return nodes;
+	}
+
+	// Returns the pool of triangle indices referenced by leaf children
+	const std::vector<uint32_t>& GetTriangleIndices() const {
+		return triIndices;
+	}
+
+	// Returns the bounding box of the root node
+	const AxisAlignedBoundingBox& GetBounds() const {
+		return bounds;
+	}
+
+	std::size_t GetNodeCount() const {
+		return nodes.size();
+	}
+
+	std::size_t GetLeafCount() const;
+	// Returns the number of distinct triangles referenced by the leaves
+	std::size_t GetUniqueTriangleCount() const {
+		return countUniqueTriangles(triIndices);
+	}
+	LeafSizeHistogram GetLeafSizeHistogram() const;
+
+	// Returns the number of bytes occupied by the nodes and the triangle indices
+	std::size_t GetMemoryUsage() const {
+		return nodes.size() * sizeof(Node) + triIndices.size() * sizeof(uint32_t);
+	}
+
+	// Returns the number of levels of the hierarchy
+	unsigned GetMaxDepth() const {
+		return maxDepth;
+	}
+
+	// Returns the expected cost of tracing a ray according to the surface area heuristic
+	float ComputeExpectedRayCost() const;
+
+private:
+
+	// Collapses the binary hierarchy accessed through "source", see the sources in wide_bvh.cpp
+	template<typename BinarySource>
+	void collapse(const BinarySource& source);
+
+private:
+
+	std::vector<Node, tbb::cache_aligned_allocator<Node>> nodes;	// Nodes of the hierarchy. The root is stored at index 0.
+	std::vector<uint32_t> triIndices;	// Shared pool of the triangle indices referenced by leaf children.
+	AxisAlignedBoundingBox bounds;	// Bounding box of the root node.
+	unsigned maxDepth = 0;
+};
+
+}